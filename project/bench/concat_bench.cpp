@@ -0,0 +1,64 @@
+//----------------------------------------------------------------------
+// FILE: concat_bench.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Benchmark building large strings through CONCAT in a vm loop
+// (s = concat(s, piece)), up to 100 MB
+//----------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "vm.h"
+
+using namespace std;
+
+
+// the string appended on each iteration
+const string PIECE(100, 'x');
+
+
+// the vm program for:
+//   string s = ""
+//   for (int i = 0; i < count; i = i + 1)
+//     s = concat(s, piece)
+//   print(length(s))
+VMFrameInfo concat_loop(int count)
+{
+  VMFrameInfo main {"main", 0};
+  main.instructions = {
+    VMInstr::PUSH(""), VMInstr::STORE(0),
+    VMInstr::PUSH(0), VMInstr::STORE(1),
+    VMInstr::LOAD(1), VMInstr::PUSH(count), VMInstr::CMPLT_INT(),
+    VMInstr::JMPF(17),
+    VMInstr::LOAD(0), VMInstr::PUSH(PIECE), VMInstr::CONCAT(),
+    VMInstr::STORE(0),
+    VMInstr::LOAD(1), VMInstr::PUSH(1), VMInstr::ADD_INT(),
+    VMInstr::STORE(1),
+    VMInstr::JMP(4),
+    VMInstr::LOAD(0), VMInstr::SLEN(), VMInstr::WRITE(),
+    VMInstr::PUSH(nullptr), VMInstr::RET()
+  };
+  return main;
+}
+
+
+int main()
+{
+  // the program itself writes the length column
+  printf("%-10s %10s %12s %12s\n", "size (MB)", "length", "time (ms)",
+         "MB/sec");
+  for (int mb : {1, 10, 100}) {
+    int count = mb * 1000000 / PIECE.size();
+    VM vm;
+    vm.add(concat_loop(count));
+    vm.link();
+    printf("%-10d ", mb);
+    fflush(stdout);
+    auto start = chrono::steady_clock::now();
+    vm.run();
+    auto end = chrono::steady_clock::now();
+    double ms = chrono::duration<double, milli>(end - start).count();
+    printf(" %12.1f %12.1f\n", ms, mb / (ms / 1000.0));
+  }
+}
@@ -0,0 +1,199 @@
+//----------------------------------------------------------------------
+// FILE: value_bench.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Benchmark comparing the std::variant vm values (VMValue) to the
+// NaN-boxed vm words (VMWord): memory footprint and ops/sec of the vm
+// operation helpers
+//----------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include "vm.h"
+
+using namespace std;
+
+
+// heap accounting (every allocation in this program goes through here)
+static size_t heap_bytes = 0;
+
+void* operator new(size_t size)
+{
+  heap_bytes += size;
+  size_t* p = static_cast<size_t*>(malloc(size + sizeof(size_t)));
+  if (!p)
+    throw bad_alloc();
+  *p = size;
+  return p + 1;
+}
+
+void operator delete(void* ptr) noexcept
+{
+  if (!ptr)
+    return;
+  size_t* p = static_cast<size_t*>(ptr) - 1;
+  heap_bytes -= *p;
+  free(p);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+  operator delete(ptr);
+}
+
+
+// the number of values in each test
+const int N = 1000000;
+
+// times to repeat each operation pass
+const int PASSES = 20;
+
+
+// a deterministic mix of ints, doubles, bools, strings, and nulls
+VMValue sample(int i)
+{
+  switch (i % 5) {
+  case 0: return i;
+  case 1: return i * 0.5;
+  case 2: return i % 2 == 0;
+  case 3: return "value-" + to_string(i) + "-of-the-benchmark";
+  default: return nullptr;
+  }
+}
+
+
+template<typename F>
+double millis(F f)
+{
+  auto start = chrono::steady_clock::now();
+  f();
+  auto end = chrono::steady_clock::now();
+  return chrono::duration<double, milli>(end - start).count();
+}
+
+
+void report(const string& name, double variant_ms, double word_ms, long ops)
+{
+  printf("%-28s %12.1f %12.1f %8.2fx\n", name.c_str(),
+         ops / (variant_ms / 1000.0) / 1e6, ops / (word_ms / 1000.0) / 1e6,
+         variant_ms / word_ms);
+}
+
+
+int main()
+{
+  VM vm;
+  long sink = 0;
+
+  //--------------------------------------------------------------------
+  // memory footprint
+  //--------------------------------------------------------------------
+
+  printf("sizeof(VMValue) = %zu bytes, sizeof(VMWord) = %zu bytes\n\n",
+         sizeof(VMValue), sizeof(VMWord));
+
+  size_t before = heap_bytes;
+  vector<VMValue> values;
+  values.reserve(N);
+  for (int i = 0; i < N; ++i)
+    values.push_back(sample(i));
+  size_t variant_bytes = heap_bytes - before;
+
+  before = heap_bytes;
+  VMStringPool pool;
+  vector<VMWord> words;
+  words.reserve(N);
+  for (int i = 0; i < N; ++i)
+    words.push_back(to_word(values[i], pool));
+  size_t word_bytes = heap_bytes - before;
+
+  printf("memory for %d mixed values (including string storage)\n", N);
+  printf("  VMValue: %10.2f MB\n", variant_bytes / 1e6);
+  printf("  VMWord:  %10.2f MB\n\n", word_bytes / 1e6);
+
+  //--------------------------------------------------------------------
+  // operation throughput
+  //--------------------------------------------------------------------
+
+  vector<VMValue> ints, doubles;
+  vector<VMWord> int_words, double_words;
+  for (int i = 0; i < N; ++i) {
+    ints.push_back(i + 1);
+    doubles.push_back(i + 1.5);
+    int_words.push_back(VMWord::from_int(i + 1));
+    double_words.push_back(VMWord::from_double(i + 1.5));
+  }
+  long ops = (long) N * PASSES;
+
+  printf("%-28s %12s %12s %9s\n", "operation (M ops/sec)", "VMValue",
+         "VMWord", "speedup");
+
+  double v = millis([&]() {
+    for (int p = 0; p < PASSES; ++p)
+      for (int i = 1; i < N; ++i)
+        sink += get<int>(vm.add(ints[i - 1], ints[i]));
+  });
+  double w = millis([&]() {
+    for (int p = 0; p < PASSES; ++p)
+      for (int i = 1; i < N; ++i)
+        sink += vm.add(int_words[i - 1], int_words[i]).as_int();
+  });
+  report("add int", v, w, ops);
+
+  v = millis([&]() {
+    for (int p = 0; p < PASSES; ++p)
+      for (int i = 1; i < N; ++i)
+        sink += get<double>(vm.mul(doubles[i - 1], doubles[i])) > 0;
+  });
+  w = millis([&]() {
+    for (int p = 0; p < PASSES; ++p)
+      for (int i = 1; i < N; ++i)
+        sink += vm.mul(double_words[i - 1], double_words[i]).as_double() > 0;
+  });
+  report("mul double", v, w, ops);
+
+  v = millis([&]() {
+    for (int p = 0; p < PASSES; ++p)
+      for (int i = 1; i < N; ++i)
+        sink += get<bool>(vm.lt(ints[i - 1], ints[i]));
+  });
+  w = millis([&]() {
+    for (int p = 0; p < PASSES; ++p)
+      for (int i = 1; i < N; ++i)
+        sink += vm.lt(int_words[i - 1], int_words[i]).as_bool();
+  });
+  report("lt int", v, w, ops);
+
+  v = millis([&]() {
+    for (int p = 0; p < PASSES; ++p)
+      for (int i = 5; i < N; ++i)
+        sink += get<bool>(vm.eq(values[i - 5], values[i]));
+  });
+  w = millis([&]() {
+    for (int p = 0; p < PASSES; ++p)
+      for (int i = 5; i < N; ++i)
+        sink += vm.eq(words[i - 5], words[i]).as_bool();
+  });
+  report("eq mixed (same kinds)", v, w, ops);
+
+  // copying values, as LOAD and DUP do
+  v = millis([&]() {
+    for (int p = 0; p < PASSES; ++p) {
+      vector<VMValue> copy = values;
+      sink += copy.size();
+    }
+  });
+  w = millis([&]() {
+    for (int p = 0; p < PASSES; ++p) {
+      vector<VMWord> copy = words;
+      sink += copy.size();
+    }
+  });
+  report("copy mixed", v, w, ops);
+
+  printf("\n(checksum %ld)\n", sink);
+}
@@ -68,6 +68,13 @@ public:
 // Top-level Abstract AST Nodes
 //----------------------------------------------------------------------
 
+class DataType
+{
+public:
+  bool is_array = false;
+  std::string type_name;
+};
+
 class ASTNode
 {
 public:
@@ -82,6 +89,8 @@ class Stmt : public ASTNode
 class ExprTerm : public ASTNode
 {
 public:
+  // the inferred type of the term (set by the semantic checker)
+  DataType type;
   // helper to return first token in the term
   virtual Token first_token() = 0;
 };
@@ -108,14 +117,6 @@ public:
 };
 
 
-class DataType
-{
-public:
-  bool is_array = false;
-  std::string type_name;
-};
-
-
 class VarDef
 {
 public:
@@ -152,12 +153,17 @@ public:
 class Expr : public ASTNode
 {
 public:
+  // the inferred type of the expression (set by the semantic checker)
+  DataType type;
   bool negated = false;
   std::shared_ptr<ExprTerm> first = nullptr;
   std::optional<Token> op = std::nullopt;
   std::shared_ptr<Expr> rest = nullptr;
   void accept(Visitor& v) { v.visit(*this); }  
   Token first_token() {return first->first_token();}
+  // true if the value comes from a comparison, and/or, or not (so
+  // it is never null), looking inside parentheses
+  bool never_null();
 };
 
 class SimpleTerm : public ExprTerm
@@ -177,6 +183,14 @@ public:
   Token first_token() {return expr.first_token();}
 };
 
+inline bool Expr::never_null()
+{
+  if (negated or op.has_value())
+    return true;
+  ComplexTerm* term = dynamic_cast<ComplexTerm*>(first.get());
+  return term and term->expr.never_null();
+}
+
 
 class SimpleRValue : public RValue
 {
@@ -202,6 +216,8 @@ class VarRef
 public:
   Token var_name;
   std::optional<Expr> array_expr = std::nullopt; 
+  // the type of the referenced value (set by the semantic checker)
+  DataType type;
 };
 
 
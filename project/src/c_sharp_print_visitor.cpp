@@ -282,7 +282,15 @@ void CSharpPrintVisitor::visit(Expr& e) {
         else
             new_op = e.op->lexeme();
         out << " " << new_op << " ";
+        // mypl evaluates the rest first (so a and b or c is a and (b or c)),
+        // which C# only short-circuits the same way in parentheses
+        bool group = (op == "and" or op == "or") and e.rest->op.has_value()
+            and !e.rest->negated;
+        if (group)
+            out << "(";
         e.rest->accept(*this);
+        if (group)
+            out << ")";
     }
     if(e.negated)
         out << ")";
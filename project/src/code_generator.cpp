@@ -6,10 +6,14 @@
 //----------------------------------------------------------------------
 
 #include <iostream>             // for debugging
+#include <unordered_set>
 #include "code_generator.h"
 
 using namespace std;
 
+// hash table of names of the base data types (non-reference values)
+const unordered_set<string> BASE_TYPES {"int", "double", "char", "string", "bool"};
+
 
 // helper function to replace all occurrences of old string with new
 void replace_all(string& s, const string& old_str, const string& new_str)
@@ -19,9 +23,25 @@ void replace_all(string& s, const string& old_str, const string& new_str)
 }
 
 
-CodeGenerator::CodeGenerator(VM& vm)
-  : vm(vm)
+CodeGenerator::CodeGenerator(VM& vm, int opt_level)
+  : vm(vm), opt_level(opt_level)
+{
+}
+
+
+int CodeGenerator::eliminated() const
+{
+  return optimizer.eliminated();
+}
+
+
+void CodeGenerator::stmt(Stmt& s)
 {
+  s.accept(*this);
+  // a call statement (other than print) leaves a value to discard
+  CallExpr* call = dynamic_cast<CallExpr*>(&s);
+  if (call and call->fun_name.lexeme() != "print")
+    curr_frame.instructions.push_back(VMInstr::POP());
 }
 
 
@@ -38,17 +58,12 @@ void CodeGenerator::visit(FunDef& f)
 {
     var_table.push_environment();
     curr_frame = {f.fun_name.lexeme(), (int)f.params.size()};
-    // check every param
-    int count = 0;
-    for(auto varDef : f.params) {
-        string name = varDef.var_name.lexeme();
-        curr_frame.instructions.push_back(VMInstr::STORE(count));
-        count++;
+    // params are the first variables (the vm passes args in place)
+    for(auto varDef : f.params)
         var_table.add(varDef.var_name.lexeme());
-    }
 
     for(auto s : f.stmts)
-        s->accept(*this);
+        stmt(*s);
 
     if(f.return_type.type_name == "void") {
         curr_frame.instructions.push_back(VMInstr::PUSH(nullptr));
@@ -56,6 +71,8 @@ void CodeGenerator::visit(FunDef& f)
     }
 
     // add function frame
+    if (opt_level >= 1)
+        optimizer.optimize(curr_frame);
     vm.add(curr_frame);
     var_table.pop_environment();
 
@@ -65,6 +82,48 @@ void CodeGenerator::visit(FunDef& f)
 void CodeGenerator::visit(StructDef& s)
 {
     struct_defs[s.struct_name.lexeme()] = s;
+    // fields are laid out in declaration order
+    auto& slots = field_slots[s.struct_name.lexeme()];
+    VMStructInfo type {s.struct_name.lexeme()};
+    for (int i = 0; i < s.fields.size(); ++i) {
+        slots[s.fields[i].var_name.lexeme()] = i;
+        type.field_names.push_back(s.fields[i].var_name.lexeme());
+        // struct and array fields hold object references
+        const DataType& field_type = s.fields[i].data_type;
+        if (field_type.is_array or !BASE_TYPES.contains(field_type.type_name))
+            type.reference_slots.push_back(i);
+    }
+    vm.add(type);
+}
+
+
+int CodeGenerator::field_slot(const DataType& type, const Token& field)
+{
+    return field_slots[type.type_name][field.lexeme()];
+}
+
+
+VMInstr CodeGenerator::array_get(const DataType& type)
+{
+    if (type.type_name == "int")
+        return VMInstr::GETI_INT();
+    else if (type.type_name == "double")
+        return VMInstr::GETI_DBL();
+    else if (type.type_name == "bool")
+        return VMInstr::GETI_BOOL();
+    return VMInstr::GETI();
+}
+
+
+VMInstr CodeGenerator::array_set(const DataType& type)
+{
+    if (type.type_name == "int")
+        return VMInstr::SETI_INT();
+    else if (type.type_name == "double")
+        return VMInstr::SETI_DBL();
+    else if (type.type_name == "bool")
+        return VMInstr::SETI_BOOL();
+    return VMInstr::SETI();
 }
 
 
@@ -84,7 +143,7 @@ void CodeGenerator::visit(WhileStmt& s)
     curr_frame.instructions.push_back(VMInstr::JMPF(-1));
     var_table.push_environment();
     for (int i = 0; i < s.stmts.size(); i++)
-        s.stmts[i]->accept(*this);
+        stmt(*s.stmts[i]);
     var_table.pop_environment();
     // jump to start
     curr_frame.instructions.push_back(VMInstr::JMP(jump_index));
@@ -106,7 +165,7 @@ void CodeGenerator::visit(ForStmt& s)
     curr_frame.instructions.push_back(VMInstr::JMPF(-1));
     var_table.push_environment();
     for (int i = 0; i < s.stmts.size(); i++)
-        s.stmts[i]->accept(*this);
+        stmt(*s.stmts[i]);
     var_table.pop_environment();
     s.assign_stmt.accept(*this);
     curr_frame.instructions.push_back(VMInstr::JMP(jump_index));
@@ -127,7 +186,7 @@ void CodeGenerator::visit(IfStmt& s)
     // new environment within if block
     var_table.push_environment();
     for (int i = 0; i < s.if_part.stmts.size(); i++)
-        s.if_part.stmts[i]->accept(*this);
+        stmt(*s.if_part.stmts[i]);
     var_table.pop_environment();
 
     std::vector<int> jmp_indexes;
@@ -141,7 +200,7 @@ void CodeGenerator::visit(IfStmt& s)
         curr_frame.instructions.push_back(VMInstr::JMPF(-1));
         var_table.push_environment();
         for (int j = 0; j < s.else_ifs[i].stmts.size(); j++)
-            s.else_ifs[i].stmts[j]->accept(*this);
+            stmt(*s.else_ifs[i].stmts[j]);
         var_table.pop_environment();
         jmp_indexes.push_back(int(curr_frame.instructions.size()));
         curr_frame.instructions.push_back(VMInstr::JMP(-1));
@@ -151,7 +210,7 @@ void CodeGenerator::visit(IfStmt& s)
     if(s.else_stmts.size() > 0) {
         var_table.push_environment();
         for (int i = 0; i < s.else_stmts.size(); i++)
-            s.else_stmts[i]->accept(*this);
+            stmt(*s.else_stmts[i]);
 
         var_table.pop_environment();
     }
@@ -179,11 +238,11 @@ void CodeGenerator::visit(AssignStmt& s)
         if (i == 0)
             curr_frame.instructions.push_back(VMInstr::LOAD(var_table.get(s.lvalue[0].var_name.lexeme())));
         else
-            curr_frame.instructions.push_back(VMInstr::GETF((s.lvalue[i].var_name.lexeme())));
+            curr_frame.instructions.push_back(VMInstr::GETF(field_slot(s.lvalue[i - 1].type, s.lvalue[i].var_name)));
 
         if(s.lvalue[i].array_expr.has_value()) {
             s.lvalue[i].array_expr.value().accept(*this);
-            curr_frame.instructions.push_back(VMInstr::GETI());
+            curr_frame.instructions.push_back(array_get(s.lvalue[i].type));
         }
     }
 
@@ -192,14 +251,14 @@ void CodeGenerator::visit(AssignStmt& s)
         if (s.lvalue.size() == 1)
             curr_frame.instructions.push_back(VMInstr::LOAD(var_table.get(s.lvalue[0].var_name.lexeme())));
         else
-            curr_frame.instructions.push_back(VMInstr::GETF((s.lvalue[s.lvalue.size() - 1].var_name.lexeme())));
+            curr_frame.instructions.push_back(VMInstr::GETF(field_slot(s.lvalue[s.lvalue.size() - 2].type, s.lvalue[s.lvalue.size() - 1].var_name)));
         s.lvalue[s.lvalue.size() - 1].array_expr.value().accept(*this);
         s.expr.accept(*this);
-        curr_frame.instructions.push_back(VMInstr::SETI());
+        curr_frame.instructions.push_back(array_set(s.lvalue[s.lvalue.size() - 1].type));
     }
     else if (s.lvalue.size() > 1) {
         s.expr.accept(*this);
-        curr_frame.instructions.push_back(VMInstr::SETF(s.lvalue[s.lvalue.size() - 1].var_name.lexeme()));
+        curr_frame.instructions.push_back(VMInstr::SETF(field_slot(s.lvalue[s.lvalue.size() - 2].type, s.lvalue[s.lvalue.size() - 1].var_name)));
     }
     else {
         s.expr.accept(*this);
@@ -245,38 +304,102 @@ void CodeGenerator::visit(Expr& e)
     // get lhs type
     e.first->accept(*this);
 
+    // and/or jump past the rest once the first operand settles the
+    // result (leaving it in place of the rest's value)
+    if(e.op.has_value() and (e.op->lexeme() == "and" or e.op->lexeme() == "or")) {
+        vector<VMInstr>& code = curr_frame.instructions;
+        // the rest's value is checked for null (as the JMPF checks the
+        // first's) by a JMPF to the next instruction
+        auto rest = [&]() {
+            e.rest->accept(*this);
+            if (!e.rest->never_null()) {
+                code.push_back(VMInstr::DUP());
+                code.push_back(VMInstr::JMPF(int(code.size()) + 1));
+            }
+        };
+        int jmpf_index = code.size();
+        code.push_back(VMInstr::JMPF(-1));
+        if (e.op->lexeme() == "and") {
+            rest();
+            int jmp_index = code.size();
+            code.push_back(VMInstr::JMP(-1));
+            code[jmpf_index].set_operand(int(code.size()));
+            code.push_back(VMInstr::PUSH(false));
+            code[jmp_index].set_operand(int(code.size()));
+        }
+        else {
+            code.push_back(VMInstr::PUSH(true));
+            int jmp_index = code.size();
+            code.push_back(VMInstr::JMP(-1));
+            code[jmpf_index].set_operand(int(code.size()));
+            rest();
+            code[jmp_index].set_operand(int(code.size()));
+        }
+    }
     // if op check operator is valid with types
-    if(e.op.has_value()) {
+    else if(e.op.has_value()) {
         // get rhs type
         e.rest->accept(*this);
 
         // check operator is compatible
         string op_val = e.op->lexeme();
 
+        // operand types (from the semantic checker) select a typed
+        // instruction when both sides are the same primitive type
+        const DataType& lhs = e.first->type;
+        const DataType& rhs = e.rest->type;
+        string type = "";
+        if (!lhs.is_array and !rhs.is_array and
+            lhs.type_name == rhs.type_name)
+            type = lhs.type_name;
+        bool is_num = type == "int" or type == "double";
+        bool is_int = type == "int";
+        bool is_cmp = is_num or type == "string" or type == "char";
+        bool is_str = type == "string";
+        bool is_chr = type == "char";
+
         if(op_val == "+")
-            curr_frame.instructions.push_back(VMInstr::ADD());
+            curr_frame.instructions.push_back(!is_num ? VMInstr::ADD() :
+              is_int ? VMInstr::ADD_INT() : VMInstr::ADD_DBL());
         else if(op_val == "-")
-            curr_frame.instructions.push_back(VMInstr::SUB());
+            curr_frame.instructions.push_back(!is_num ? VMInstr::SUB() :
+              is_int ? VMInstr::SUB_INT() : VMInstr::SUB_DBL());
         else if(op_val == "*")
-            curr_frame.instructions.push_back(VMInstr::MUL());
+            curr_frame.instructions.push_back(!is_num ? VMInstr::MUL() :
+              is_int ? VMInstr::MUL_INT() : VMInstr::MUL_DBL());
         else if(op_val == "/")
-            curr_frame.instructions.push_back(VMInstr::DIV());
+            curr_frame.instructions.push_back(!is_num ? VMInstr::DIV() :
+              is_int ? VMInstr::DIV_INT() : VMInstr::DIV_DBL());
         else if(op_val == "==")
-            curr_frame.instructions.push_back(VMInstr::CMPEQ());
+            curr_frame.instructions.push_back(!is_cmp ? VMInstr::CMPEQ() :
+              is_str ? VMInstr::CMPEQ_STR() :
+              is_chr ? VMInstr::CMPEQ_CHR() :
+              is_int ? VMInstr::CMPEQ_INT() : VMInstr::CMPEQ_DBL());
         else if(op_val == "!=")
-            curr_frame.instructions.push_back(VMInstr::CMPNE());
+            curr_frame.instructions.push_back(!is_cmp ? VMInstr::CMPNE() :
+              is_str ? VMInstr::CMPNE_STR() :
+              is_chr ? VMInstr::CMPNE_CHR() :
+              is_int ? VMInstr::CMPNE_INT() : VMInstr::CMPNE_DBL());
         else if(op_val == "<")
-            curr_frame.instructions.push_back(VMInstr::CMPLT());
+            curr_frame.instructions.push_back(!is_cmp ? VMInstr::CMPLT() :
+              is_str ? VMInstr::CMPLT_STR() :
+              is_chr ? VMInstr::CMPLT_CHR() :
+              is_int ? VMInstr::CMPLT_INT() : VMInstr::CMPLT_DBL());
         else if(op_val == ">")
-            curr_frame.instructions.push_back(VMInstr::CMPGT());
+            curr_frame.instructions.push_back(!is_cmp ? VMInstr::CMPGT() :
+              is_str ? VMInstr::CMPGT_STR() :
+              is_chr ? VMInstr::CMPGT_CHR() :
+              is_int ? VMInstr::CMPGT_INT() : VMInstr::CMPGT_DBL());
         else if(op_val == "<=")
-            curr_frame.instructions.push_back(VMInstr::CMPLE());
+            curr_frame.instructions.push_back(!is_cmp ? VMInstr::CMPLE() :
+              is_str ? VMInstr::CMPLE_STR() :
+              is_chr ? VMInstr::CMPLE_CHR() :
+              is_int ? VMInstr::CMPLE_INT() : VMInstr::CMPLE_DBL());
         else if(op_val == ">=")
-            curr_frame.instructions.push_back(VMInstr::CMPGE());
-        else if(op_val == "and")
-            curr_frame.instructions.push_back(VMInstr::AND());
-        else if(op_val == "or")
-            curr_frame.instructions.push_back(VMInstr::OR());
+            curr_frame.instructions.push_back(!is_cmp ? VMInstr::CMPGE() :
+              is_str ? VMInstr::CMPGE_STR() :
+              is_chr ? VMInstr::CMPGE_CHR() :
+              is_int ? VMInstr::CMPGE_INT() : VMInstr::CMPGE_DBL());
     }
 
     if(e.negated)
@@ -327,8 +450,8 @@ void CodeGenerator::visit(SimpleRValue& v)
         string s = v.value.lexeme();
         replace_all(s, "\\n", "\n");
         replace_all(s, "\\t", "\t");
-        // could do more here
-        curr_frame.instructions.push_back(VMInstr::PUSH(s));
+        // chars are vm char values (not one-character strings)
+        curr_frame.instructions.push_back(VMInstr::PUSH(s[0]));
     }
 
 }
@@ -339,19 +462,20 @@ void CodeGenerator::visit(NewRValue& v)
     if (v.array_expr.has_value()) {
         v.array_expr->accept(*this);
         curr_frame.instructions.push_back(VMInstr::PUSH(nullptr));
-        curr_frame.instructions.push_back(VMInstr::ALLOCA());
+        // int, double, and bool arrays are stored unboxed
+        string type = v.type.lexeme();
+        if (type == "int")
+            curr_frame.instructions.push_back(VMInstr::ALLOCA_INT());
+        else if (type == "double")
+            curr_frame.instructions.push_back(VMInstr::ALLOCA_DBL());
+        else if (type == "bool")
+            curr_frame.instructions.push_back(VMInstr::ALLOCA_BOOL());
+        else
+            curr_frame.instructions.push_back(VMInstr::ALLOCA());
     }
     else  {
-        curr_frame.instructions.push_back(VMInstr::ALLOCS());
-        StructDef s = struct_defs[v.type.lexeme()];
-        for(auto varDef : s.fields) {
-            curr_frame.instructions.push_back(VMInstr::DUP());
-            string name = varDef.var_name.lexeme();
-            curr_frame.instructions.push_back(VMInstr::ADDF(name));
-            curr_frame.instructions.push_back(VMInstr::DUP());
-            curr_frame.instructions.push_back(VMInstr::PUSH(nullptr));
-            curr_frame.instructions.push_back(VMInstr::SETF(name));
-        }
+        // the vm creates the object with all fields set to null
+        curr_frame.instructions.push_back(VMInstr::ALLOCS(v.type.lexeme()));
     }
 
 }
@@ -365,17 +489,17 @@ void CodeGenerator::visit(VarRValue& v)
     curr_frame.instructions.push_back(VMInstr::LOAD(var_index));
     if (ref1.array_expr.has_value()) {
         ref1.array_expr->accept(*this);
-        curr_frame.instructions.push_back(VMInstr::GETI());
+        curr_frame.instructions.push_back(array_get(ref1.type));
     }
 
     // go through all paths
     for(int i = 1; i < v.path.size(); ++i) {
         VarRef varRef = v.path[i];
-        curr_frame.instructions.push_back(VMInstr::GETF((varRef.var_name.lexeme())));
+        curr_frame.instructions.push_back(VMInstr::GETF(field_slot(v.path[i - 1].type, varRef.var_name)));
 
         if (varRef.array_expr.has_value()) {
             varRef.array_expr->accept(*this);
-            curr_frame.instructions.push_back(VMInstr::GETI());
+            curr_frame.instructions.push_back(array_get(varRef.type));
         }
     }
 
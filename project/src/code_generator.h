@@ -12,13 +12,15 @@
 #include <string>
 #include <unordered_map>
 #include "ast.h"
+#include "peephole_optimizer.h"
 #include "var_table.h"
 #include "vm.h"
 
 
 class CodeGenerator : public Visitor {
 public:
-  CodeGenerator(VM& vm);
+  // opt_level 1 and up runs the peephole optimizer over each function
+  CodeGenerator(VM& vm, int opt_level = 0);
   void visit(Program& p);
   void visit(FunDef& f);
   void visit(StructDef& s);
@@ -36,13 +38,32 @@ public:
   void visit(NewRValue& v);
   void visit(VarRValue& v);    
 
+  // number of instructions the optimizer eliminated
+  int eliminated() const;
+
 private:
 
   VM& vm;
+  int opt_level;
+  PeepholeOptimizer optimizer;
   VMFrameInfo curr_frame;
   int next_var_index = 0;  
   VarTable var_table;
   std::unordered_map<std::string,StructDef> struct_defs;
+  // field slot offsets (by struct name, then field name)
+  std::unordered_map<std::string,
+                     std::unordered_map<std::string,int>> field_slots;
+
+  // generate code for a statement within a statement list
+  void stmt(Stmt& s);
+
+  // slot offset of the field within objects of the given struct type
+  int field_slot(const DataType& type, const Token& field);
+
+  // array element get and set instructions for the array's type
+  // (unboxed int, double, and bool arrays have their own)
+  VMInstr array_get(const DataType& type);
+  VMInstr array_set(const DataType& type);
 
 };
 
@@ -0,0 +1,179 @@
+//----------------------------------------------------------------------
+// FILE: compile_cache.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: A content-addressed cache of compiled programs
+//----------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <unistd.h>
+#include "compile_cache.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+string to_string(const CompileCacheStats& stats)
+{
+  string s = "";
+  s += "Cache hits........: " + to_string(stats.hits) + "\n";
+  s += "Cache misses......: " + to_string(stats.misses) + "\n";
+  s += "Cache evictions...: " + to_string(stats.evictions) + "\n";
+  s += "Cache entries.....: " + to_string(stats.entries) + "\n";
+  s += "Cache bytes.......: " + to_string(stats.bytes) + "\n";
+  return s;
+}
+
+
+CompileCache::CompileCache()
+{
+  const char* xdg = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  if (xdg and *xdg)
+    directory = string(xdg) + "/mypl";
+  else if (home and *home)
+    directory = string(home) + "/.cache/mypl";
+  error_code ec;
+  if (directory != "")
+    fs::create_directories(directory, ec);
+  if (ec)
+    directory = "";
+}
+
+
+string CompileCache::hash(const vector<string>& parts)
+{
+  // 64-bit FNV-1a, with each part's size mixed in to separate them
+  uint64_t hash = 14695981039346656037u;
+  auto mix = [&hash](const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= static_cast<unsigned char>(data[i]);
+      hash *= 1099511628211u;
+    }
+  };
+  for (const string& part : parts) {
+    uint64_t size = part.size();
+    mix(reinterpret_cast<const char*>(&size), sizeof(size));
+    mix(part.data(), part.size());
+  }
+  char digest[17];
+  snprintf(digest, sizeof(digest), "%016llx", (unsigned long long) hash);
+  return digest;
+}
+
+
+const string& CompileCache::build_id()
+{
+  // the size and modification time of the mypl executable
+  static const string id = [] {
+    error_code ec;
+    auto size = fs::file_size("/proc/self/exe", ec);
+    auto time = fs::last_write_time("/proc/self/exe", ec);
+    if (ec)
+      return string("unknown");
+    return to_string(size) + ":" +
+      to_string(time.time_since_epoch().count());
+  }();
+  return id;
+}
+
+
+string CompileCache::path(const string& name) const
+{
+  return directory + "/" + name;
+}
+
+
+string CompileCache::temp_path(const string& name) const
+{
+  string dir = directory != "" ? directory :
+    fs::temp_directory_path().string();
+  return dir + "/" + name + ".tmp" + to_string(getpid());
+}
+
+
+bool CompileCache::lookup(const string& name)
+{
+  error_code ec;
+  if (directory != "" and fs::exists(path(name), ec)) {
+    // recently used entries are evicted last
+    fs::last_write_time(path(name), fs::file_time_type::clock::now(), ec);
+    ++counts.hits;
+    return true;
+  }
+  ++counts.misses;
+  return false;
+}
+
+
+bool CompileCache::insert(const string& temp, const string& name)
+{
+  error_code ec;
+  if (directory == "")
+    return false;
+  fs::rename(temp, path(name), ec);
+  if (ec)
+    return false;
+  evict();
+  return true;
+}
+
+
+vector<CompileCache::Entry> CompileCache::entries() const
+{
+  vector<Entry> entries;
+  if (directory == "")
+    return entries;
+  auto now = fs::file_time_type::clock::now();
+  error_code ec;
+  for (const auto& file : fs::directory_iterator(directory, ec)) {
+    error_code file_ec;
+    if (!file.is_regular_file(file_ec))
+      continue;
+    Entry entry {file.path(), file.last_write_time(file_ec),
+                 file.file_size(file_ec)};
+    if (file_ec)
+      continue;
+    // entries still being built elsewhere (unless left by a crash)
+    if (entry.path.filename().string().find(".tmp") != string::npos and
+        now - entry.time < chrono::hours(1))
+      continue;
+    entries.push_back(entry);
+  }
+  return entries;
+}
+
+
+void CompileCache::evict()
+{
+  vector<Entry> lru = entries();
+  uintmax_t total = 0;
+  for (const Entry& entry : lru)
+    total += entry.size;
+  // oldest first (another process may remove the same entries)
+  sort(lru.begin(), lru.end(),
+       [](const Entry& x, const Entry& y) {return x.time < y.time;});
+  error_code ec;
+  for (const Entry& entry : lru) {
+    if (total <= MAX_BYTES)
+      break;
+    if (fs::remove(entry.path, ec))
+      ++counts.evictions;
+    total -= entry.size;
+  }
+}
+
+
+CompileCacheStats CompileCache::stats() const
+{
+  CompileCacheStats stats = counts;
+  for (const Entry& entry : entries()) {
+    ++stats.entries;
+    stats.bytes += entry.size;
+  }
+  return stats;
+}
@@ -0,0 +1,103 @@
+//----------------------------------------------------------------------
+// FILE: compile_cache.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: A content-addressed cache of compiled programs
+//----------------------------------------------------------------------
+
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+// Cache statistics (of the current process, apart from the entry count
+// and size of the whole cache)
+class CompileCacheStats
+{
+public:
+
+  long hits = 0;
+  long misses = 0;
+  long evictions = 0;
+
+  // entries and bytes in the cache
+  long entries = 0;
+  long bytes = 0;
+
+};
+
+// function to get a (multi-line) report of the cache statistics
+std::string to_string(const CompileCacheStats& stats);
+
+
+// Compiled programs (bytecode images and native executables) stored in
+// $XDG_CACHE_HOME/mypl (or ~/.cache/mypl), named by a hash of
+// everything they were built from. Entries are built under a temporary
+// name and renamed into place, so concurrent mypl processes only ever
+// see complete entries and never hold a lock. Once the cache outgrows
+// its size limit, the least recently used entries are removed. Errors
+// using the cache directory are ignored (programs are then compiled
+// every time).
+class CompileCache
+{
+public:
+
+  CompileCache();
+
+  // a (hex) content hash of the parts, stable across runs
+  static std::string hash(const std::vector<std::string>& parts);
+
+  // identifies the running mypl build, so a rebuilt mypl never uses
+  // entries compiled by another build
+  static const std::string& build_id();
+
+  // the path of the named entry
+  std::string path(const std::string& name) const;
+
+  // true if the named entry exists (a hit, which marks the entry as
+  // recently used), otherwise false (a miss)
+  bool lookup(const std::string& name);
+
+  // a path (unique to this process) to build the named entry in
+  std::string temp_path(const std::string& name) const;
+
+  // move the file built at the temporary path into the cache as the
+  // named entry, evicting old entries if the cache is over its limit
+  // (returns false, leaving the file in place, if it cannot be added)
+  bool insert(const std::string& temp, const std::string& name);
+
+  // the statistics so far (with the current size of the cache)
+  CompileCacheStats stats() const;
+
+private:
+
+  // cache size (in bytes) above which entries are evicted
+  static const std::uintmax_t MAX_BYTES = std::uintmax_t(256) << 20;
+
+  // the cache directory (empty if it is not usable)
+  std::string directory;
+
+  // hits, misses, and evictions so far
+  CompileCacheStats counts;
+
+  class Entry
+  {
+  public:
+    std::filesystem::path path;
+    std::filesystem::file_time_type time;
+    std::uintmax_t size = 0;
+  };
+
+  // the entries of the cache (skipping those still being built)
+  std::vector<Entry> entries() const;
+
+  // remove least recently used entries until the cache fits its limit
+  void evict();
+
+};
+
+#endif
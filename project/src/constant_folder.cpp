@@ -0,0 +1,498 @@
+//----------------------------------------------------------------------
+// FILE: constant_folder.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Implementation of the constant folding visitor (-O1)
+//----------------------------------------------------------------------
+
+#include <cmath>
+#include <cstdio>
+#include <climits>
+#include "constant_folder.h"
+
+using namespace std;
+
+
+// the literal an expression consists of (if it is a single literal)
+static SimpleRValue* literal(ExprTerm& term)
+{
+  SimpleTerm* simple = dynamic_cast<SimpleTerm*>(&term);
+  if (!simple)
+    return nullptr;
+  return dynamic_cast<SimpleRValue*>(simple->rvalue.get());
+}
+
+static SimpleRValue* literal(Expr& e)
+{
+  if (e.op.has_value() or e.negated)
+    return nullptr;
+  return literal(*e.first);
+}
+
+
+// a term holding the literal value
+static shared_ptr<ExprTerm> literal_term(const Token& value,
+                                         const DataType& type)
+{
+  shared_ptr<SimpleRValue> rvalue = make_shared<SimpleRValue>();
+  rvalue->value = value;
+  shared_ptr<SimpleTerm> term = make_shared<SimpleTerm>();
+  term->rvalue = rvalue;
+  term->type = type;
+  return term;
+}
+
+
+// replace the expression with the literal value
+static void set_literal(Expr& e, const Token& value)
+{
+  e.first = literal_term(value, e.type);
+  e.op = nullopt;
+  e.rest = nullptr;
+  e.negated = false;
+}
+
+
+// the string or char value of a literal (with the escapes the code
+// generator replaces)
+static string decode(const string& lexeme)
+{
+  string s = lexeme;
+  for (auto [escape, c] : {pair<string,string>{"\\n", "\n"}, {"\\t", "\t"}})
+    while (s.find(escape) != string::npos)
+      s.replace(s.find(escape), escape.size(), c);
+  return s;
+}
+
+
+// the lexeme of a double that reads back as the same double (including
+// the sign of a zero, e.g., "-0" for 0.0 * -1.0, which prints
+// differently than 0.0)
+static string double_lexeme(double value)
+{
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.17g", value);
+  return buffer;
+}
+
+
+// the result of comparing two values with the comparison operator
+template<typename T>
+static optional<bool> compare(const string& op, const T& x, const T& y)
+{
+  if (op == "==") return x == y;
+  if (op == "!=") return x != y;
+  if (op == "<") return x < y;
+  if (op == ">") return x > y;
+  if (op == "<=") return x <= y;
+  if (op == ">=") return x >= y;
+  return nullopt;
+}
+
+
+// true if a statement list declares variables in its own scope
+static bool declares(const vector<shared_ptr<Stmt>>& list)
+{
+  for (auto& s : list)
+    if (dynamic_cast<VarDeclStmt*>(s.get()))
+      return true;
+  return false;
+}
+
+
+int ConstantFolder::folded() const
+{
+  return folded_count;
+}
+
+
+void ConstantFolder::stmts(vector<shared_ptr<Stmt>>& list)
+{
+  vector<shared_ptr<Stmt>> result;
+  for (auto& s : list) {
+    s->accept(*this);
+    if (replacement.has_value()) {
+      for (auto& r : *replacement)
+        result.push_back(r);
+      replacement.reset();
+    }
+    else
+      result.push_back(s);
+  }
+  list = result;
+}
+
+
+void ConstantFolder::count_assigns(vector<shared_ptr<Stmt>>& list)
+{
+  for (auto& s : list) {
+    if (auto decl = dynamic_cast<VarDeclStmt*>(s.get()))
+      ++assign_counts[decl->var_def.var_name.lexeme()];
+    else if (auto assign = dynamic_cast<AssignStmt*>(s.get()))
+      ++assign_counts[assign->lvalue[0].var_name.lexeme()];
+    else if (auto loop = dynamic_cast<WhileStmt*>(s.get()))
+      count_assigns(loop->stmts);
+    else if (auto loop = dynamic_cast<ForStmt*>(s.get())) {
+      ++assign_counts[loop->var_decl.var_def.var_name.lexeme()];
+      ++assign_counts[loop->assign_stmt.lvalue[0].var_name.lexeme()];
+      count_assigns(loop->stmts);
+    }
+    else if (auto cond = dynamic_cast<IfStmt*>(s.get())) {
+      count_assigns(cond->if_part.stmts);
+      for (auto& part : cond->else_ifs)
+        count_assigns(part.stmts);
+      count_assigns(cond->else_stmts);
+    }
+  }
+}
+
+
+void ConstantFolder::visit(Program& p)
+{
+  for (auto& fun_def : p.fun_defs)
+    fun_def.accept(*this);
+}
+
+
+void ConstantFolder::visit(FunDef& f)
+{
+  assign_counts.clear();
+  constants.clear();
+  for (auto& param : f.params)
+    ++assign_counts[param.var_name.lexeme()];
+  count_assigns(f.stmts);
+  stmts(f.stmts);
+}
+
+
+void ConstantFolder::visit(StructDef& s)
+{
+}
+
+
+void ConstantFolder::visit(ReturnStmt& s)
+{
+  s.expr.accept(*this);
+}
+
+
+void ConstantFolder::visit(WhileStmt& s)
+{
+  s.condition.accept(*this);
+  SimpleRValue* cond = literal(s.condition);
+  if (cond and cond->value.lexeme() == "false") {
+    replacement = vector<shared_ptr<Stmt>>{};
+    ++folded_count;
+    return;
+  }
+  stmts(s.stmts);
+}
+
+
+void ConstantFolder::visit(ForStmt& s)
+{
+  s.var_decl.accept(*this);
+  s.condition.accept(*this);
+  s.assign_stmt.accept(*this);
+  stmts(s.stmts);
+}
+
+
+void ConstantFolder::visit(IfStmt& s)
+{
+  vector<BasicIf*> parts {&s.if_part};
+  for (auto& part : s.else_ifs)
+    parts.push_back(&part);
+  Token at = s.if_part.condition.first_token();
+
+  // the branches that may run, and the statements run when none do
+  vector<BasicIf> kept;
+  vector<shared_ptr<Stmt>> otherwise = s.else_stmts;
+  bool taken = false;
+  for (int i = 0; i < parts.size(); ++i) {
+    BasicIf* part = parts[i];
+    part->condition.accept(*this);
+    SimpleRValue* cond = literal(part->condition);
+    if (cond and cond->value.lexeme() == "false") {
+      ++folded_count;
+      continue;
+    }
+    stmts(part->stmts);
+    if (cond and cond->value.lexeme() == "true") {
+      // the rest of the branches never run
+      otherwise = part->stmts;
+      folded_count += parts.size() - i;
+      taken = true;
+      break;
+    }
+    kept.push_back(*part);
+  }
+  if (!taken)
+    stmts(otherwise);
+
+  if (!kept.empty()) {
+    s.if_part = kept[0];
+    s.else_ifs.assign(kept.begin() + 1, kept.end());
+    s.else_stmts = otherwise;
+  }
+  else if (!declares(otherwise))
+    replacement = otherwise;
+  else {
+    // keep the statements in a scope of their own
+    s.if_part.condition.type = DataType {false, "bool"};
+    set_literal(s.if_part.condition, Token(TokenType::BOOL_VAL, "true",
+                                           at.line(), at.column()));
+    s.if_part.stmts = otherwise;
+    s.else_ifs.clear();
+    s.else_stmts.clear();
+  }
+}
+
+
+void ConstantFolder::visit(VarDeclStmt& s)
+{
+  s.expr.accept(*this);
+  const DataType& type = s.var_def.data_type;
+  string name = s.var_def.var_name.lexeme();
+  SimpleRValue* value = literal(s.expr);
+  if (value and value->value.type() != TokenType::NULL_VAL and
+      !type.is_array and assign_counts[name] == 1)
+    constants[name] = value->value;
+}
+
+
+void ConstantFolder::visit(AssignStmt& s)
+{
+  for (auto& ref : s.lvalue)
+    if (ref.array_expr.has_value())
+      ref.array_expr->accept(*this);
+  s.expr.accept(*this);
+}
+
+
+void ConstantFolder::visit(CallExpr& e)
+{
+  for (auto& arg : e.args)
+    arg.accept(*this);
+}
+
+
+void ConstantFolder::visit(Expr& e)
+{
+  e.first->accept(*this);
+  fold_term(e.first);
+  if (e.op.has_value())
+    e.rest->accept(*this);
+
+  SimpleRValue* lhs = literal(*e.first);
+  if (!lhs)
+    return;
+  Token value = lhs->value;
+  if (e.op.has_value()) {
+    SimpleRValue* rhs = literal(*e.rest);
+    string op_val = e.op->lexeme();
+    bool logical = op_val == "and" or op_val == "or";
+    if (!rhs and logical and value.type() == TokenType::BOOL_VAL) {
+      // the rest only runs when the first operand doesn't settle the
+      // result (true and rest, false or rest), and is the result then
+      // (unless it could be null, which the and/or checks)
+      if ((op_val == "and") == (value.lexeme() == "true")) {
+        Expr rest = *e.rest;
+        rest.negated = e.negated != e.rest->negated;
+        if (!rest.never_null())
+          return;
+        e = rest;
+        ++folded_count;
+        return;
+      }
+      // otherwise the first operand is the result
+    }
+    else {
+      if (!rhs)
+        return;
+      optional<Token> result = fold_binary(*e.op, value, rhs->value);
+      if (!result.has_value())
+        return;
+      value = *result;
+    }
+  }
+  if (e.negated) {
+    if (value.type() != TokenType::BOOL_VAL)
+      return;
+    string negation = value.lexeme() == "true" ? "false" : "true";
+    value = Token(TokenType::BOOL_VAL, negation, value.line(), value.column());
+  }
+  if (e.op.has_value() or e.negated) {
+    set_literal(e, value);
+    ++folded_count;
+  }
+}
+
+
+void ConstantFolder::visit(SimpleTerm& t)
+{
+  t.rvalue->accept(*this);
+}
+
+
+void ConstantFolder::visit(ComplexTerm& t)
+{
+  t.expr.accept(*this);
+}
+
+
+void ConstantFolder::visit(SimpleRValue& v)
+{
+}
+
+
+void ConstantFolder::visit(NewRValue& v)
+{
+  if (v.array_expr.has_value())
+    v.array_expr->accept(*this);
+}
+
+
+void ConstantFolder::visit(VarRValue& v)
+{
+  for (auto& ref : v.path)
+    if (ref.array_expr.has_value())
+      ref.array_expr->accept(*this);
+}
+
+
+void ConstantFolder::fold_term(shared_ptr<ExprTerm>& term)
+{
+  // a parenthesized literal
+  if (auto complex = dynamic_cast<ComplexTerm*>(term.get())) {
+    if (literal(complex->expr))
+      term = complex->expr.first;
+    return;
+  }
+  SimpleTerm* simple = dynamic_cast<SimpleTerm*>(term.get());
+  if (!simple)
+    return;
+
+  // a constant variable
+  if (auto var = dynamic_cast<VarRValue*>(simple->rvalue.get())) {
+    const VarRef& ref = var->path[0];
+    string name = ref.var_name.lexeme();
+    if (var->path.size() == 1 and !ref.array_expr.has_value() and
+        constants.contains(name)) {
+      Token value = constants[name];
+      term = literal_term(Token(value.type(), value.lexeme(),
+                                ref.var_name.line(), ref.var_name.column()),
+                          term->type);
+      ++folded_count;
+    }
+    return;
+  }
+
+  // built-in string functions of string literals
+  auto call = dynamic_cast<CallExpr*>(simple->rvalue.get());
+  if (!call)
+    return;
+  string fun_name = call->fun_name.lexeme();
+  vector<Token> args;
+  for (auto& arg : call->args) {
+    SimpleRValue* value = literal(arg);
+    if (!value or value->value.type() != TokenType::STRING_VAL)
+      return;
+    args.push_back(value->value);
+  }
+  Token at = call->fun_name;
+  if (fun_name == "concat" and args.size() == 2) {
+    // an escape can't span the two strings
+    string x = args[0].lexeme();
+    string y = args[1].lexeme();
+    if (!x.empty() and x.back() == '\\')
+      return;
+    term = literal_term(Token(TokenType::STRING_VAL, x + y, at.line(),
+                              at.column()), term->type);
+    ++folded_count;
+  }
+  else if (fun_name == "length" and args.size() == 1) {
+    string length = to_string(decode(args[0].lexeme()).size());
+    term = literal_term(Token(TokenType::INT_VAL, length, at.line(),
+                              at.column()), term->type);
+    ++folded_count;
+  }
+}
+
+
+optional<Token> ConstantFolder::fold_binary(const Token& op, const Token& lhs,
+                                            const Token& rhs)
+{
+  if (lhs.type() != rhs.type())
+    return nullopt;
+  string op_val = op.lexeme();
+  int line = lhs.line();
+  int column = lhs.column();
+  auto boolean = [&](optional<bool> value) -> optional<Token> {
+    if (!value.has_value())
+      return nullopt;
+    return Token(TokenType::BOOL_VAL, *value ? "true" : "false", line, column);
+  };
+
+  if (lhs.type() == TokenType::INT_VAL) {
+    long long x = stoll(lhs.lexeme());
+    long long y = stoll(rhs.lexeme());
+    if (x < INT_MIN or x > INT_MAX or y < INT_MIN or y > INT_MAX)
+      return nullopt;
+    long long value;
+    if (op_val == "+")
+      value = x + y;
+    else if (op_val == "-")
+      value = x - y;
+    else if (op_val == "*")
+      value = x * y;
+    else if (op_val == "/") {
+      if (y == 0)
+        return nullopt;
+      value = x / y;
+    }
+    else
+      return boolean(compare(op_val, x, y));
+    // an int overflow is left for the vm
+    if (value < INT_MIN or value > INT_MAX)
+      return nullopt;
+    return Token(TokenType::INT_VAL, to_string(value), line, column);
+  }
+  if (lhs.type() == TokenType::DOUBLE_VAL) {
+    double x = stod(lhs.lexeme());
+    double y = stod(rhs.lexeme());
+    double value;
+    if (op_val == "+")
+      value = x + y;
+    else if (op_val == "-")
+      value = x - y;
+    else if (op_val == "*")
+      value = x * y;
+    else if (op_val == "/")
+      value = x / y;
+    else
+      return boolean(compare(op_val, x, y));
+    if (!isfinite(value))
+      return nullopt;
+    return Token(TokenType::DOUBLE_VAL, double_lexeme(value), line, column);
+  }
+  if (lhs.type() == TokenType::BOOL_VAL) {
+    bool x = lhs.lexeme() == "true";
+    bool y = rhs.lexeme() == "true";
+    if (op_val == "and")
+      return boolean(x and y);
+    if (op_val == "or")
+      return boolean(x or y);
+    if (op_val == "==" or op_val == "!=")
+      return boolean(compare(op_val, x, y));
+    return nullopt;
+  }
+  if (lhs.type() == TokenType::STRING_VAL)
+    return boolean(compare(op_val, decode(lhs.lexeme()), decode(rhs.lexeme())));
+  // chars order as unsigned bytes (as in the vm)
+  if (lhs.type() == TokenType::CHAR_VAL)
+    return boolean(compare(op_val,
+                           (unsigned char) decode(lhs.lexeme())[0],
+                           (unsigned char) decode(rhs.lexeme())[0]));
+  return nullopt;
+}
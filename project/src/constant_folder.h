@@ -0,0 +1,88 @@
+//----------------------------------------------------------------------
+// FILE: constant_folder.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Interface for the constant folding visitor (-O1)
+//----------------------------------------------------------------------
+
+
+#ifndef CONSTANT_FOLDER_H
+#define CONSTANT_FOLDER_H
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.h"
+
+
+// Simplifies a checked program before code generation:
+//
+//   - operators over int, double, bool, string, and char literals
+//     (and concat and length over string literals) become the literal
+//     they evaluate to, following the code generator's (right to left)
+//     evaluation of an expression's first op rest chain
+//   - and/or expressions with a literal first operand become that
+//     operand (false and x, true or x) or their rest (true and x,
+//     false or x, unless x could be null)
+//   - a variable declared with a constant value, and never assigned
+//     again in its function, is replaced by its value where it is read
+//   - if branches with a false condition, the branches after a true
+//     one, and while loops with a false condition are dropped
+//
+// Operations that fail or overflow at run time (e.g., dividing by
+// zero) are left for the vm.
+class ConstantFolder : public Visitor {
+public:
+  void visit(Program& p);
+  void visit(FunDef& f);
+  void visit(StructDef& s);
+  void visit(ReturnStmt& s);
+  void visit(WhileStmt& s);
+  void visit(ForStmt& s);
+  void visit(IfStmt& s);
+  void visit(VarDeclStmt& s);
+  void visit(AssignStmt& s);
+  void visit(CallExpr& e);
+  void visit(Expr& e);
+  void visit(SimpleTerm& t);
+  void visit(ComplexTerm& t);
+  void visit(SimpleRValue& v);
+  void visit(NewRValue& v);
+  void visit(VarRValue& v);
+
+  // number of expressions folded and branches dropped
+  int folded() const;
+
+private:
+
+  int folded_count = 0;
+
+  // number of times each variable of the current function is declared
+  // or assigned (by name, including parameters)
+  std::unordered_map<std::string,int> assign_counts;
+
+  // the values of the constant variables declared so far
+  std::unordered_map<std::string,Token> constants;
+
+  // the statements to put in place of the statement just visited
+  // (e.g., the taken branch of an if statement)
+  std::optional<std::vector<std::shared_ptr<Stmt>>> replacement;
+
+  // fold the statements of a statement list, in place
+  void stmts(std::vector<std::shared_ptr<Stmt>>& list);
+
+  // count the declarations and assignments within the statements
+  void count_assigns(std::vector<std::shared_ptr<Stmt>>& list);
+
+  // replace the term by the literal it evaluates to, if it is constant
+  void fold_term(std::shared_ptr<ExprTerm>& term);
+
+  // the value of the binary operation over the literals (if folded)
+  std::optional<Token> fold_binary(const Token& op, const Token& lhs,
+                                   const Token& rhs);
+
+};
+
+#endif
@@ -0,0 +1,479 @@
+//----------------------------------------------------------------------
+// FILE: cpp_print_visitor.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Translates a MyPL program into C++ (for the native backend)
+//----------------------------------------------------------------------
+
+#include <unordered_map>
+#include <unordered_set>
+#include "print_visitor.h"
+
+using namespace std;
+
+// C++ types of the base data types (chars are one-character strings)
+const unordered_map<string, string> CPP_TYPES {{"int", "mypl::Int"},
+  {"double", "mypl::Double"}, {"bool", "mypl::Bool"},
+  {"string", "mypl::String"}, {"char", "mypl::String"}};
+
+// runtime functions of the built-ins and operators
+const unordered_set<string> CPP_BUILT_INS {"print", "input", "to_string",
+  "to_int", "to_double", "length", "get", "concat"};
+const unordered_map<string, string> CPP_OPS {{"+", "add"}, {"-", "sub"},
+  {"*", "mul"}, {"/", "div"}, {"<", "lt"}, {"<=", "le"}, {">", "gt"},
+  {">=", "ge"}, {"==", "eq"}, {"!=", "ne"}, {"and", "and_"}, {"or", "or_"}};
+
+
+// helper functions to find side effects (calls and allocations) and
+// uses of a variable name within an expression
+
+static void scan(Expr& e, const string& name, bool& effects, bool& uses);
+
+static void scan(vector<VarRef>& path, const string& name, bool& effects,
+                 bool& uses)
+{
+  if (path[0].var_name.lexeme() == name)
+    uses = true;
+  for (VarRef& var_ref : path)
+    if (var_ref.array_expr.has_value())
+      scan(*var_ref.array_expr, name, effects, uses);
+}
+
+static void scan(ExprTerm& t, const string& name, bool& effects,
+                 bool& uses)
+{
+  if (auto c = dynamic_cast<ComplexTerm*>(&t)) {
+    scan(c->expr, name, effects, uses);
+    return;
+  }
+  RValue* v = dynamic_cast<SimpleTerm&>(t).rvalue.get();
+  if (auto c = dynamic_cast<CallExpr*>(v)) {
+    effects = true;
+    for (Expr& arg : c->args)
+      scan(arg, name, effects, uses);
+  }
+  else if (auto n = dynamic_cast<NewRValue*>(v)) {
+    effects = true;
+    if (n->array_expr.has_value())
+      scan(*n->array_expr, name, effects, uses);
+  }
+  else if (auto r = dynamic_cast<VarRValue*>(v))
+    scan(r->path, name, effects, uses);
+}
+
+static void scan(Expr& e, const string& name, bool& effects, bool& uses)
+{
+  scan(*e.first, name, effects, uses);
+  if (e.rest)
+    scan(*e.rest, name, effects, uses);
+}
+
+template<typename T>
+static bool has_effects(T& node)
+{
+  bool effects = false, uses = false;
+  scan(node, "", effects, uses);
+  return effects;
+}
+
+// string literal with the same escapes the code generator handles
+static string cpp_string(const string& s)
+{
+  string result = "\"";
+  for (int i = 0; i < s.size(); ++i) {
+    if (s[i] == '\\' and i + 1 < s.size() and
+        (s[i + 1] == 'n' or s[i + 1] == 't'))
+      result += s[++i] == 'n' ? "\\n" : "\\t";
+    else if (s[i] == '\\' or s[i] == '"')
+      result += string("\\") + s[i];
+    else
+      result += s[i];
+  }
+  return result + "\"";
+}
+
+
+CppPrintVisitor::CppPrintVisitor(ostream& output)
+  : out(output)
+{
+}
+
+
+void CppPrintVisitor::inc_indent()
+{
+  indent += INDENT_AMT;
+}
+
+
+void CppPrintVisitor::dec_indent()
+{
+  indent -= INDENT_AMT;
+}
+
+
+void CppPrintVisitor::print_indent()
+{
+  out << string(indent, ' ');
+}
+
+
+string CppPrintVisitor::type_name(const DataType& t)
+{
+  string name = "void";
+  if (CPP_TYPES.contains(t.type_name))
+    name = CPP_TYPES.at(t.type_name);
+  else if (t.type_name != "void")
+    name = "mypl::Ref<s_" + t.type_name + ">";
+  if (t.is_array)
+    name = "mypl::Array<" + name + ">";
+  return name;
+}
+
+
+void CppPrintVisitor::print_signature(FunDef& f)
+{
+  out << type_name(f.return_type) << " f_" << f.fun_name.lexeme() << "(";
+  for (int i = 0; i < f.params.size(); ++i) {
+    if (i > 0)
+      out << ", ";
+    out << type_name(f.params[i].data_type) << " v_"
+        << f.params[i].var_name.lexeme();
+  }
+  out << ")";
+}
+
+
+void CppPrintVisitor::print_stmts(vector<shared_ptr<Stmt>>& stmts)
+{
+  for (auto& stmt : stmts) {
+    print_indent();
+    stmt->accept(*this);
+    // calls are also expressions (other statements end themselves)
+    if (dynamic_cast<CallExpr*>(stmt.get()))
+      out << ";";
+    out << endl;
+  }
+}
+
+
+void CppPrintVisitor::print_block(vector<shared_ptr<Stmt>>& stmts)
+{
+  out << "{" << endl;
+  inc_indent();
+  print_stmts(stmts);
+  dec_indent();
+  print_indent();
+  out << "}";
+}
+
+
+void CppPrintVisitor::print_path(vector<VarRef>& path)
+{
+  for (int i = 0; i < path.size(); ++i) {
+    out << (i == 0 ? "v_" : "->v_") << path[i].var_name.lexeme();
+    if (path[i].array_expr.has_value()) {
+      out << "[";
+      path[i].array_expr->accept(*this);
+      out << "]";
+    }
+  }
+}
+
+
+void CppPrintVisitor::print_call(const string& fun,
+                                 const vector<ASTNode*>& args,
+                                 bool has_effects)
+{
+  // C++ leaves the order of argument evaluation unspecified
+  if (args.size() > 1 and has_effects) {
+    out << "[&] { ";
+    for (int i = 0; i < args.size(); ++i) {
+      out << "auto a" << i << " = ";
+      args[i]->accept(*this);
+      out << "; ";
+    }
+    out << "return " << fun << "(";
+    for (int i = 0; i < args.size(); ++i)
+      out << (i > 0 ? ", a" : "a") << i;
+    out << "); }()";
+    return;
+  }
+  out << fun << "(";
+  for (int i = 0; i < args.size(); ++i) {
+    if (i > 0)
+      out << ", ";
+    args[i]->accept(*this);
+  }
+  out << ")";
+}
+
+
+void CppPrintVisitor::visit(Program& p)
+{
+  out << "// generated from a MyPL program" << endl;
+  out << "#include \"mypl_runtime.h\"" << endl;
+  // declare everything first (definitions can then be in any order)
+  if (p.struct_defs.size() > 0)
+    out << endl;
+  for (auto& struct_def : p.struct_defs)
+    out << "struct s_" << struct_def.struct_name.lexeme() << ";" << endl;
+  for (auto& struct_def : p.struct_defs)
+    struct_def.accept(*this);
+  out << endl;
+  for (auto& fun_def : p.fun_defs) {
+    print_signature(fun_def);
+    out << ";" << endl;
+  }
+  for (auto& fun_def : p.fun_defs)
+    fun_def.accept(*this);
+  out << endl;
+  out << "int main()" << endl;
+  out << "{" << endl;
+  out << "  return mypl::run(f_main);" << endl;
+  out << "}" << endl;
+}
+
+
+void CppPrintVisitor::visit(FunDef& f)
+{
+  out << endl;
+  print_signature(f);
+  out << endl;
+  void_fun = f.return_type.type_name == "void" and !f.return_type.is_array;
+  out << "{" << endl;
+  inc_indent();
+  print_stmts(f.stmts);
+  // functions without a return statement return null
+  if (!void_fun) {
+    print_indent();
+    out << "return {};" << endl;
+  }
+  dec_indent();
+  out << "}" << endl;
+}
+
+
+void CppPrintVisitor::visit(StructDef& s)
+{
+  out << endl;
+  out << "struct s_" << s.struct_name.lexeme() << endl;
+  out << "{" << endl;
+  inc_indent();
+  for (auto& field : s.fields) {
+    print_indent();
+    out << type_name(field.data_type) << " v_" << field.var_name.lexeme()
+        << ";" << endl;
+  }
+  dec_indent();
+  out << "};" << endl;
+}
+
+
+void CppPrintVisitor::visit(ReturnStmt& s)
+{
+  out << "return ";
+  if (void_fun) {
+    out << "(void) (";
+    s.expr.accept(*this);
+    out << ");";
+  }
+  else {
+    s.expr.accept(*this);
+    out << ";";
+  }
+}
+
+
+void CppPrintVisitor::visit(WhileStmt& s)
+{
+  out << "while (mypl::test(";
+  s.condition.accept(*this);
+  out << ")) ";
+  print_block(s.stmts);
+}
+
+
+void CppPrintVisitor::visit(ForStmt& s)
+{
+  // the loop variable is scoped to the loop
+  out << "{" << endl;
+  inc_indent();
+  print_indent();
+  s.var_decl.accept(*this);
+  out << endl;
+  print_indent();
+  out << "while (mypl::test(";
+  s.condition.accept(*this);
+  out << ")) {" << endl;
+  inc_indent();
+  print_indent();
+  print_block(s.stmts);
+  out << endl;
+  print_indent();
+  s.assign_stmt.accept(*this);
+  out << endl;
+  dec_indent();
+  print_indent();
+  out << "}" << endl;
+  dec_indent();
+  print_indent();
+  out << "}";
+}
+
+
+void CppPrintVisitor::visit(IfStmt& s)
+{
+  out << "if (mypl::test(";
+  s.if_part.condition.accept(*this);
+  out << ")) ";
+  print_block(s.if_part.stmts);
+  for (auto& else_if : s.else_ifs) {
+    out << endl;
+    print_indent();
+    out << "else if (mypl::test(";
+    else_if.condition.accept(*this);
+    out << ")) ";
+    print_block(else_if.stmts);
+  }
+  if (s.else_stmts.size() > 0) {
+    out << endl;
+    print_indent();
+    out << "else ";
+    print_block(s.else_stmts);
+  }
+}
+
+
+void CppPrintVisitor::visit(VarDeclStmt& s)
+{
+  string type = type_name(s.var_def.data_type);
+  string name = s.var_def.var_name.lexeme();
+  bool effects = false, uses = false;
+  scan(s.expr, name, effects, uses);
+  // the initializer may refer to a shadowed variable of the same name,
+  // which in C++ would already be the new variable
+  if (uses) {
+    string temp = "t" + to_string(temp_count++);
+    out << type << " " << temp << " = ";
+    s.expr.accept(*this);
+    out << "; " << type << " v_" << name << " = " << temp << ";";
+    return;
+  }
+  out << type << " v_" << name << " = ";
+  s.expr.accept(*this);
+  out << ";";
+}
+
+
+void CppPrintVisitor::visit(AssignStmt& s)
+{
+  // the vm finds the lvalue before evaluating the expression (C++
+  // evaluates the right side of an assignment first)
+  if ((s.lvalue.size() > 1 or s.lvalue[0].array_expr.has_value()) and
+      (has_effects(s.lvalue) or has_effects(s.expr))) {
+    out << "{ auto& lv = ";
+    print_path(s.lvalue);
+    out << "; lv = ";
+    s.expr.accept(*this);
+    out << "; }";
+    return;
+  }
+  print_path(s.lvalue);
+  out << " = ";
+  s.expr.accept(*this);
+  out << ";";
+}
+
+
+void CppPrintVisitor::visit(CallExpr& e)
+{
+  string fun_name = e.fun_name.lexeme();
+  string fun = "f_" + fun_name;
+  if (fun_name == "length_array")
+    fun = "mypl::length";
+  else if (CPP_BUILT_INS.contains(fun_name))
+    fun = "mypl::" + fun_name;
+  vector<ASTNode*> args;
+  bool effects = false;
+  for (Expr& arg : e.args) {
+    args.push_back(&arg);
+    effects = effects or has_effects(arg);
+  }
+  print_call(fun, args, effects);
+}
+
+
+void CppPrintVisitor::visit(Expr& e)
+{
+  if (e.negated)
+    out << "mypl::not_(";
+  string op = e.op.has_value() ? e.op->lexeme() : "";
+  if (op == "and" or op == "or") {
+    // the rest is passed unevaluated (short-circuiting)
+    out << "mypl::" << CPP_OPS.at(op) << "(";
+    e.first->accept(*this);
+    out << ", [&] { return ";
+    e.rest->accept(*this);
+    out << "; })";
+  }
+  else if (e.op.has_value()) {
+    bool effects = has_effects(*e.first) or has_effects(*e.rest);
+    print_call("mypl::" + CPP_OPS.at(e.op->lexeme()),
+               {e.first.get(), e.rest.get()}, effects);
+  }
+  else
+    e.first->accept(*this);
+  if (e.negated)
+    out << ")";
+}
+
+
+void CppPrintVisitor::visit(SimpleTerm& t)
+{
+  t.rvalue->accept(*this);
+}
+
+
+void CppPrintVisitor::visit(ComplexTerm& t)
+{
+  out << "(";
+  t.expr.accept(*this);
+  out << ")";
+}
+
+
+void CppPrintVisitor::visit(SimpleRValue& v)
+{
+  string lexeme = v.value.lexeme();
+  TokenType type = v.value.type();
+  if (type == TokenType::INT_VAL)
+    out << "mypl::Int(" << lexeme << ")";
+  else if (type == TokenType::DOUBLE_VAL)
+    out << "mypl::Double(" << lexeme << ")";
+  else if (type == TokenType::BOOL_VAL)
+    out << "mypl::Bool(" << lexeme << ")";
+  else if (type == TokenType::STRING_VAL or type == TokenType::CHAR_VAL)
+    out << "mypl::String(" << cpp_string(lexeme) << ")";
+  else
+    out << "mypl::null";
+}
+
+
+void CppPrintVisitor::visit(NewRValue& v)
+{
+  DataType type;
+  type.type_name = v.type.lexeme();
+  if (v.array_expr.has_value()) {
+    out << "mypl::make_array<" << type_name(type) << ">(";
+    v.array_expr->accept(*this);
+    out << ")";
+  }
+  else
+    out << "mypl::make<s_" << type.type_name << ">()";
+}
+
+
+void CppPrintVisitor::visit(VarRValue& v)
+{
+  print_path(v.path);
+}
@@ -5,9 +5,13 @@
 // DESC: This program allows for multiple options to be entered to output different parts of some text
 //----------------------------------------------------------------------
 
+#include <charconv>
+#include <chrono>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <filesystem>
+#include <vector>
 #include "token.h"
 #include "lexer.h"
 #include "simple_parser.h"
@@ -16,19 +20,210 @@
 #include "ast_parser.h"
 #include "semantic_checker.h"
 #include "vm.h"
+#include "constant_folder.h"
 #include "code_generator.h"
+#include "reg_code_generator.h"
+#include "compile_cache.h"
+#include "native_compiler.h"
+#include "vm_image.h"
 
 using namespace std;
 namespace fs = std::filesystem;
+
+// prints the number of instructions the optimizer eliminated (-O1)
+void report_optimizer(int eliminated, int opt_level) {
+    if (opt_level >= 1)
+        cerr << "Optimizer.........: " << eliminated
+             << " instructions eliminated" << endl;
+}
+
+void report_optimizer(const CodeGenerator& g, int opt_level) {
+    report_optimizer(g.eliminated(), opt_level);
+}
+
+// prints the number of expressions and branches folded (-O1)
+void report_folded(int folded, int opt_level) {
+    if (opt_level >= 1)
+        cerr << "Constants folded..: " << folded
+             << " expressions and branches" << endl;
+}
+
+// folds the checked program's constants (-O1), printing and returning
+// how many
+int fold_constants(Program& p, int opt_level) {
+    if (opt_level < 1)
+        return 0;
+    ConstantFolder f;
+    p.accept(f);
+    report_folded(f.folded(), opt_level);
+    return f.folded();
+}
+
+// loads the program in the source file into the vm, from the compile
+// cache if the same source was compiled before (by this mypl build, at
+// the same optimization level), reporting the optimizer counts either
+// way
+void load_cached(VM& vm, const string& filename, CompileCache& cache,
+                 int opt_level) {
+    ifstream file(filename);
+    stringstream source;
+    source << file.rdbuf();
+    string name = CompileCache::hash({source.str(), CompileCache::build_id(),
+                                      "O" + to_string(opt_level)}) + ".myplc";
+    if (cache.lookup(name)) {
+        try {
+            VMImageStats stats = VMImage::read(vm, cache.path(name));
+            report_folded(stats.folded, opt_level);
+            report_optimizer(stats.eliminated, opt_level);
+            return;
+        } catch (MyPLException &ex) {
+            // removed (or damaged) since the lookup, so compile it again
+        }
+    }
+    Lexer lexer(source);
+    ASTParser parser(lexer);
+    Program p = parser.parse();
+    SemanticChecker t;
+    p.accept(t);
+    VMImageStats stats;
+    stats.folded = fold_constants(p, opt_level);
+    CodeGenerator g(vm, opt_level);
+    p.accept(g);
+    report_optimizer(g, opt_level);
+    stats.eliminated = g.eliminated();
+    vm.link();
+    // a cache that cannot be written to only costs the next run time
+    string temp = cache.temp_path(name);
+    try {
+        VMImage::write(vm, temp, stats);
+        if (cache.insert(temp, name))
+            return;
+    } catch (MyPLException &ex) {
+    }
+    error_code ec;
+    fs::remove(temp, ec);
+}
+
+// prints the profile of the vm's run, writing its call stacks to the
+// (folded) profile file
+void report_profile(const VM& vm, const string& profile_file) {
+    VMProfile profile = vm.profile();
+    cerr << to_string(profile);
+    ofstream out(profile_file);
+    write_folded(profile, out);
+    if (!out)
+        cerr << "cannot write profile file '" << profile_file << "'" << endl;
+}
+
+// prints the engine's instruction count and run time (--engine-stats)
+void report_engine(const string& engine, long instructions,
+                   chrono::steady_clock::duration time) {
+    long ns = chrono::duration_cast<chrono::nanoseconds>(time).count();
+    cerr << "Engine............: " << engine << endl;
+    cerr << "Instructions......: " << instructions << endl;
+    cerr << "Run time..........: " << to_string(ns / 1000000.0) << " ms" << endl;
+}
+
+// runs the checked program on the register engine (over the vm's
+// heaps and output)
+void run_registers(Program& p, VM& vm, bool engine_stats) {
+    RegVM reg_vm(vm);
+    RegCodeGenerator g(reg_vm);
+    p.accept(g);
+    if (engine_stats)
+        reg_vm.enable_count();
+    auto start = chrono::steady_clock::now();
+    reg_vm.run();
+    if (engine_stats)
+        report_engine("reg", reg_vm.instruction_count(),
+                      chrono::steady_clock::now() - start);
+}
+
+// runs the vm's (loaded) program on the stack engine
+void run_stack(VM& vm, bool engine_stats) {
+    auto start = chrono::steady_clock::now();
+    vm.run();
+    if (engine_stats)
+        report_engine("stack", vm.instruction_count(),
+                      chrono::steady_clock::now() - start);
+}
+
 int main(int argc, char *argv[]) {
     string option = "";
     string filename = "";
+    // run flags (used in normal mode), accepted anywhere in the arguments
+    bool gc_stats = false;
+    bool jit = false;
+    bool cache_stats = false;
+    // execution engine (stack or reg) and whether to report its counts
+    string engine = "stack";
+    bool engine_stats = false;
+    // superinstructions in the stack engine
+    bool fusion = true;
+    // call stack output of --profile (folded, for flamegraph tools)
+    string profile_file = "";
+    // binary instruction trace output (read with mypl_trace)
+    string trace_file = "";
+    // output buffering, when given (otherwise chosen by the vm)
+    string output_buffer = "";
+    long gc_threshold = 0;
+    // optimization level (-O1 runs the peephole optimizer)
+    int opt_level = 0;
+    // output file of --compile-only
+    string output_file = "";
+    vector<string> args;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--gc-stats")
+            gc_stats = true;
+        else if (arg == "--jit")
+            jit = true;
+        else if (arg == "--profile")
+            profile_file = "profile.folded";
+        else if (arg.starts_with("--profile="))
+            profile_file = arg.substr(string("--profile=").size());
+        else if (arg.starts_with("--trace="))
+            trace_file = arg.substr(string("--trace=").size());
+        else if (arg.starts_with("--engine="))
+            engine = arg.substr(string("--engine=").size());
+        else if (arg == "--engine-stats")
+            engine_stats = true;
+        else if (arg == "--no-fusion")
+            fusion = false;
+        else if (arg == "-O0" or arg == "-O1")
+            opt_level = arg[2] - '0';
+        else if (arg == "--cache-stats")
+            cache_stats = true;
+        else if (arg.starts_with("--output-buffer="))
+            output_buffer = arg.substr(string("--output-buffer=").size());
+        else if (arg.starts_with("--gc-threshold=")) {
+            string value = arg.substr(string("--gc-threshold=").size());
+            const char* end = value.data() + value.size();
+            auto result = from_chars(value.data(), end, gc_threshold);
+            if (result.ec != errc() or result.ptr != end or gc_threshold <= 0) {
+                cerr << "invalid gc threshold '" << value << "' (expected a positive number of bytes)" << endl;
+                return 1;
+            }
+        }
+        else if (arg == "-o" and i + 1 < argc)
+            output_file = argv[++i];
+        else
+            args.push_back(arg);
+    }
     // checks if argument was entered for option and/or file
-    if (argc >= 2) {
-        option = argv[1];
+    if (args.size() >= 1) {
+        option = args[0];
+    }
+    if (args.size() == 2) {
+        filename = args[1];
+    }
+    if (engine != "stack" and engine != "reg") {
+        cerr << "unknown engine '" << engine << "' (expected stack or reg)" << endl;
+        return 1;
     }
-    if (argc == 3) {
-        filename = argv[2];
+    if (output_buffer != "" and output_buffer != "line" and output_buffer != "full") {
+        cerr << "unknown output buffering '" << output_buffer << "' (expected line or full)" << endl;
+        return 1;
     }
     // normal mode with input in terminal
     if (option == "") {
@@ -40,15 +235,41 @@ int main(int argc, char *argv[]) {
             Program p = parser.parse();
             SemanticChecker t;
             p.accept(t);
+            fold_constants(p, opt_level);
             VM vm;
-            CodeGenerator g(vm);
-            p.accept(g);
-            vm.run();
+            if (gc_threshold > 0)
+                vm.set_gc_threshold(gc_threshold);
+            if (jit and !vm.enable_jit())
+                cerr << "JIT not supported on this platform (interpreting)" << endl;
+            vm.set_fusion(fusion);
+            if (output_buffer == "line")
+                vm.set_output_mode(VMBufferMode::LINE);
+            else if (output_buffer == "full")
+                vm.set_output_mode(VMBufferMode::FULL);
+            if (engine == "reg")
+                run_registers(p, vm, engine_stats);
+            else {
+                CodeGenerator g(vm, opt_level);
+                p.accept(g);
+                report_optimizer(g, opt_level);
+                vm.link();
+                if (profile_file != "")
+                    vm.enable_profile();
+                else if (trace_file != "")
+                    vm.enable_trace(trace_file);
+                else if (engine_stats)
+                    vm.enable_count();
+                run_stack(vm, engine_stats);
+            }
+            if (gc_stats)
+                cerr << to_string(vm.gc_stats());
+            if (profile_file != "")
+                report_profile(vm, profile_file);
         } catch (MyPLException &ex) {
             cerr << ex.what() << endl;
         }
 
-    } else if (option == "--help" || argc > 3) {
+    } else if (option == "--help" || args.size() > 2) {
         // help option, when command entered, or too many arguments
         cout << "Usage: ./mypl [option] [script-file]" << endl;
         cout << "Options:" << endl;
@@ -59,6 +280,26 @@ int main(int argc, char *argv[]) {
         cout << "--csharp pretty prints program (typing on terminal not supported as it has to build new file)" << endl;
         cout << "--check statically checks program" << endl;
         cout << "--ir print intermediate (code) representation" << endl;
+        cout << "--emit-cpp prints the program translated to C++" << endl;
+        cout << "--native compiles the program to a (cached) native executable and runs it" << endl;
+        cout << "-O1 folds constant expressions and dead branches, and removes redundant stack vm" << endl;
+        cout << "    instructions (NOPs, jumps to jumps, unreachable code), reporting how many" << endl;
+        cout << "    (with --ir, --compile-only, or when running)" << endl;
+        cout << "--compile-only [-o file.myplc] saves the compiled program (run it with ./mypl file.myplc)" << endl;
+        cout << "Run flags (normal mode):" << endl;
+        cout << "--gc-stats prints garbage collection statistics after running" << endl;
+        cout << "--gc-threshold=N collects once the heap reaches N bytes" << endl;
+        cout << "--jit compiles hot functions to native code (x86-64 Linux)" << endl;
+        cout << "--output-buffer=line|full writes output after each line or only when the buffer fills" << endl;
+        cout << "--profile[=FILE] prints instruction counts and function times after running, writing" << endl;
+        cout << "    the call stacks (in ns) to FILE (default profile.folded) for flamegraph tools" << endl;
+        cout << "--trace=FILE writes a binary trace of every instruction run to FILE (print it with mypl_trace)" << endl;
+        cout << "--cache-stats prints compile cache statistics after running (also with --native)" << endl;
+        cout << "--engine=stack|reg runs the stack vm (default) or the register vm (source files only," << endl;
+        cout << "    also selects the code printed by --ir)" << endl;
+        cout << "--engine-stats prints the engine's instruction count and run time after running" << endl;
+        cout << "--no-fusion runs the stack engine without superinstructions (e.g. to mine traces" << endl;
+        cout << "    for new ones with mypl_ngrams)" << endl;
     } else if (option == "--lex") {
         // lex option, if filename is provided it will print first
         // char from file, else input will be entered and printed
@@ -195,10 +436,21 @@ int main(int argc, char *argv[]) {
                 Program p = parser.parse();
                 SemanticChecker t;
                 p.accept(t);
+                fold_constants(p, opt_level);
                 VM vm;
-                CodeGenerator g(vm);
-                p.accept(g);
-                cout << to_string(vm) << endl;
+                if (engine == "reg") {
+                    RegVM reg_vm(vm);
+                    RegCodeGenerator g(reg_vm);
+                    p.accept(g);
+                    cout << to_string(reg_vm) << endl;
+                }
+                else {
+                    CodeGenerator g(vm, opt_level);
+                    p.accept(g);
+                    report_optimizer(g, opt_level);
+                    vm.link();
+                    cout << to_string(vm) << endl;
+                }
             } catch (MyPLException &ex) {
                 cerr << ex.what() << endl;
             }
@@ -210,15 +462,102 @@ int main(int argc, char *argv[]) {
                 Program p = parser.parse();
                 SemanticChecker t;
                 p.accept(t);
+                fold_constants(p, opt_level);
                 VM vm;
-                CodeGenerator g(vm);
-                p.accept(g);
-                cout << to_string(vm) << endl;
+                if (engine == "reg") {
+                    RegVM reg_vm(vm);
+                    RegCodeGenerator g(reg_vm);
+                    p.accept(g);
+                    cout << to_string(reg_vm) << endl;
+                }
+                else {
+                    CodeGenerator g(vm, opt_level);
+                    p.accept(g);
+                    report_optimizer(g, opt_level);
+                    vm.link();
+                    cout << to_string(vm) << endl;
+                }
             } catch (MyPLException &ex) {
                 cerr << ex.what() << endl;
             }
         }
     }
+    else if (option == "--emit-cpp") {
+        // emit-cpp option, prints the checked program as C++ (built
+        // against src/mypl_runtime.h)
+        istream *input = &cin;
+        if (filename != "")
+            input = new ifstream(filename);
+        if (!input->fail()) {
+            Lexer lexer(*input);
+            try {
+                ASTParser parser(lexer);
+                Program p = parser.parse();
+                SemanticChecker t;
+                p.accept(t);
+                CppPrintVisitor v(cout);
+                p.accept(v);
+            } catch (MyPLException &ex) {
+                cerr << ex.what() << endl;
+            }
+        } else
+            cout << "fail to open file" << endl;
+    }
+    else if (option == "--native") {
+        // native option, compiles the program's C++ with the system
+        // compiler (once, the executable is cached) and runs it
+        cout << "[Native Mode]" << endl;
+        istream *input = new ifstream(filename);
+        if (filename != "" and !input->fail()) {
+            Lexer lexer(*input);
+            try {
+                ASTParser parser(lexer);
+                Program p = parser.parse();
+                SemanticChecker t;
+                p.accept(t);
+                stringstream source;
+                CppPrintVisitor v(source);
+                p.accept(v);
+                CompileCache cache;
+                NativeCompiler compiler(cache);
+                int status = compiler.run(compiler.compile(source.str()));
+                if (cache_stats)
+                    cerr << to_string(cache.stats());
+                return status;
+            } catch (MyPLException &ex) {
+                cerr << ex.what() << endl;
+            }
+        } else
+            cout << "fail to open file" << endl;
+    }
+    else if (option == "--compile-only") {
+        // compile-only option, saves the linked vm program as a binary
+        // image that runs without the front end
+        if (output_file == "")
+            output_file = fs::path(filename).replace_extension(".myplc").string();
+        istream *input = new ifstream(filename);
+        if (filename != "" and !input->fail()) {
+            Lexer lexer(*input);
+            try {
+                ASTParser parser(lexer);
+                Program p = parser.parse();
+                SemanticChecker t;
+                p.accept(t);
+                VMImageStats stats;
+                stats.folded = fold_constants(p, opt_level);
+                VM vm;
+                CodeGenerator g(vm, opt_level);
+                p.accept(g);
+                report_optimizer(g, opt_level);
+                stats.eliminated = g.eliminated();
+                vm.link();
+                VMImage::write(vm, output_file, stats);
+            } catch (MyPLException &ex) {
+                cerr << ex.what() << endl;
+            }
+        } else
+            cout << "fail to open file" << endl;
+    }
     else if (option == "--csharp") {
         cout << "[C# Mode]" << endl;
         string name = "";
@@ -272,17 +611,51 @@ int main(int argc, char *argv[]) {
         cout << "[Normal Mode]" << endl;
         filename = option;
 
-        istream *input = new ifstream(filename);
-        Lexer lexer(*input);
         try {
-            ASTParser parser(lexer);
-            Program p = parser.parse();
-            SemanticChecker t;
-            p.accept(t);
             VM vm;
-            CodeGenerator g(vm);
-            p.accept(g);
-            vm.run();
+            if (gc_threshold > 0)
+                vm.set_gc_threshold(gc_threshold);
+            if (jit and !vm.enable_jit())
+                cerr << "JIT not supported on this platform (interpreting)" << endl;
+            vm.set_fusion(fusion);
+            if (output_buffer == "line")
+                vm.set_output_mode(VMBufferMode::LINE);
+            else if (output_buffer == "full")
+                vm.set_output_mode(VMBufferMode::FULL);
+            // compiled images (given or cached) skip the front end
+            CompileCache cache;
+            if (engine == "reg") {
+                // register code is generated from the source each run
+                if (VMImage::is_image(filename))
+                    throw MyPLException::VMError("the register engine runs source files only");
+                ifstream file(filename);
+                Lexer lexer(file);
+                ASTParser parser(lexer);
+                Program p = parser.parse();
+                SemanticChecker t;
+                p.accept(t);
+                fold_constants(p, opt_level);
+                run_registers(p, vm, engine_stats);
+            }
+            else {
+                if (VMImage::is_image(filename))
+                    VMImage::read(vm, filename);
+                else
+                    load_cached(vm, filename, cache, opt_level);
+                if (profile_file != "")
+                    vm.enable_profile();
+                else if (trace_file != "")
+                    vm.enable_trace(trace_file);
+                else if (engine_stats)
+                    vm.enable_count();
+                run_stack(vm, engine_stats);
+            }
+            if (gc_stats)
+                cerr << to_string(vm.gc_stats());
+            if (profile_file != "")
+                report_profile(vm, profile_file);
+            if (cache_stats)
+                cerr << to_string(cache.stats());
         } catch (MyPLException &ex) {
             cerr << ex.what() << endl;
         }
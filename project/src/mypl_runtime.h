@@ -0,0 +1,362 @@
+//----------------------------------------------------------------------
+// FILE: mypl_runtime.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Runtime support for MyPL programs compiled to C++ (values,
+//       arrays, structs, and the built-in functions)
+//----------------------------------------------------------------------
+
+#ifndef MYPL_RUNTIME_H
+#define MYPL_RUNTIME_H
+
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace mypl {
+
+// runtime errors (reported the same way as vm errors)
+class Error : public std::runtime_error
+{
+public:
+  using std::runtime_error::runtime_error;
+};
+
+[[noreturn]] inline void error(const std::string& msg)
+{
+  throw Error(msg);
+}
+
+
+//----------------------------------------------------------------------
+// Values
+//----------------------------------------------------------------------
+
+// the null literal (converts to any type)
+struct Null {};
+inline constexpr Null null {};
+
+// a nullable primitive value
+template<typename T>
+class Value
+{
+public:
+  Value() = default;
+  Value(Null) {}
+  Value(T value) : val(std::move(value)), is_null(false) {}
+  bool null() const { return is_null; }
+  const T& get() const
+  {
+    if (is_null)
+      error("null reference");
+    return val;
+  }
+private:
+  T val {};
+  bool is_null = true;
+};
+
+// chars are one-character strings
+using Int = Value<int>;
+using Double = Value<double>;
+using Bool = Value<bool>;
+using String = Value<std::string>;
+
+// next object id (numbered as in the vm, so printed refs match)
+inline int next_obj_id = 2023;
+
+// a nullable reference to a struct object (objects are reference
+// counted, so cyclic structures are never freed)
+template<typename T>
+class Ref
+{
+public:
+  Ref() = default;
+  Ref(Null) {}
+  bool null() const { return !ptr; }
+  int id() const { return obj_id; }
+  T* get() const
+  {
+    if (!ptr)
+      error("null reference");
+    return ptr.get();
+  }
+  T* operator->() const { return get(); }
+  template<typename S> friend Ref<S> make();
+private:
+  std::shared_ptr<T> ptr;
+  int obj_id = 0;
+};
+
+template<typename T>
+Ref<T> make()
+{
+  Ref<T> ref;
+  ref.ptr = std::make_shared<T>();
+  ref.obj_id = next_obj_id++;
+  return ref;
+}
+
+// a nullable reference to an array (elements start out null)
+template<typename T>
+class Array
+{
+public:
+  Array() = default;
+  Array(Null) {}
+  bool null() const { return !ptr; }
+  int id() const { return obj_id; }
+  std::vector<T>* get() const
+  {
+    if (!ptr)
+      error("null reference");
+    return ptr.get();
+  }
+  T& operator[](const Int& index) const
+  {
+    std::vector<T>& values = *get();
+    int i = index.get();
+    if (i < 0 or i >= (int) values.size())
+      error("out-of-bounds array index");
+    return values[i];
+  }
+  template<typename S> friend Array<S> make_array(const Int& size);
+private:
+  std::shared_ptr<std::vector<T>> ptr;
+  int obj_id = 0;
+};
+
+template<typename T>
+Array<T> make_array(const Int& size)
+{
+  Array<T> array;
+  array.ptr = std::make_shared<std::vector<T>>(size.get());
+  array.obj_id = next_obj_id++;
+  return array;
+}
+
+
+//----------------------------------------------------------------------
+// Operators (the operands are already evaluated, left to right)
+//----------------------------------------------------------------------
+
+inline bool is_null(Null) { return true; }
+template<typename T> bool is_null(const Value<T>& x) { return x.null(); }
+template<typename T> bool is_null(const Ref<T>& x) { return x.null(); }
+template<typename T> bool is_null(const Array<T>& x) { return x.null(); }
+
+// the underlying value of an operand (refs compare by identity)
+[[noreturn]] inline int value(Null) { error("null reference"); }
+template<typename T> const T& value(const Value<T>& x) { return x.get(); }
+template<typename T> const void* value(const Ref<T>& x) { return x.get(); }
+template<typename T> const void* value(const Array<T>& x)
+{
+  return x.get();
+}
+
+template<typename X, typename Y> auto add(const X& x, const Y& y)
+{
+  return Value(value(x) + value(y));
+}
+
+template<typename X, typename Y> auto sub(const X& x, const Y& y)
+{
+  return Value(value(x) - value(y));
+}
+
+template<typename X, typename Y> auto mul(const X& x, const Y& y)
+{
+  return Value(value(x) * value(y));
+}
+
+template<typename X, typename Y> auto div(const X& x, const Y& y)
+{
+  return Value(value(x) / value(y));
+}
+
+template<typename X, typename Y> Bool lt(const X& x, const Y& y)
+{
+  return value(x) < value(y);
+}
+
+template<typename X, typename Y> Bool le(const X& x, const Y& y)
+{
+  return value(x) <= value(y);
+}
+
+template<typename X, typename Y> Bool gt(const X& x, const Y& y)
+{
+  return value(x) > value(y);
+}
+
+template<typename X, typename Y> Bool ge(const X& x, const Y& y)
+{
+  return value(x) >= value(y);
+}
+
+// equality allows null operands
+template<typename X, typename Y> Bool eq(const X& x, const Y& y)
+{
+  if constexpr (std::is_same_v<X, Null> or std::is_same_v<Y, Null>)
+    return is_null(x) and is_null(y);
+  else {
+    if (is_null(x) or is_null(y))
+      return is_null(x) and is_null(y);
+    return value(x) == value(y);
+  }
+}
+
+template<typename X, typename Y> Bool ne(const X& x, const Y& y)
+{
+  return !eq(x, y).get();
+}
+
+// the second operand (a function returning it) is only evaluated when
+// the first doesn't settle the result (as in the vm)
+template<typename X, typename Y> Bool and_(const X& x, const Y& y)
+{
+  return value(x) and value(y());
+}
+
+template<typename X, typename Y> Bool or_(const X& x, const Y& y)
+{
+  return value(x) or value(y());
+}
+
+template<typename X> Bool not_(const X& x)
+{
+  return !value(x);
+}
+
+// a condition of an if, while, or for statement
+template<typename X> bool test(const X& x)
+{
+  return value(x);
+}
+
+
+//----------------------------------------------------------------------
+// Built-in functions
+//----------------------------------------------------------------------
+
+inline std::string format(int x) { return std::to_string(x); }
+inline std::string format(double x) { return std::to_string(x); }
+inline std::string format(bool x) { return x ? "true" : "false"; }
+inline std::string format(const std::string& x) { return x; }
+
+inline void print(Null)
+{
+  std::cout << "null";
+}
+
+template<typename T> void print(const Value<T>& x)
+{
+  if (x.null())
+    std::cout << "null";
+  else
+    std::cout << format(x.get());
+}
+
+// refs print as their object id (as in the vm)
+template<typename T> void print(const Ref<T>& x)
+{
+  if (x.null())
+    std::cout << "null";
+  else
+    std::cout << x.id();
+}
+
+template<typename T> void print(const Array<T>& x)
+{
+  if (x.null())
+    std::cout << "null";
+  else
+    std::cout << x.id();
+}
+
+inline String input()
+{
+  std::string line;
+  std::getline(std::cin, line);
+  return line;
+}
+
+template<typename X> String to_string(const X& x)
+{
+  return format(value(x));
+}
+
+template<typename X> Int to_int(const X& x)
+{
+  return (int) value(x);
+}
+
+inline Int to_int(const String& x)
+{
+  try {
+    return std::stoi(x.get());
+  }
+  catch (const std::logic_error&) {
+    error("cannot convert string to int");
+  }
+}
+
+template<typename X> Double to_double(const X& x)
+{
+  return (double) value(x);
+}
+
+inline Double to_double(const String& x)
+{
+  try {
+    return std::stod(x.get());
+  }
+  catch (const std::logic_error&) {
+    error("cannot convert string to double");
+  }
+}
+
+inline Int length(const String& x)
+{
+  return (int) x.get().size();
+}
+
+template<typename T> Int length(const Array<T>& x)
+{
+  return (int) x.get()->size();
+}
+
+inline String get(const Int& index, const String& x)
+{
+  const std::string& str = x.get();
+  int i = index.get();
+  if (i < 0 or i >= (int) str.size())
+    error("out-of-bounds string index");
+  return std::string(1, str[i]);
+}
+
+inline String concat(const String& x, const String& y)
+{
+  return x.get() + y.get();
+}
+
+// run the program's main function, reporting runtime errors
+template<typename F> int run(F main)
+{
+  std::ios::sync_with_stdio(false);
+  try {
+    main();
+  }
+  catch (const Error& e) {
+    std::cout.flush();
+    std::cerr << "Runtime Error: " << e.what() << std::endl;
+  }
+  return 0;
+}
+
+}
+
+#endif
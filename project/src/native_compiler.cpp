@@ -0,0 +1,84 @@
+//----------------------------------------------------------------------
+// FILE: native_compiler.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Builds (and caches) native executables from generated C++
+//----------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mypl_exception.h"
+#include "native_compiler.h"
+
+// location of mypl_runtime.h (set by the build)
+#ifndef MYPL_RUNTIME_DIR
+#define MYPL_RUNTIME_DIR "src"
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+// helper function to quote a path for the shell
+static string quote(const string& s)
+{
+  string result = "'";
+  for (char c : s)
+    result += c == '\'' ? string("'\\''") : string(1, c);
+  return result + "'";
+}
+
+
+NativeCompiler::NativeCompiler(CompileCache& cache)
+  : cache(cache)
+{
+  const char* cxx = getenv("CXX");
+  compiler = cxx and *cxx ? cxx : "c++";
+  runtime_dir = MYPL_RUNTIME_DIR;
+}
+
+
+string NativeCompiler::command(const string& input, const string& output)
+{
+  return compiler + " -std=c++20 -O2 -I " + quote(runtime_dir) + " -o " +
+    quote(output) + " " + quote(input);
+}
+
+
+string NativeCompiler::compile(const string& source)
+{
+  // the name covers everything the executable depends on
+  ifstream runtime_file(runtime_dir + "/mypl_runtime.h");
+  stringstream runtime;
+  runtime << runtime_file.rdbuf();
+  string name = CompileCache::hash({source, runtime.str(), command("", "")})
+    + ".bin";
+  if (cache.lookup(name))
+    return cache.path(name);
+
+  string temp = cache.temp_path(name);
+  ofstream(temp + ".cpp") << source;
+  int status = system(command(temp + ".cpp", temp).c_str());
+  fs::remove(temp + ".cpp");
+  if (status != 0) {
+    fs::remove(temp);
+    throw MyPLException("Native Error: C++ compilation failed");
+  }
+  // without a usable cache the executable stays at its temporary path
+  return cache.insert(temp, name) ? cache.path(name) : temp;
+}
+
+
+int NativeCompiler::run(const string& executable)
+{
+  // output so far must come before the program's output
+  cout.flush();
+  int status = system(quote(executable).c_str());
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
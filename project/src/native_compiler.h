@@ -0,0 +1,44 @@
+//----------------------------------------------------------------------
+// FILE: native_compiler.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Builds (and caches) native executables from generated C++
+//----------------------------------------------------------------------
+
+#ifndef NATIVE_COMPILER_H
+#define NATIVE_COMPILER_H
+
+#include <string>
+#include "compile_cache.h"
+
+
+// Compiles the C++ generated for a program (by the CppPrintVisitor)
+// with the system C++ compiler ($CXX, otherwise c++). Executables are
+// kept in the compile cache, named by a hash of the source, the runtime
+// header, and the compile command, so a program is only compiled the
+// first time it is run.
+class NativeCompiler
+{
+public:
+
+  NativeCompiler(CompileCache& cache);
+
+  // path of the executable for the source, compiling it if it is not
+  // already cached (throws a MyPLException if compilation fails)
+  std::string compile(const std::string& source);
+
+  // run the executable, returning its exit status
+  int run(const std::string& executable);
+
+private:
+
+  CompileCache& cache;
+  std::string compiler;
+  std::string runtime_dir;
+
+  // the full compile command for the input and output files
+  std::string command(const std::string& input, const std::string& output);
+
+};
+
+#endif
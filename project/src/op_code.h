@@ -8,7 +8,9 @@
 #ifndef OP_CODE_H
 #define OP_CODE_H
 
-enum class OpCode {
+#include <cstdint>
+
+enum class OpCode : std::uint8_t {
 
   // consts/vars
   PUSH,         // [operand] push v onto stack
@@ -35,12 +37,48 @@ enum class OpCode {
   CMPEQ,        // pop x and y off stack, push (y == x)  
   CMPNE,        // pop x and y off stack, push (y != x)
 
+  // typed arithmetic and comparators (emitted when the operand types
+  // are known statically, a null operand is still an error for the
+  // arithmetic and ordering ops)
+  ADD_INT,      // pop ints x and y, push (y + x)
+  ADD_DBL,      // pop doubles x and y, push (y + x)
+  SUB_INT,      // pop ints x and y, push (y - x)
+  SUB_DBL,      // pop doubles x and y, push (y - x)
+  MUL_INT,      // pop ints x and y, push (y * x)
+  MUL_DBL,      // pop doubles x and y, push (y * x)
+  DIV_INT,      // pop ints x and y, push (y / x)
+  DIV_DBL,      // pop doubles x and y, push (y / x)
+  CMPLT_INT,    // pop ints x and y, push (y < x)
+  CMPLT_DBL,    // pop doubles x and y, push (y < x)
+  CMPLT_STR,    // pop strings x and y, push (y < x)
+  CMPLE_INT,    // pop ints x and y, push (y <= x)
+  CMPLE_DBL,    // pop doubles x and y, push (y <= x)
+  CMPLE_STR,    // pop strings x and y, push (y <= x)
+  CMPGT_INT,    // pop ints x and y, push (y > x)
+  CMPGT_DBL,    // pop doubles x and y, push (y > x)
+  CMPGT_STR,    // pop strings x and y, push (y > x)
+  CMPGE_INT,    // pop ints x and y, push (y >= x)
+  CMPGE_DBL,    // pop doubles x and y, push (y >= x)
+  CMPGE_STR,    // pop strings x and y, push (y >= x)
+  CMPEQ_INT,    // pop ints x and y, push (y == x)
+  CMPEQ_DBL,    // pop doubles x and y, push (y == x)
+  CMPEQ_STR,    // pop strings x and y, push (y == x)
+  CMPNE_INT,    // pop ints x and y, push (y != x)
+  CMPNE_DBL,    // pop doubles x and y, push (y != x)
+  CMPNE_STR,    // pop strings x and y, push (y != x)
+  CMPLT_CHR,    // pop chars x and y, push (y < x)
+  CMPLE_CHR,    // pop chars x and y, push (y <= x)
+  CMPGT_CHR,    // pop chars x and y, push (y > x)
+  CMPGE_CHR,    // pop chars x and y, push (y >= x)
+  CMPEQ_CHR,    // pop chars x and y, push (y == x)
+  CMPNE_CHR,    // pop chars x and y, push (y != x)
+
   // jump
   JMP,          // [operand] jump to given instruction v
   JMPF,         // [operand] pop x, if x is false jump to instruction v
 
   // functions
-  CALL,         // [operand] call function v (pop and push args)
+  CALL,         // [operand] call function v (args become its first locals)
   RET,          // return from current function
 
   // built-ins
@@ -55,14 +93,36 @@ enum class OpCode {
   CONCAT,       // pop x, pop y, push y + x (string concat)
     
   // heap
-  ALLOCS,       // allocate struct obj, push oid x
+  ALLOCS,       // [operand] allocate struct obj of type v, push oid x
   ALLOCA,       // pop x, pop y, allocate array obj with y x values, push oid
-  ADDF,         // [operand] pop x, add field named v to obj(x)
-  SETF,         // [operand] pop x and y, set obj(y).v = x
-  GETF,         // [operand] pop x, push value of obj(x).v 
+  ADDF,         // [operand] pop x, add field slot v to obj(x)
+  SETF,         // [operand] pop x and y, set obj(y)[v] = x (field slot v)
+  GETF,         // [operand] pop x, push obj(x)[v] (field slot v)
   SETI,         // pop x, y, and z, set array obj(z)[y] = x
   GETI,         // pop x and y, push array obj(y)[x] value
-    
+
+  // typed (unboxed) arrays of int, double, and bool elements
+  ALLOCA_INT,   // pop x, pop y, allocate int array obj with y x values
+  ALLOCA_DBL,   // pop x, pop y, allocate double array obj with y x values
+  ALLOCA_BOOL,  // pop x, pop y, allocate bool array obj with y x values
+  SETI_INT,     // pop x, y, and z, set int array obj(z)[y] = x
+  SETI_DBL,     // pop x, y, and z, set double array obj(z)[y] = x
+  SETI_BOOL,    // pop x, y, and z, set bool array obj(z)[y] = x
+  GETI_INT,     // pop x and y, push int array obj(y)[x] value
+  GETI_DBL,     // pop x and y, push double array obj(y)[x] value
+  GETI_BOOL,    // pop x and y, push bool array obj(y)[x] value
+
+  // superinstructions (see VM::fuse), each replacing the LOAD v that
+  // starts a common sequence (the rest of which follows it in the code)
+  INC_LOCAL,    // [operand] LOAD v, PUSH c, ADD_INT, STORE v
+  LOAD_ADD_CONST,         // [operand] LOAD v, PUSH c, ADD_INT
+  LOAD_SUB_CONST,         // [operand] LOAD v, PUSH c, SUB_INT
+  LOAD_GETF,              // [operand] LOAD v, GETF s
+  JMP_IF_LOCAL_GE_CONST,  // [operand] LOAD v, PUSH c, CMPLT_INT, JMPF t
+  JMP_IF_LOCAL_GT_CONST,  // [operand] LOAD v, PUSH c, CMPLE_INT, JMPF t
+  JMP_IF_LOCAL_LE_CONST,  // [operand] LOAD v, PUSH c, CMPGT_INT, JMPF t
+  JMP_IF_LOCAL_LT_CONST,  // [operand] LOAD v, PUSH c, CMPGE_INT, JMPF t
+
   // special
   DUP,          // pop x, push x, push x
   NOP           // has no effect (for jumping over code segments)
@@ -0,0 +1,173 @@
+//----------------------------------------------------------------------
+// FILE: peephole_optimizer.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Implementation of the bytecode peephole optimizer (-O1)
+//----------------------------------------------------------------------
+
+#include "peephole_optimizer.h"
+
+using namespace std;
+
+
+// helper functions for jump instructions and their targets
+static bool is_jump(const VMInstr& instr)
+{
+  return instr.opcode() == OpCode::JMP or instr.opcode() == OpCode::JMPF;
+}
+
+static int target(const VMInstr& instr)
+{
+  return get<int>(instr.operand().value());
+}
+
+// true if the instruction pushes a bool with an instruction after it
+static bool pushes_bool(const vector<VMInstr>& code, int pc)
+{
+  return pc + 1 < code.size() and code[pc].opcode() == OpCode::PUSH and
+    holds_alternative<bool>(code[pc].operand().value());
+}
+
+
+void PeepholeOptimizer::optimize(VMFrameInfo& frame)
+{
+  vector<VMInstr>& code = frame.instructions;
+  int size = code.size();
+  bool changed = true;
+  while (changed) {
+    changed = thread_jumps(code);
+    changed = remove_unreachable(code) or changed;
+    changed = remove_redundant(code) or changed;
+  }
+  eliminated_count += size - code.size();
+}
+
+
+int PeepholeOptimizer::eliminated() const
+{
+  return eliminated_count;
+}
+
+
+bool PeepholeOptimizer::thread_jumps(vector<VMInstr>& code)
+{
+  bool changed = false;
+  for (VMInstr& instr : code) {
+    if (!is_jump(instr))
+      continue;
+    // follow NOPs, JMPs, and JMPFs of a pushed bool (the result of a
+    // short-circuit and/or), giving up on a cycle of jumps
+    int t = target(instr);
+    for (int steps = 0; t < code.size() and steps <= code.size(); ++steps) {
+      if (code[t].opcode() == OpCode::NOP)
+        ++t;
+      else if (code[t].opcode() == OpCode::JMP and target(code[t]) != t)
+        t = target(code[t]);
+      else if (pushes_bool(code, t) and code[t + 1].opcode() == OpCode::JMPF)
+        t = get<bool>(code[t].operand().value()) ? t + 2 : target(code[t + 1]);
+      else
+        break;
+    }
+    if (t != target(instr)) {
+      instr.set_operand(t);
+      changed = true;
+    }
+    // returning right away
+    if (instr.opcode() == OpCode::JMP and t < code.size() and
+        code[t].opcode() == OpCode::RET) {
+      instr = VMInstr::RET();
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+
+bool PeepholeOptimizer::remove_unreachable(vector<VMInstr>& code)
+{
+  vector<bool> reached(code.size(), false);
+  vector<int> pending {0};
+  while (!pending.empty()) {
+    int pc = pending.back();
+    pending.pop_back();
+    if (pc >= code.size() or reached[pc])
+      continue;
+    reached[pc] = true;
+    OpCode op = code[pc].opcode();
+    if (is_jump(code[pc]))
+      pending.push_back(target(code[pc]));
+    if (op != OpCode::JMP and op != OpCode::RET)
+      pending.push_back(pc + 1);
+  }
+  vector<bool> dead(code.size());
+  for (int pc = 0; pc < code.size(); ++pc)
+    dead[pc] = !reached[pc];
+  return remove(code, dead);
+}
+
+
+bool PeepholeOptimizer::remove_redundant(vector<VMInstr>& code)
+{
+  vector<bool> targeted(code.size() + 1, false);
+  for (const VMInstr& instr : code)
+    if (is_jump(instr))
+      targeted[target(instr)] = true;
+
+  bool changed = false;
+  vector<bool> dead(code.size(), false);
+  for (int pc = 0; pc < code.size(); ++pc) {
+    OpCode op = code[pc].opcode();
+    if (op == OpCode::NOP or (op == OpCode::JMP and target(code[pc]) == pc + 1)) {
+      dead[pc] = true;
+      continue;
+    }
+    if (pc + 1 == code.size() or targeted[pc + 1])
+      continue;
+    const VMInstr& next = code[pc + 1];
+    OpCode next_op = next.opcode();
+    bool pushes = op == OpCode::DUP or op == OpCode::PUSH or op == OpCode::LOAD;
+    bool same_var = (op == OpCode::LOAD or op == OpCode::STORE) and
+      next.operand().has_value() and code[pc].operand() == next.operand();
+    if ((pushes and next_op == OpCode::POP) or
+        (op == OpCode::LOAD and next_op == OpCode::STORE and same_var)) {
+      dead[pc] = dead[pc + 1] = true;
+      ++pc;
+    }
+    else if (op == OpCode::STORE and next_op == OpCode::LOAD and same_var) {
+      code[pc + 1] = code[pc];
+      code[pc] = VMInstr::DUP();
+      changed = true;
+      ++pc;
+    }
+  }
+  return remove(code, dead) or changed;
+}
+
+
+bool PeepholeOptimizer::remove(vector<VMInstr>& code, const vector<bool>& dead)
+{
+  // new_index[i] is the new index of the first instruction kept at or
+  // after i (the end of the code for i == size)
+  vector<int> new_index(code.size() + 1);
+  int kept = 0;
+  for (int pc = 0; pc < code.size(); ++pc) {
+    new_index[pc] = kept;
+    if (!dead[pc])
+      ++kept;
+  }
+  new_index[code.size()] = kept;
+  if (kept == code.size())
+    return false;
+
+  vector<VMInstr> result;
+  result.reserve(kept);
+  for (int pc = 0; pc < code.size(); ++pc) {
+    if (dead[pc])
+      continue;
+    result.push_back(code[pc]);
+    if (is_jump(code[pc]))
+      result.back().set_operand(new_index[target(code[pc])]);
+  }
+  code = move(result);
+  return true;
+}
@@ -0,0 +1,54 @@
+//----------------------------------------------------------------------
+// FILE: peephole_optimizer.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Interface for the bytecode peephole optimizer (-O1)
+//----------------------------------------------------------------------
+
+#ifndef PEEPHOLE_OPTIMIZER_H
+#define PEEPHOLE_OPTIMIZER_H
+
+#include <vector>
+#include "vm_frame.h"
+
+
+// Rewrites the generated (not yet linked) instructions of a frame,
+// repeating until nothing changes:
+//
+//   - jumps to NOPs, to other jumps, and to a JMPF of a pushed bool
+//     (as short-circuit and/or leave) go straight to the final target
+//     (and a JMP to a RET becomes the RET)
+//   - code no jump or fall through can reach is deleted (e.g., the
+//     JMP past the else branches after a RET)
+//   - NOPs, jumps to the next instruction, and pairs that cancel out
+//     (DUP/PUSH/LOAD then POP, LOAD x then STORE x) are deleted
+//   - STORE x then LOAD x becomes DUP then STORE x
+//
+// A pair is only rewritten when no jump targets its second
+// instruction.
+class PeepholeOptimizer
+{
+public:
+
+  // optimize the frame's instructions
+  void optimize(VMFrameInfo& frame);
+
+  // number of instructions eliminated so far (over all frames)
+  int eliminated() const;
+
+private:
+
+  int eliminated_count = 0;
+
+  // apply each rewrite once, returning true if the code changed
+  bool thread_jumps(std::vector<VMInstr>& code);
+  bool remove_unreachable(std::vector<VMInstr>& code);
+  bool remove_redundant(std::vector<VMInstr>& code);
+
+  // delete the marked instructions, retargeting jumps to the next
+  // instruction kept (returns true if any were deleted)
+  bool remove(std::vector<VMInstr>& code, const std::vector<bool>& dead);
+
+};
+
+#endif
@@ -72,4 +72,54 @@ private:
     void print_indent();
 
 };
+
+// Translates a (checked) program into C++ built against the runtime
+// in mypl_runtime.h. Operands are evaluated left to right and
+// expressions group right to left, the same as in the vm.
+class CppPrintVisitor : public Visitor {
+public:
+  CppPrintVisitor(std::ostream& output);
+  void visit(Program& p);
+  void visit(FunDef& f);
+  void visit(StructDef& s);
+  void visit(ReturnStmt& s);
+  void visit(WhileStmt& s);
+  void visit(ForStmt& s);
+  void visit(IfStmt& s);
+  void visit(VarDeclStmt& s);
+  void visit(AssignStmt& s);
+  void visit(CallExpr& e);
+  void visit(Expr& e);
+  void visit(SimpleTerm& t);
+  void visit(ComplexTerm& t);
+  void visit(SimpleRValue& v);
+  void visit(NewRValue& v);
+  void visit(VarRValue& v);
+private:
+  std::ostream& out;
+  int indent = 0;
+  const int INDENT_AMT = 2;
+  // true while printing a function returning void
+  bool void_fun = false;
+  // number of temporaries declared so far (for unique names)
+  int temp_count = 0;
+
+  void inc_indent();
+  void dec_indent();
+  void print_indent();
+
+  // the C++ type of a MyPL type
+  std::string type_name(const DataType& t);
+  // the function signature (without a body)
+  void print_signature(FunDef& f);
+  // print statements, one per line (and as a braced block)
+  void print_stmts(std::vector<std::shared_ptr<Stmt>>& stmts);
+  void print_block(std::vector<std::shared_ptr<Stmt>>& stmts);
+  // print a variable path (as an rvalue or lvalue)
+  void print_path(std::vector<VarRef>& path);
+  // print a call, sequencing the arguments through temporaries (left
+  // to right) when one has side effects
+  void print_call(const std::string& fun, const std::vector<ASTNode*>& args,
+                  bool has_effects);
+};
 #endif
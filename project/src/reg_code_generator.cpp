@@ -0,0 +1,495 @@
+//----------------------------------------------------------------------
+// FILE: reg_code_generator.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Program that takes an AST and converts it into register
+// machine instructions
+//----------------------------------------------------------------------
+
+#include <unordered_set>
+#include "reg_code_generator.h"
+
+using namespace std;
+
+// hash table of names of the base data types (non-reference values)
+const unordered_set<string> BASE_TYPES {"int", "double", "char", "string", "bool"};
+
+// helper function to replace all occurrences of old string with new
+// (defined in code_generator.cpp)
+void replace_all(string& s, const string& old_str, const string& new_str);
+
+
+RegCodeGenerator::RegCodeGenerator(RegVM& vm)
+  : vm(vm)
+{
+}
+
+
+int RegCodeGenerator::emit(RegOp op, int a, int b, int c)
+{
+  curr_function.code.push_back(RegCode {op, a, b, c});
+  return curr_function.code.size() - 1;
+}
+
+
+int RegCodeGenerator::temp()
+{
+  int reg = next_reg++;
+  curr_function.reg_count = max(curr_function.reg_count, next_reg);
+  return reg;
+}
+
+
+void RegCodeGenerator::reset_temps()
+{
+  next_reg = var_table.size();
+  curr_function.reg_count = max(curr_function.reg_count, next_reg);
+}
+
+
+int RegCodeGenerator::result_reg(int dest)
+{
+  return dest >= 0 ? dest : temp();
+}
+
+
+int RegCodeGenerator::expr(ASTNode& e, int dest)
+{
+  target = dest;
+  e.accept(*this);
+  if (dest >= 0 and result != dest) {
+    emit(RegOp::MOV, dest, result);
+    return dest;
+  }
+  return result;
+}
+
+
+void RegCodeGenerator::stmt(Stmt& s)
+{
+  // temporaries never outlive a statement
+  reset_temps();
+  s.accept(*this);
+}
+
+
+void RegCodeGenerator::visit(Program& p)
+{
+  // functions are numbered up front (calls may come before the
+  // function's definition)
+  for (int i = 0; i < p.fun_defs.size(); ++i)
+    function_index[p.fun_defs[i].fun_name.lexeme()] = i;
+  for (auto& struct_def : p.struct_defs)
+    struct_def.accept(*this);
+  for (auto& fun_def : p.fun_defs)
+    fun_def.accept(*this);
+}
+
+
+void RegCodeGenerator::visit(FunDef& f)
+{
+  var_table.push_environment();
+  curr_function = {f.fun_name.lexeme(), (int)f.params.size()};
+  // params are the first registers (the vm passes args in place)
+  for (auto& param : f.params)
+    var_table.add(param.var_name.lexeme());
+  reset_temps();
+
+  for (auto& s : f.stmts)
+    stmt(*s);
+
+  // every function ends in a return (of null if it falls off the end)
+  reset_temps();
+  int null_reg = temp();
+  emit(RegOp::LOADK, null_reg, vm.constant(nullptr));
+  emit(RegOp::RET, null_reg);
+
+  vm.add(curr_function);
+  var_table.pop_environment();
+}
+
+
+void RegCodeGenerator::visit(StructDef& s)
+{
+  // fields are laid out in declaration order
+  auto& slots = field_slots[s.struct_name.lexeme()];
+  VMStructInfo type {s.struct_name.lexeme()};
+  for (int i = 0; i < s.fields.size(); ++i) {
+    slots[s.fields[i].var_name.lexeme()] = i;
+    type.field_names.push_back(s.fields[i].var_name.lexeme());
+    // struct and array fields hold object references
+    const DataType& field_type = s.fields[i].data_type;
+    if (field_type.is_array or !BASE_TYPES.contains(field_type.type_name))
+      type.reference_slots.push_back(i);
+  }
+  struct_index[s.struct_name.lexeme()] = vm.add(type);
+}
+
+
+int RegCodeGenerator::field_slot(const DataType& type, const Token& field)
+{
+  return field_slots[type.type_name][field.lexeme()];
+}
+
+
+RegOp RegCodeGenerator::array_get(const DataType& type)
+{
+  if (type.type_name == "int")
+    return RegOp::GETI_INT;
+  else if (type.type_name == "double")
+    return RegOp::GETI_DBL;
+  else if (type.type_name == "bool")
+    return RegOp::GETI_BOOL;
+  return RegOp::GETI;
+}
+
+
+RegOp RegCodeGenerator::array_set(const DataType& type)
+{
+  if (type.type_name == "int")
+    return RegOp::SETI_INT;
+  else if (type.type_name == "double")
+    return RegOp::SETI_DBL;
+  else if (type.type_name == "bool")
+    return RegOp::SETI_BOOL;
+  return RegOp::SETI;
+}
+
+
+int RegCodeGenerator::path_value(vector<VarRef>& path, int count, int dest)
+{
+  // intermediate objects go in temporaries, the last value straight to
+  // dest (instructions read their operands before writing)
+  int reg = var_table.get(path[0].var_name.lexeme());
+  for (int i = 0; i < count; ++i) {
+    bool last = i == count - 1;
+    if (i > 0) {
+      int field_reg = last and !path[i].array_expr ? result_reg(dest) : temp();
+      emit(RegOp::GETF, field_reg, reg,
+           field_slot(path[i - 1].type, path[i].var_name));
+      reg = field_reg;
+    }
+    if (path[i].array_expr.has_value()) {
+      int index = expr(path[i].array_expr.value());
+      int elem_reg = last ? result_reg(dest) : temp();
+      emit(array_get(path[i].type), elem_reg, reg, index);
+      reg = elem_reg;
+    }
+  }
+  if (dest >= 0 and reg != dest)
+    emit(RegOp::MOV, dest, reg);
+  return dest >= 0 ? dest : reg;
+}
+
+
+void RegCodeGenerator::visit(ReturnStmt& s)
+{
+  emit(RegOp::RET, expr(s.expr));
+}
+
+
+void RegCodeGenerator::visit(WhileStmt& s)
+{
+  int start = curr_function.code.size();
+  int cond = expr(s.condition);
+  int jmpf = emit(RegOp::JMPF, cond, -1);
+  var_table.push_environment();
+  for (auto& body_stmt : s.stmts)
+    stmt(*body_stmt);
+  var_table.pop_environment();
+  emit(RegOp::JMP, start);
+  curr_function.code[jmpf].b = curr_function.code.size();
+}
+
+
+void RegCodeGenerator::visit(ForStmt& s)
+{
+  var_table.push_environment();
+  s.var_decl.accept(*this);
+  int start = curr_function.code.size();
+  reset_temps();
+  int cond = expr(s.condition);
+  int jmpf = emit(RegOp::JMPF, cond, -1);
+  var_table.push_environment();
+  for (auto& body_stmt : s.stmts)
+    stmt(*body_stmt);
+  var_table.pop_environment();
+  stmt(s.assign_stmt);
+  emit(RegOp::JMP, start);
+  curr_function.code[jmpf].b = curr_function.code.size();
+  var_table.pop_environment();
+}
+
+
+void RegCodeGenerator::visit(IfStmt& s)
+{
+  vector<int> jmps;
+  // the if part and each else if: the condition, then the block
+  // jumping past the rest
+  vector<BasicIf*> parts {&s.if_part};
+  for (auto& else_if : s.else_ifs)
+    parts.push_back(&else_if);
+  for (BasicIf* part : parts) {
+    reset_temps();
+    int cond = expr(part->condition);
+    int jmpf = emit(RegOp::JMPF, cond, -1);
+    var_table.push_environment();
+    for (auto& body_stmt : part->stmts)
+      stmt(*body_stmt);
+    var_table.pop_environment();
+    jmps.push_back(emit(RegOp::JMP, -1));
+    curr_function.code[jmpf].b = curr_function.code.size();
+  }
+  var_table.push_environment();
+  for (auto& else_stmt : s.else_stmts)
+    stmt(*else_stmt);
+  var_table.pop_environment();
+  for (int jmp : jmps)
+    curr_function.code[jmp].a = curr_function.code.size();
+}
+
+
+void RegCodeGenerator::visit(VarDeclStmt& s)
+{
+  // the value is computed directly into the variable's register
+  string var_name = s.var_def.var_name.lexeme();
+  var_table.add(var_name);
+  reset_temps();
+  expr(s.expr, var_table.get(var_name));
+}
+
+
+void RegCodeGenerator::visit(AssignStmt& s)
+{
+  vector<VarRef>& lvalue = s.lvalue;
+  int n = lvalue.size();
+  VarRef& last = lvalue[n - 1];
+  if (n == 1 and !last.array_expr.has_value()) {
+    expr(s.expr, var_table.get(last.var_name.lexeme()));
+    return;
+  }
+  // the object (or array) being set
+  int obj = path_value(lvalue, n - 1);
+  if (last.array_expr.has_value()) {
+    int arr = obj;
+    if (n == 1)
+      arr = var_table.get(last.var_name.lexeme());
+    else {
+      arr = temp();
+      emit(RegOp::GETF, arr, obj, field_slot(lvalue[n - 2].type, last.var_name));
+    }
+    int index = expr(last.array_expr.value());
+    int value = expr(s.expr);
+    emit(array_set(last.type), arr, index, value);
+  }
+  else {
+    int value = expr(s.expr);
+    emit(RegOp::SETF, obj, field_slot(lvalue[n - 2].type, last.var_name), value);
+  }
+}
+
+
+void RegCodeGenerator::visit(CallExpr& e)
+{
+  int dest = target;
+  int save = next_reg;
+  string fun_name = e.fun_name.lexeme();
+
+  // built in functions are single instructions
+  static const unordered_map<string,RegOp> builtins {
+    {"input", RegOp::READ}, {"get", RegOp::GETC}, {"concat", RegOp::CONCAT},
+    {"length", RegOp::SLEN}, {"length_array", RegOp::ALEN},
+    {"to_int", RegOp::TOINT}, {"to_double", RegOp::TODBL},
+    {"to_string", RegOp::TOSTR}
+  };
+  if (fun_name == "print") {
+    result = expr(e.args[0]);
+    emit(RegOp::WRITE, result);
+    return;
+  }
+  if (builtins.contains(fun_name)) {
+    vector<int> args;
+    for (auto& arg : e.args)
+      args.push_back(expr(arg));
+    args.resize(2, 0);
+    next_reg = save;
+    result = result_reg(dest);
+    emit(builtins.at(fun_name), result, args[0], args[1]);
+    return;
+  }
+
+  // args are computed into consecutive registers, the callee's first
+  // registers
+  int base = next_reg;
+  for (int i = 0; i < e.args.size(); ++i)
+    temp();
+  for (int i = 0; i < e.args.size(); ++i)
+    expr(e.args[i], base + i);
+  next_reg = save;
+  result = result_reg(dest);
+  emit(RegOp::CALL, result, function_index[fun_name], base);
+}
+
+
+void RegCodeGenerator::visit(Expr& e)
+{
+  int dest = target;
+  int save = next_reg;
+
+  if (!e.op.has_value()) {
+    if (!e.negated)
+      result = expr(*e.first, dest);
+    else {
+      int x = expr(*e.first);
+      next_reg = save;
+      result = result_reg(dest);
+      emit(RegOp::NOT, result, x);
+    }
+    return;
+  }
+
+  // and/or jump past the rest once the first operand settles the
+  // result, so both operands go to the result register (a temporary,
+  // since the rest could read a variable being assigned)
+  string op_val = e.op->lexeme();
+  if (op_val == "and" or op_val == "or") {
+    int reg = dest >= var_table.size() ? dest : temp();
+    expr(*e.first, reg);
+    int jmpf = emit(RegOp::JMPF, reg, -1);
+    int jmp = -1;
+    if (op_val == "or") {
+      jmp = emit(RegOp::JMP, -1);
+      curr_function.code[jmpf].b = curr_function.code.size();
+    }
+    expr(*e.rest, reg);
+    // a JMPF to the next instruction checks the rest's value for null
+    // (as the JMPF checks the first's)
+    if (!e.rest->never_null())
+      emit(RegOp::JMPF, reg, curr_function.code.size() + 1);
+    if (op_val == "and")
+      curr_function.code[jmpf].b = curr_function.code.size();
+    else
+      curr_function.code[jmp].a = curr_function.code.size();
+    next_reg = max(save, reg + 1);
+    if (e.negated)
+      emit(RegOp::NOT, reg, reg);
+    result = reg;
+    return;
+  }
+
+  int x = expr(*e.first);
+  int y = expr(*e.rest);
+  // operand temporaries are free once the operation reads them
+  next_reg = save;
+  result = result_reg(dest);
+
+  // operand types (from the semantic checker) select a typed
+  // instruction when both sides are the same int or double type
+  const DataType& lhs = e.first->type;
+  const DataType& rhs = e.rest->type;
+  string type = "";
+  if (!lhs.is_array and !rhs.is_array and lhs.type_name == rhs.type_name)
+    type = lhs.type_name;
+  bool is_int = type == "int";
+  bool is_dbl = type == "double";
+  auto typed = [&](RegOp generic, RegOp int_op, RegOp dbl_op) {
+    return is_int ? int_op : is_dbl ? dbl_op : generic;
+  };
+
+  RegOp op = RegOp::ADD;
+  if (op_val == "+")
+    op = typed(RegOp::ADD, RegOp::ADD_INT, RegOp::ADD_DBL);
+  else if (op_val == "-")
+    op = typed(RegOp::SUB, RegOp::SUB_INT, RegOp::SUB_DBL);
+  else if (op_val == "*")
+    op = typed(RegOp::MUL, RegOp::MUL_INT, RegOp::MUL_DBL);
+  else if (op_val == "/")
+    op = typed(RegOp::DIV, RegOp::DIV_INT, RegOp::DIV_DBL);
+  else if (op_val == "==")
+    op = typed(RegOp::CMPEQ, RegOp::CMPEQ_INT, RegOp::CMPEQ_DBL);
+  else if (op_val == "!=")
+    op = typed(RegOp::CMPNE, RegOp::CMPNE_INT, RegOp::CMPNE_DBL);
+  else if (op_val == "<")
+    op = typed(RegOp::CMPLT, RegOp::CMPLT_INT, RegOp::CMPLT_DBL);
+  else if (op_val == ">")
+    op = typed(RegOp::CMPGT, RegOp::CMPGT_INT, RegOp::CMPGT_DBL);
+  else if (op_val == "<=")
+    op = typed(RegOp::CMPLE, RegOp::CMPLE_INT, RegOp::CMPLE_DBL);
+  else if (op_val == ">=")
+    op = typed(RegOp::CMPGE, RegOp::CMPGE_INT, RegOp::CMPGE_DBL);
+  emit(op, result, x, y);
+
+  if (e.negated)
+    emit(RegOp::NOT, result, result);
+}
+
+
+void RegCodeGenerator::visit(SimpleTerm& t)
+{
+  result = expr(*t.rvalue, target);
+}
+
+
+void RegCodeGenerator::visit(ComplexTerm& t)
+{
+  result = expr(t.expr, target);
+}
+
+
+void RegCodeGenerator::visit(SimpleRValue& v)
+{
+  VMValue value = nullptr;
+  if (v.value.type() == TokenType::INT_VAL)
+    value = stoi(v.value.lexeme());
+  else if (v.value.type() == TokenType::DOUBLE_VAL)
+    value = stod(v.value.lexeme());
+  else if (v.value.type() == TokenType::BOOL_VAL)
+    value = v.value.lexeme() == "true";
+  else if (v.value.type() == TokenType::STRING_VAL or
+           v.value.type() == TokenType::CHAR_VAL) {
+    string s = v.value.lexeme();
+    replace_all(s, "\\n", "\n");
+    replace_all(s, "\\t", "\t");
+    // chars are vm char values (not one-character strings)
+    if (v.value.type() == TokenType::CHAR_VAL)
+      value = s[0];
+    else
+      value = VMString(s);
+  }
+  result = result_reg(target);
+  emit(RegOp::LOADK, result, vm.constant(value));
+}
+
+
+void RegCodeGenerator::visit(NewRValue& v)
+{
+  int dest = target;
+  int save = next_reg;
+  if (v.array_expr.has_value()) {
+    int size = expr(v.array_expr.value());
+    next_reg = save;
+    result = result_reg(dest);
+    // int, double, and bool arrays are stored unboxed
+    string type = v.type.lexeme();
+    if (type == "int")
+      emit(RegOp::ALLOCA_INT, result, size);
+    else if (type == "double")
+      emit(RegOp::ALLOCA_DBL, result, size);
+    else if (type == "bool")
+      emit(RegOp::ALLOCA_BOOL, result, size);
+    else
+      emit(RegOp::ALLOCA, result, size);
+  }
+  else {
+    // the vm creates the object with all fields set to null
+    result = result_reg(dest);
+    emit(RegOp::ALLOCS, result, struct_index[v.type.lexeme()]);
+  }
+}
+
+
+void RegCodeGenerator::visit(VarRValue& v)
+{
+  // a plain variable is used in place (no instruction)
+  result = path_value(v.path, v.path.size(), target);
+}
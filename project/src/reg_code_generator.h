@@ -0,0 +1,96 @@
+//----------------------------------------------------------------------
+// FILE: reg_code_generator.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Interface for the register code generator visitor.
+//----------------------------------------------------------------------
+
+
+#ifndef REG_CODE_GENERATOR_H
+#define REG_CODE_GENERATOR_H
+
+#include <string>
+#include <unordered_map>
+#include "ast.h"
+#include "reg_vm.h"
+#include "var_table.h"
+
+
+// Generates register code (see reg_vm.h) for a checked program. Each
+// variable is the register of its var table index, and temporaries
+// are allocated above the variables in scope, reused once a statement
+// (or an operand) is done with them.
+class RegCodeGenerator : public Visitor {
+public:
+  RegCodeGenerator(RegVM& vm);
+  void visit(Program& p);
+  void visit(FunDef& f);
+  void visit(StructDef& s);
+  void visit(ReturnStmt& s);
+  void visit(WhileStmt& s);
+  void visit(ForStmt& s);
+  void visit(IfStmt& s);
+  void visit(VarDeclStmt& s);
+  void visit(AssignStmt& s);
+  void visit(CallExpr& e);
+  void visit(Expr& e);
+  void visit(SimpleTerm& t);
+  void visit(ComplexTerm& t);
+  void visit(SimpleRValue& v);
+  void visit(NewRValue& v);
+  void visit(VarRValue& v);
+
+private:
+
+  RegVM& vm;
+  RegFunction curr_function;
+  VarTable var_table;
+  // function and struct indexes by name
+  std::unordered_map<std::string,int> function_index;
+  std::unordered_map<std::string,int> struct_index;
+  // field slot offsets (by struct name, then field name)
+  std::unordered_map<std::string,
+                     std::unordered_map<std::string,int>> field_slots;
+
+  // the next free temporary register
+  int next_reg = 0;
+
+  // the register an expression should leave its value in (or -1 for
+  // any register) and the register it did
+  int target = -1;
+  int result = -1;
+
+  // emit an instruction, returning its index
+  int emit(RegOp op, int a = 0, int b = 0, int c = 0);
+
+  // allocate a temporary register
+  int temp();
+
+  // free all temporaries (at the start of a statement)
+  void reset_temps();
+
+  // generate code for the expression (or term), returning the register
+  // holding its value (dest if given)
+  int expr(ASTNode& e, int dest = -1);
+
+  // the register for a result: dest, if given, or a new temporary
+  int result_reg(int dest);
+
+  // generate code for the value of a path's prefix (path[0] through
+  // path[count - 1]), returning its register (dest if given)
+  int path_value(std::vector<VarRef>& path, int count, int dest = -1);
+
+  // generate code for a statement within a statement list
+  void stmt(Stmt& s);
+
+  // slot offset of the field within objects of the given struct type
+  int field_slot(const DataType& type, const Token& field);
+
+  // array element get and set instructions for the array's type
+  // (unboxed int, double, and bool arrays have their own)
+  RegOp array_get(const DataType& type);
+  RegOp array_set(const DataType& type);
+
+};
+
+#endif
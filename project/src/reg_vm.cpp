@@ -0,0 +1,797 @@
+//----------------------------------------------------------------------
+// FILE: reg_vm.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Register-based alternative to the stack vm run loop
+//----------------------------------------------------------------------
+
+#include <iostream>
+#include "mypl_exception.h"
+#include "reg_vm.h"
+
+using namespace std;
+
+
+string to_string(RegOp op)
+{
+  static const char* names[] = {
+    "MOV", "LOADK",
+    "ADD", "SUB", "MUL", "DIV",
+    "ADD_INT", "SUB_INT", "MUL_INT", "DIV_INT",
+    "ADD_DBL", "SUB_DBL", "MUL_DBL", "DIV_DBL",
+    "AND", "OR", "NOT",
+    "CMPLT", "CMPLE", "CMPGT", "CMPGE", "CMPEQ", "CMPNE",
+    "CMPLT_INT", "CMPLE_INT", "CMPGT_INT", "CMPGE_INT", "CMPEQ_INT",
+    "CMPNE_INT",
+    "CMPLT_DBL", "CMPLE_DBL", "CMPGT_DBL", "CMPGE_DBL", "CMPEQ_DBL",
+    "CMPNE_DBL",
+    "JMP", "JMPF", "CALL", "RET",
+    "WRITE", "READ", "SLEN", "ALEN", "GETC",
+    "TOINT", "TODBL", "TOSTR", "CONCAT",
+    "ALLOCS", "ALLOCA", "ALLOCA_INT", "ALLOCA_DBL", "ALLOCA_BOOL",
+    "GETF", "SETF",
+    "GETI", "GETI_INT", "GETI_DBL", "GETI_BOOL",
+    "SETI", "SETI_INT", "SETI_DBL", "SETI_BOOL"
+  };
+  static_assert(sizeof(names) / sizeof(names[0]) ==
+                static_cast<int>(RegOp::SETI_BOOL) + 1,
+                "register opcode names out of sync with RegOp");
+  return names[static_cast<int>(op)];
+}
+
+
+RegVM::RegVM(VM& vm)
+  : vm(vm)
+{
+  frames.reserve(VM::FRAME_RESERVE);
+}
+
+
+int RegVM::add(const RegFunction& function)
+{
+  functions.push_back(function);
+  return functions.size() - 1;
+}
+
+
+int RegVM::add(const VMStructInfo& type)
+{
+  vm.add(type);
+  return vm.struct_index[type.struct_name];
+}
+
+
+int RegVM::constant(const VMValue& value)
+{
+  return vm.add_constant(value);
+}
+
+
+void RegVM::enable_count()
+{
+  counting = true;
+}
+
+
+long RegVM::instruction_count() const
+{
+  return count;
+}
+
+
+void RegVM::error(string msg, const RegFrame& frame) const
+{
+  vm.output.flush();
+  int pc = frame.pc - 1;
+  msg += " (in " + frame.function->function_name + " at " + to_string(pc) +
+    ": " + instr_string(*frame.function, pc) + ")";
+  throw MyPLException::VMError(msg);
+}
+
+
+VMValue& RegVM::field(const RegFrame& frame, int oid, int slot)
+{
+  auto obj = vm.struct_heap.find(oid);
+  if (obj == vm.struct_heap.end() or slot >= obj->second.fields.size())
+    error("invalid struct reference", frame);
+  return obj->second.fields[slot];
+}
+
+
+string RegVM::instr_string(const RegFunction& function, int pc) const
+{
+  const RegCode& code = function.code[pc];
+  auto r = [](int i) {return "r" + to_string(i);};
+  string args = "";
+  switch (code.op) {
+  case RegOp::LOADK:
+    args = r(code.a) + ", " + to_string(vm.constants[code.b]);
+    break;
+  case RegOp::JMP:
+    args = to_string(code.a);
+    break;
+  case RegOp::JMPF:
+    args = r(code.a) + ", " + to_string(code.b);
+    break;
+  case RegOp::CALL:
+    args = r(code.a) + ", " + functions[code.b].function_name + ", " +
+      r(code.c);
+    break;
+  case RegOp::RET: case RegOp::WRITE: case RegOp::READ:
+    args = r(code.a);
+    break;
+  case RegOp::ALLOCS:
+    args = r(code.a) + ", " + vm.struct_info[code.b].struct_name;
+    break;
+  case RegOp::GETF:
+    args = r(code.a) + ", " + r(code.b) + ", " + to_string(code.c);
+    break;
+  case RegOp::SETF:
+    args = r(code.a) + ", " + to_string(code.b) + ", " + r(code.c);
+    break;
+  case RegOp::MOV: case RegOp::NOT: case RegOp::SLEN: case RegOp::ALEN:
+  case RegOp::TOINT: case RegOp::TODBL: case RegOp::TOSTR:
+  case RegOp::ALLOCA: case RegOp::ALLOCA_INT: case RegOp::ALLOCA_DBL:
+  case RegOp::ALLOCA_BOOL:
+    args = r(code.a) + ", " + r(code.b);
+    break;
+  default:
+    args = r(code.a) + ", " + r(code.b) + ", " + r(code.c);
+  }
+  return to_string(code.op) + "(" + args + ")";
+}
+
+
+string to_string(const RegVM& vm)
+{
+  string s = "";
+  for (int f = 0; f < vm.functions.size(); ++f) {
+    const RegFunction& function = vm.functions[f];
+    s += "\nFrame '" + function.function_name + "' (" + to_string(f) + ", " +
+      to_string(function.reg_count) + " registers)\n";
+    for (int i = 0; i < function.code.size(); ++i)
+      s += "  " + to_string(i) + ": " + vm.instr_string(function, i) + "\n";
+  }
+  return s;
+}
+
+
+void RegVM::run()
+{
+  int main = -1;
+  for (int i = 0; i < functions.size(); ++i)
+    if (functions[i].function_name == "main")
+      main = i;
+  if (main == -1)
+    vm.error("No 'main' function");
+  frames.push_back(RegFrame {&functions[main], 0, 0});
+  vm.stack.resize(functions[main].reg_count, nullptr);
+  if (counting)
+    execute<true>();
+  else
+    execute<false>();
+  vm.output.flush();
+}
+
+
+//----------------------------------------------------------------------
+// Dispatch
+//----------------------------------------------------------------------
+
+// As in the stack vm (see vm.cpp), handlers are threaded with
+// computed gotos when supported and are switch cases otherwise. Every
+// function ends in a RET, so there is no end of code check.
+
+#if defined(MYPL_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#define REG_THREADED_DISPATCH
+#endif
+
+#define REG_FETCH()                                                     \
+  instr = &code[frame->pc];                                             \
+  ++frame->pc;                                                          \
+  if constexpr (COUNT)                                                  \
+    ++count;
+
+#ifdef REG_THREADED_DISPATCH
+#define REG_DISPATCH_BEGIN()                                            \
+  REG_FETCH();                                                          \
+  goto *dispatch_table[static_cast<int>(instr->op)];
+#define REG_CASE(op) L_##op:
+#define REG_NEXT()                                                      \
+  do {                                                                  \
+    REG_FETCH();                                                        \
+    goto *dispatch_table[static_cast<int>(instr->op)];                 \
+  } while (false)
+#define REG_DISPATCH_END()
+#else
+#define REG_DISPATCH_BEGIN()                                            \
+  while (true) {                                                        \
+    REG_FETCH();                                                        \
+    switch (instr->op) {
+#define REG_CASE(op) case RegOp::op:
+#define REG_NEXT() continue
+#define REG_DISPATCH_END()                                              \
+    }                                                                   \
+    error("unsupported operation " + to_string(instr->op), *frame);    \
+  }
+#endif
+
+// registers of the current instruction
+#define RA r[instr->a]
+#define RB r[instr->b]
+#define RC r[instr->c]
+
+// null operands are errors (the stack vm's ensure_not_null)
+#define REG_NOT_NULL(x)                                                 \
+  if (holds_alternative<nullptr_t>(x))                                  \
+    error("null reference", *frame);
+
+// generic binary operations using the stack vm's helper functions
+#define REG_BINARY(fn)                                                  \
+  {                                                                     \
+    REG_NOT_NULL(RB);                                                   \
+    REG_NOT_NULL(RC);                                                   \
+    RA = vm.fn(RB, RC);                                                 \
+  }
+
+// typed binary operations (x op y), see VM_TYPED_BINARY and
+// VM_TYPED_EQUALITY in vm.cpp
+#define REG_TYPED_BINARY(T, expr)                                       \
+  {                                                                     \
+    const T* x = get_if<T>(&RB);                                        \
+    const T* y = get_if<T>(&RC);                                        \
+    if (!x or !y)                                                       \
+      error("null reference", *frame);                                  \
+    RA = (expr);                                                        \
+  }
+#define REG_TYPED_EQUALITY(T, negate)                                   \
+  {                                                                     \
+    const T* x = get_if<T>(&RB);                                        \
+    const T* y = get_if<T>(&RC);                                        \
+    bool xy = (x and y) ? (*x == *y) : get<bool>(vm.eq(RB, RC));        \
+    RA = (negate) ? !xy : xy;                                           \
+  }
+
+// unboxed array operations, see VM_TYPED_ALLOCA, VM_TYPED_SETI, and
+// VM_TYPED_GETI in vm.cpp (arrays are created with null elements)
+#define REG_TYPED_ALLOCA(heap, T)                                       \
+  {                                                                     \
+    if (vm.heap_bytes >= vm.gc_threshold)                               \
+      vm.collect();                                                     \
+    REG_NOT_NULL(RB);                                                   \
+    int size = get<int>(RB);                                            \
+    auto& arr = vm.heap[vm.next_obj_id];                                \
+    arr.values.assign(size, T {});                                      \
+    arr.nulls.assign(size, true);                                       \
+    vm.heap_bytes += VM::object_bytes(size, sizeof(T));                 \
+    RA = vm.next_obj_id;                                                \
+    ++vm.next_obj_id;                                                   \
+  }
+#define REG_TYPED_SETI(heap, T, V)                                      \
+  {                                                                     \
+    REG_NOT_NULL(RA);                                                   \
+    REG_NOT_NULL(RB);                                                   \
+    REG_NOT_NULL(RC);                                                   \
+    int i = get<int>(RB);                                               \
+    auto& arr = vm.heap.at(get<int>(RA));                               \
+    if (i < 0 or i >= arr.values.size())                                \
+      error("out-of-bounds array index", *frame);                       \
+    arr.values[i] = static_cast<T>(get<V>(RC));                         \
+    arr.nulls[i] = false;                                               \
+  }
+#define REG_TYPED_GETI(heap, V)                                         \
+  {                                                                     \
+    REG_NOT_NULL(RB);                                                   \
+    REG_NOT_NULL(RC);                                                   \
+    int i = get<int>(RC);                                               \
+    auto& arr = vm.heap.at(get<int>(RB));                               \
+    if (i < 0 or i >= arr.values.size())                                \
+      error("out-of-bounds array index", *frame);                       \
+    if (arr.nulls[i])                                                   \
+      RA = nullptr;                                                     \
+    else                                                                \
+      RA = static_cast<V>(arr.values[i]);                               \
+  }
+
+
+template<bool COUNT>
+void RegVM::execute()
+{
+#ifdef REG_THREADED_DISPATCH
+  // handler table, one entry per opcode in the order of RegOp
+  static void* dispatch_table[] = {
+    &&L_MOV, &&L_LOADK,
+    &&L_ADD, &&L_SUB, &&L_MUL, &&L_DIV,
+    &&L_ADD_INT, &&L_SUB_INT, &&L_MUL_INT, &&L_DIV_INT,
+    &&L_ADD_DBL, &&L_SUB_DBL, &&L_MUL_DBL, &&L_DIV_DBL,
+    &&L_AND, &&L_OR, &&L_NOT,
+    &&L_CMPLT, &&L_CMPLE, &&L_CMPGT, &&L_CMPGE, &&L_CMPEQ, &&L_CMPNE,
+    &&L_CMPLT_INT, &&L_CMPLE_INT, &&L_CMPGT_INT, &&L_CMPGE_INT,
+    &&L_CMPEQ_INT, &&L_CMPNE_INT,
+    &&L_CMPLT_DBL, &&L_CMPLE_DBL, &&L_CMPGT_DBL, &&L_CMPGE_DBL,
+    &&L_CMPEQ_DBL, &&L_CMPNE_DBL,
+    &&L_JMP, &&L_JMPF, &&L_CALL, &&L_RET,
+    &&L_WRITE, &&L_READ, &&L_SLEN, &&L_ALEN, &&L_GETC,
+    &&L_TOINT, &&L_TODBL, &&L_TOSTR, &&L_CONCAT,
+    &&L_ALLOCS, &&L_ALLOCA, &&L_ALLOCA_INT, &&L_ALLOCA_DBL, &&L_ALLOCA_BOOL,
+    &&L_GETF, &&L_SETF,
+    &&L_GETI, &&L_GETI_INT, &&L_GETI_DBL, &&L_GETI_BOOL,
+    &&L_SETI, &&L_SETI_INT, &&L_SETI_DBL, &&L_SETI_BOOL
+  };
+  static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) ==
+                static_cast<int>(RegOp::SETI_BOOL) + 1,
+                "dispatch table out of sync with RegOp");
+#endif
+
+  RegFrame* frame = &frames.back();
+  const RegCode* code = frame->function->code.data();
+  // the current frame's registers (reset whenever the stack is resized)
+  VMValue* r = vm.stack.data() + frame->base;
+  const RegCode* instr = nullptr;
+
+  REG_DISPATCH_BEGIN()
+
+    //----------------------------------------------------------------------
+    // Moves
+    //----------------------------------------------------------------------
+
+    REG_CASE(MOV) {
+      RA = RB;
+      REG_NEXT();
+    }
+
+    REG_CASE(LOADK) {
+      RA = vm.constants[instr->b];
+      REG_NEXT();
+    }
+
+    //----------------------------------------------------------------------
+    // Operations
+    //----------------------------------------------------------------------
+
+    REG_CASE(ADD) {
+      REG_BINARY(add);
+      REG_NEXT();
+    }
+
+    REG_CASE(SUB) {
+      REG_BINARY(sub);
+      REG_NEXT();
+    }
+
+    REG_CASE(MUL) {
+      REG_BINARY(mul);
+      REG_NEXT();
+    }
+
+    REG_CASE(DIV) {
+      REG_BINARY(div);
+      REG_NEXT();
+    }
+
+    REG_CASE(ADD_INT) {
+      REG_TYPED_BINARY(int, *x + *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(SUB_INT) {
+      REG_TYPED_BINARY(int, *x - *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(MUL_INT) {
+      REG_TYPED_BINARY(int, *x * *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(DIV_INT) {
+      REG_TYPED_BINARY(int, *x / *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(ADD_DBL) {
+      REG_TYPED_BINARY(double, *x + *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(SUB_DBL) {
+      REG_TYPED_BINARY(double, *x - *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(MUL_DBL) {
+      REG_TYPED_BINARY(double, *x * *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(DIV_DBL) {
+      REG_TYPED_BINARY(double, *x / *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(AND) {
+      REG_NOT_NULL(RB);
+      REG_NOT_NULL(RC);
+      RA = get<bool>(RB) && get<bool>(RC);
+      REG_NEXT();
+    }
+
+    REG_CASE(OR) {
+      REG_NOT_NULL(RB);
+      REG_NOT_NULL(RC);
+      RA = get<bool>(RB) || get<bool>(RC);
+      REG_NEXT();
+    }
+
+    REG_CASE(NOT) {
+      REG_NOT_NULL(RB);
+      RA = !get<bool>(RB);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPLT) {
+      REG_BINARY(lt);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPLE) {
+      REG_BINARY(le);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPGT) {
+      REG_BINARY(gt);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPGE) {
+      REG_BINARY(ge);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPEQ) {
+      RA = vm.eq(RB, RC);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPNE) {
+      RA = !get<bool>(vm.eq(RB, RC));
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPLT_INT) {
+      REG_TYPED_BINARY(int, *x < *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPLE_INT) {
+      REG_TYPED_BINARY(int, *x <= *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPGT_INT) {
+      REG_TYPED_BINARY(int, *x > *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPGE_INT) {
+      REG_TYPED_BINARY(int, *x >= *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPEQ_INT) {
+      REG_TYPED_EQUALITY(int, false);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPNE_INT) {
+      REG_TYPED_EQUALITY(int, true);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPLT_DBL) {
+      REG_TYPED_BINARY(double, *x < *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPLE_DBL) {
+      REG_TYPED_BINARY(double, *x <= *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPGT_DBL) {
+      REG_TYPED_BINARY(double, *x > *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPGE_DBL) {
+      REG_TYPED_BINARY(double, *x >= *y);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPEQ_DBL) {
+      REG_TYPED_EQUALITY(double, false);
+      REG_NEXT();
+    }
+
+    REG_CASE(CMPNE_DBL) {
+      REG_TYPED_EQUALITY(double, true);
+      REG_NEXT();
+    }
+
+    //----------------------------------------------------------------------
+    // Branching and functions
+    //----------------------------------------------------------------------
+
+    REG_CASE(JMP) {
+      frame->pc = instr->a;
+      REG_NEXT();
+    }
+
+    REG_CASE(JMPF) {
+      REG_NOT_NULL(RA);
+      if (!get<bool>(RA))
+        frame->pc = instr->b;
+      REG_NEXT();
+    }
+
+    REG_CASE(CALL) {
+      // the callee's window starts at the argument registers (which
+      // become its parameters in place), overlapping the caller's
+      // temporaries
+      const RegFunction* function = &functions[instr->b];
+      int base = frame->base + instr->c;
+      frames.push_back(RegFrame {function, 0, base});
+      frame = &frames.back();
+      vm.stack.resize(base + function->reg_count, nullptr);
+      code = function->code.data();
+      r = vm.stack.data() + base;
+      REG_NEXT();
+    }
+
+    REG_CASE(RET) {
+      // the value goes to the destination of the caller's CALL
+      VMValue x = std::move(RA);
+      frames.pop_back();
+      if (frames.empty()) {
+        vm.stack.clear();
+        goto done;
+      }
+      frame = &frames.back();
+      code = frame->function->code.data();
+      vm.stack.resize(frame->base + frame->function->reg_count, nullptr);
+      r = vm.stack.data() + frame->base;
+      r[code[frame->pc - 1].a] = std::move(x);
+      REG_NEXT();
+    }
+
+    //----------------------------------------------------------------------
+    // Built in functions
+    //----------------------------------------------------------------------
+
+    REG_CASE(WRITE) {
+      vm.output.write(RA);
+      REG_NEXT();
+    }
+
+    REG_CASE(READ) {
+      // prompts are shown before waiting for input
+      vm.output.flush();
+      string val = "";
+      getline(cin, val);
+      RA = VMString(std::move(val));
+      REG_NEXT();
+    }
+
+    REG_CASE(SLEN) {
+      REG_NOT_NULL(RB);
+      RA = (int) get<VMString>(RB).size();
+      REG_NEXT();
+    }
+
+    REG_CASE(ALEN) {
+      REG_NOT_NULL(RB);
+      int x = get<int>(RB);
+      int length = 0;
+      if (vm.int_array_heap.contains(x))
+        length = vm.int_array_heap.at(x).values.size();
+      else if (vm.double_array_heap.contains(x))
+        length = vm.double_array_heap.at(x).values.size();
+      else if (vm.bool_array_heap.contains(x))
+        length = vm.bool_array_heap.at(x).values.size();
+      else
+        length = vm.array_heap.at(x).size();
+      RA = length;
+      REG_NEXT();
+    }
+
+    REG_CASE(GETC) {
+      REG_NOT_NULL(RB);
+      REG_NOT_NULL(RC);
+      int i = get<int>(RB);
+      string_view s = get<VMString>(RC).view();
+      if (i < 0 or i >= s.size())
+        error("out-of-bounds string index", *frame);
+      RA = s[i];
+      REG_NEXT();
+    }
+
+    REG_CASE(TOINT) {
+      REG_NOT_NULL(RB);
+      const VMValue& x = RB;
+      int value = 0;
+      if (holds_alternative<double>(x))
+        value = (int) get<double>(x);
+      else if (holds_alternative<bool>(x))
+        value = (int) get<bool>(x);
+      else if (holds_alternative<VMString>(x)) {
+        if (!parse_int(get<VMString>(x).view(), value))
+          error("cannot convert string to int", *frame);
+      }
+      else if (holds_alternative<char>(x)) {
+        if (!parse_int(string_view(&get<char>(x), 1), value))
+          error("cannot convert string to int", *frame);
+      }
+      else
+        value = get<int>(x);
+      RA = value;
+      REG_NEXT();
+    }
+
+    REG_CASE(TODBL) {
+      REG_NOT_NULL(RB);
+      const VMValue& x = RB;
+      double value = 0.0;
+      if (holds_alternative<int>(x))
+        value = (double) get<int>(x);
+      else if (holds_alternative<bool>(x))
+        value = (double) get<bool>(x);
+      else if (holds_alternative<VMString>(x)) {
+        if (!parse_double(get<VMString>(x).view(), value))
+          error("cannot convert string to double", *frame);
+      }
+      else if (holds_alternative<char>(x)) {
+        if (!parse_double(string_view(&get<char>(x), 1), value))
+          error("cannot convert string to double", *frame);
+      }
+      else
+        value = get<double>(x);
+      RA = value;
+      REG_NEXT();
+    }
+
+    REG_CASE(TOSTR) {
+      REG_NOT_NULL(RB);
+      if (holds_alternative<VMString>(RB))
+        RA = RB;
+      else
+        RA = VMString(to_string(RB));
+      REG_NEXT();
+    }
+
+    REG_CASE(CONCAT) {
+      // char operands are one-character strings
+      REG_NOT_NULL(RB);
+      REG_NOT_NULL(RC);
+      VMString x = holds_alternative<char>(RB) ?
+        VMString(to_string(RB)) : get<VMString>(RB);
+      VMString y = holds_alternative<char>(RC) ?
+        VMString(to_string(RC)) : get<VMString>(RC);
+      RA = VMString::concat(x, y);
+      REG_NEXT();
+    }
+
+    //----------------------------------------------------------------------
+    // Heap
+    //----------------------------------------------------------------------
+
+    REG_CASE(ALLOCS) {
+      if (vm.heap_bytes >= vm.gc_threshold)
+        vm.collect();
+      int field_count = vm.struct_info[instr->b].field_names.size();
+      VMStructObject& obj = vm.struct_heap[vm.next_obj_id];
+      obj.type = instr->b;
+      obj.fields.resize(field_count, nullptr);
+      vm.heap_bytes += VM::object_bytes(field_count);
+      RA = vm.next_obj_id;
+      ++vm.next_obj_id;
+      REG_NEXT();
+    }
+
+    REG_CASE(ALLOCA) {
+      if (vm.heap_bytes >= vm.gc_threshold)
+        vm.collect();
+      REG_NOT_NULL(RB);
+      int size = get<int>(RB);
+      vm.array_heap[vm.next_obj_id] = vector<VMValue>(size, nullptr);
+      vm.heap_bytes += VM::object_bytes(size);
+      RA = vm.next_obj_id;
+      ++vm.next_obj_id;
+      REG_NEXT();
+    }
+
+    REG_CASE(ALLOCA_INT) {
+      REG_TYPED_ALLOCA(int_array_heap, int32_t);
+      REG_NEXT();
+    }
+
+    REG_CASE(ALLOCA_DBL) {
+      REG_TYPED_ALLOCA(double_array_heap, double);
+      REG_NEXT();
+    }
+
+    REG_CASE(ALLOCA_BOOL) {
+      REG_TYPED_ALLOCA(bool_array_heap, uint8_t);
+      REG_NEXT();
+    }
+
+    REG_CASE(GETF) {
+      REG_NOT_NULL(RB);
+      RA = field(*frame, get<int>(RB), instr->c);
+      REG_NEXT();
+    }
+
+    REG_CASE(SETF) {
+      REG_NOT_NULL(RA);
+      field(*frame, get<int>(RA), instr->b) = RC;
+      REG_NEXT();
+    }
+
+    REG_CASE(GETI) {
+      REG_NOT_NULL(RB);
+      REG_NOT_NULL(RC);
+      int i = get<int>(RC);
+      vector<VMValue>& arr = vm.array_heap[get<int>(RB)];
+      if (i < 0 or i >= arr.size())
+        error("out-of-bounds array index", *frame);
+      RA = arr[i];
+      REG_NEXT();
+    }
+
+    REG_CASE(GETI_INT) {
+      REG_TYPED_GETI(int_array_heap, int);
+      REG_NEXT();
+    }
+
+    REG_CASE(GETI_DBL) {
+      REG_TYPED_GETI(double_array_heap, double);
+      REG_NEXT();
+    }
+
+    REG_CASE(GETI_BOOL) {
+      REG_TYPED_GETI(bool_array_heap, bool);
+      REG_NEXT();
+    }
+
+    REG_CASE(SETI) {
+      REG_NOT_NULL(RA);
+      REG_NOT_NULL(RB);
+      REG_NOT_NULL(RC);
+      int i = get<int>(RB);
+      vector<VMValue>& arr = vm.array_heap[get<int>(RA)];
+      if (i < 0 or i >= arr.size())
+        error("out-of-bounds array index", *frame);
+      arr[i] = RC;
+      REG_NEXT();
+    }
+
+    REG_CASE(SETI_INT) {
+      REG_TYPED_SETI(int_array_heap, int32_t, int);
+      REG_NEXT();
+    }
+
+    REG_CASE(SETI_DBL) {
+      REG_TYPED_SETI(double_array_heap, double, double);
+      REG_NEXT();
+    }
+
+    REG_CASE(SETI_BOOL) {
+      REG_TYPED_SETI(bool_array_heap, uint8_t, bool);
+      REG_NEXT();
+    }
+
+  REG_DISPATCH_END()
+
+ done:
+  return;
+}
@@ -0,0 +1,165 @@
+//----------------------------------------------------------------------
+// FILE: reg_vm.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Register-based alternative to the stack vm run loop
+//----------------------------------------------------------------------
+
+#ifndef REG_VM_H
+#define REG_VM_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "vm.h"
+
+
+// Register instruction opcodes. Instructions are three-address: a
+// destination register a and source registers (or operands) b and c,
+// e.g., ADD_INT a b c sets r[a] = r[b] + r[c].
+enum class RegOp : std::uint8_t {
+  MOV,          // r[a] = r[b]
+  LOADK,        // r[a] = constant b
+  ADD, SUB, MUL, DIV,                   // r[a] = r[b] op r[c]
+  ADD_INT, SUB_INT, MUL_INT, DIV_INT,
+  ADD_DBL, SUB_DBL, MUL_DBL, DIV_DBL,
+  AND, OR,                              // r[a] = r[b] op r[c]
+  NOT,                                  // r[a] = not r[b]
+  CMPLT, CMPLE, CMPGT, CMPGE, CMPEQ, CMPNE,
+  CMPLT_INT, CMPLE_INT, CMPGT_INT, CMPGE_INT, CMPEQ_INT, CMPNE_INT,
+  CMPLT_DBL, CMPLE_DBL, CMPGT_DBL, CMPGE_DBL, CMPEQ_DBL, CMPNE_DBL,
+  JMP,          // jump to instruction a
+  JMPF,         // jump to instruction b if r[a] is false
+  CALL,         // r[a] = function b called with args r[c], r[c+1], ...
+  RET,          // return r[a]
+  WRITE,        // print r[a]
+  READ,         // r[a] = line of input
+  SLEN,         // r[a] = length of string r[b]
+  ALEN,         // r[a] = length of array r[b]
+  GETC,         // r[a] = char r[b] of string r[c]
+  TOINT, TODBL, TOSTR,                  // r[a] = conversion of r[b]
+  CONCAT,       // r[a] = r[b] + r[c] (strings)
+  ALLOCS,       // r[a] = new object of struct b
+  ALLOCA,       // r[a] = new array of r[b] nulls
+  ALLOCA_INT, ALLOCA_DBL, ALLOCA_BOOL,
+  GETF,         // r[a] = field c of object r[b]
+  SETF,         // field b of object r[a] = r[c]
+  GETI,         // r[a] = element r[c] of array r[b]
+  GETI_INT, GETI_DBL, GETI_BOOL,
+  SETI,         // element r[b] of array r[a] = r[c]
+  SETI_INT, SETI_DBL, SETI_BOOL
+};
+
+// function to get the name of a register opcode
+std::string to_string(RegOp op);
+
+
+// A register instruction (plain-old-data)
+struct RegCode
+{
+  RegOp op = RegOp::MOV;
+  std::int32_t a = 0;
+  std::int32_t b = 0;
+  std::int32_t c = 0;
+};
+
+
+// A function's register code. The registers of a call are a window
+// of the vm's value stack: the parameters first, then the rest of the
+// locals, then temporaries.
+class RegFunction
+{
+public:
+
+  // the name of the function
+  std::string function_name;
+
+  // the number of parameters (passed in the first registers)
+  int arg_count = 0;
+
+  // the number of registers the code uses
+  int reg_count = 0;
+
+  // the program instructions
+  std::vector<RegCode> code;
+
+};
+
+
+// A register function call
+class RegFrame
+{
+public:
+
+  // the function being run
+  const RegFunction* function = nullptr;
+
+  // the program counter
+  int pc = 0;
+
+  // index in the vm value stack of the frame's first register
+  int base = 0;
+
+};
+
+
+// Runs register code over the state of a stack vm: its value stack
+// holds the registers (so registers are garbage collection roots), and
+// its heaps, struct types, constant pool, and output are shared.
+class RegVM
+{
+public:
+
+  RegVM(VM& vm);
+
+  // add a function, returning its index (for calls)
+  int add(const RegFunction& function);
+
+  // add a struct type to the vm, returning its index (for ALLOCS)
+  int add(const VMStructInfo& type);
+
+  // add a value to the vm's constant pool, returning its index
+  int constant(const VMValue& value);
+
+  // count the instructions run (see instruction_count)
+  void enable_count();
+
+  // run the program (from its "main" function)
+  void run();
+
+  // number of instructions run (if counting was enabled)
+  long instruction_count() const;
+
+  // to print the instructions of each function
+  friend std::string to_string(const RegVM& vm);
+
+private:
+
+  VM& vm;
+
+  // functions by index
+  std::vector<RegFunction> functions;
+
+  // function call stack (current frame last)
+  std::vector<RegFrame> frames;
+
+  bool counting = false;
+  long count = 0;
+
+  // the run loop (counting instructions if COUNT)
+  template<bool COUNT> void execute();
+
+  // helper function to report errors of the frame's current
+  // instruction (throws mypl exception)
+  void error(std::string msg, const RegFrame& frame) const;
+
+  // helper function to get a field of a struct object (throws mypl
+  // exception if there is no such object or field, see VM::field)
+  VMValue& field(const RegFrame& frame, int oid, int slot);
+
+  // helper function to pretty print an instruction of a function
+  std::string instr_string(const RegFunction& function, int pc) const;
+
+};
+
+#endif
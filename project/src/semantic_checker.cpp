@@ -274,13 +274,16 @@ void SemanticChecker::visit(AssignStmt& s)
         ref1.array_expr->accept(*this);
         if(curr_type.type_name != "int")
             error("array expression not int");
+        // an indexed array is its element
+        final_type.is_array = false;
     }
+    s.lvalue[0].type = final_type;
 
     // go through the rest of the values to evaluate
     for(int i = 1; i < s.lvalue.size(); ++i) {
         VarRef varRef = s.lvalue[i];
-        StructDef s = struct_defs[final_type.type_name];
-        std::optional<VarDef> opt_field = get_field(s, varRef.var_name.lexeme());
+        StructDef& struct_def = struct_defs[final_type.type_name];
+        std::optional<VarDef> opt_field = get_field(struct_def, varRef.var_name.lexeme());
         if(opt_field.has_value()) {
             VarDef field = opt_field.value();
             final_type = field.data_type;
@@ -293,6 +296,7 @@ void SemanticChecker::visit(AssignStmt& s)
             if(curr_type.type_name != "int")
                 error("array expression not int");
         }
+        s.lvalue[i].type = final_type;
     }
     DataType type = final_type;
     string type_name = type.type_name;
@@ -463,18 +467,22 @@ void SemanticChecker::visit(Expr& e)
         if(curr_type.type_name != "bool")
             error("value not compatible with operator");
 
+    // record the type for code generation
+    e.type = curr_type;
 }
 
 
 void SemanticChecker::visit(SimpleTerm& t)
 {
     t.rvalue->accept(*this);
+    t.type = curr_type;
 } 
 
 
 void SemanticChecker::visit(ComplexTerm& t)
 {
     t.expr.accept(*this);
+    t.type = curr_type;
 }
 
 
@@ -516,7 +524,10 @@ void SemanticChecker::visit(VarRValue& v)
         ref1.array_expr->accept(*this);
         if(curr_type.type_name != "int")
             error("array expression not int");
+        // an indexed array is its element
+        final_type.is_array = false;
     }
+    v.path[0].type = final_type;
 
     // go through all paths
     for(int i = 1; i < v.path.size(); ++i) {
@@ -536,6 +547,7 @@ void SemanticChecker::visit(VarRValue& v)
             if(curr_type.type_name != "int")
                 error("array expression not int");
         }
+        v.path[i].type = final_type;
     }
     curr_type = final_type;
 }    
@@ -32,6 +32,9 @@ public:
   // return index for most recent name (or -1 if the name doesn't exist)
   int get(const std::string& name) const;
 
+  // number of variables in all environments (the next variable's index)
+  int size() const;
+
   // pretty print the table for debugging
   friend std::string to_string(const VarTable& var_table);
 
@@ -5,9 +5,12 @@
 // DESC: 
 //----------------------------------------------------------------------
 
+#include <bit>
+#include <chrono>
 #include <iostream>
 #include "vm.h"
 #include "mypl_exception.h"
+#include "vm_jit.h"
 
 
 using namespace std;
@@ -15,17 +18,19 @@ using namespace std;
 
 void VM::error(string msg) const
 {
+  // program output comes before the error message
+  output.flush();
   throw MyPLException::VMError(msg);
 }
 
 
 void VM::error(string msg, const VMFrame& frame) const
 {
+  output.flush();
   int pc = frame.pc - 1;
-  VMInstr instr = frame.info.instructions[pc];
-  string name = frame.info.function_name;
+  string name = frame.info->function_name;
   msg += " (in " + name + " at " + to_string(pc) + ": " +
-    to_string(instr) + ")";
+    instr_string(*frame.info, pc) + ")";
   throw MyPLException::VMError(msg);
 }
 
@@ -33,363 +38,1185 @@ void VM::error(string msg, const VMFrame& frame) const
 string to_string(const VM& vm)
 {
   string s = "";
-  for (const auto& entry : vm.frame_info) {
-    const string& name = entry.first;
-    s += "\nFrame '" + name + "'\n";
-    const VMFrameInfo& frame = entry.second;
-    for (int i = 0; i < frame.instructions.size(); ++i) {
-      VMInstr instr = frame.instructions[i];
-      s += "  " + to_string(i) + ": " + to_string(instr) + "\n"; 
+  for (int f = 0; f < vm.frame_info.size(); ++f) {
+    const VMFrameInfo& frame = vm.frame_info[f];
+    s += "\nFrame '" + frame.function_name + "' (" + to_string(f) + ")\n";
+    if (vm.linked) {
+      for (int i = 0; i < frame.code.size(); ++i)
+        s += "  " + to_string(i) + ": " + vm.instr_string(frame, i) + "\n";
+    }
+    else {
+      for (int i = 0; i < frame.instructions.size(); ++i) {
+        VMInstr instr = frame.instructions[i];
+        s += "  " + to_string(i) + ": " + to_string(instr) + "\n"; 
+      }
     }
   }
   return s;
 }
 
 
+VM::VM()
+{
+  stack.reserve(STACK_RESERVE);
+  frames.reserve(FRAME_RESERVE);
+}
+
+
+VM::~VM()
+{
+}
+
+
+void VM::enable_profile()
+{
+  profiler = make_unique<VMProfiler>(frame_info);
+}
+
+
+VMProfile VM::profile() const
+{
+  return profiler ? profiler->profile() : VMProfile();
+}
+
+
+void VM::enable_trace(const string& filename)
+{
+  tracer = make_unique<VMTracer>(frame_info, filename);
+}
+
+
+void VM::enable_count()
+{
+  counter = make_unique<VMCounter>();
+}
+
+
+long VM::instruction_count() const
+{
+  return counter ? counter->instructions : 0;
+}
+
+
+bool VM::enable_jit()
+{
+  if (!VMJit::supported())
+    return false;
+  jit = make_unique<VMJit>(*this);
+  return true;
+}
+
+
 void VM::add(const VMFrameInfo& frame)
 {
-  frame_info[frame.function_name] = frame;
+  if (frame_index.contains(frame.function_name))
+    frame_info[frame_index[frame.function_name]] = frame;
+  else {
+    frame_index[frame.function_name] = frame_info.size();
+    frame_info.push_back(frame);
+  }
+  linked = false;
+}
+
+
+void VM::add(const VMStructInfo& type)
+{
+  if (struct_index.contains(type.struct_name))
+    struct_info[struct_index[type.struct_name]] = type;
+  else {
+    struct_index[type.struct_name] = struct_info.size();
+    struct_info.push_back(type);
+  }
+  linked = false;
+}
+
+
+void VM::link()
+{
+  for (VMFrameInfo& frame : frame_info) {
+    // size the frame's locals from the variable indexes it uses
+    frame.local_count = frame.arg_count;
+    for (VMInstr& instr : frame.instructions) {
+      OpCode op = instr.opcode();
+      if (op == OpCode::LOAD or op == OpCode::STORE) {
+        int index = get<int>(instr.operand().value());
+        frame.local_count = max(frame.local_count, index + 1);
+      }
+    }
+    // resolve calls
+    for (VMInstr& instr : frame.instructions) {
+      if (instr.opcode() != OpCode::CALL)
+        continue;
+      VMValue target = instr.operand().value();
+      if (!holds_alternative<VMString>(target))
+        continue;
+      string name = get<VMString>(target).str();
+      if (!frame_index.contains(name))
+        error("call to undefined function '" + name + "' in " +
+              frame.function_name);
+      instr.set_operand(frame_index[name]);
+    }
+    // resolve struct allocations
+    for (VMInstr& instr : frame.instructions) {
+      if (instr.opcode() != OpCode::ALLOCS)
+        continue;
+      VMValue target = instr.operand().value();
+      if (!holds_alternative<VMString>(target))
+        continue;
+      string name = get<VMString>(target).str();
+      if (!struct_index.contains(name))
+        error("allocation of undefined struct '" + name + "' in " +
+              frame.function_name);
+      instr.set_operand(struct_index[name]);
+    }
+    // pack the instructions
+    frame.code.clear();
+    frame.comments.clear();
+    for (const VMInstr& instr : frame.instructions) {
+      VMCode code {instr.opcode(), 0};
+      OperandKind kind = operand_kind(instr.opcode());
+      if (kind == OperandKind::IMMEDIATE)
+        code.arg = get<int>(instr.operand().value());
+      else if (kind == OperandKind::CONSTANT)
+        code.arg = add_constant(instr.operand().value());
+      if (instr.comment() != "")
+        frame.comments[frame.code.size()] = instr.comment();
+      frame.code.push_back(code);
+    }
+    frame.instructions.clear();
+    frame.instructions.shrink_to_fit();
+  }
+  linked = true;
+}
+
+
+void VM::set_fusion(bool enabled)
+{
+  fusion = enabled;
+}
+
+
+void VM::fuse(VMFrameInfo& frame)
+{
+  vector<VMCode>& code = frame.code;
+  // the opcode of instruction i (NOP past the end)
+  auto op = [&](int i) {
+    return i < code.size() ? code[i].opcode : OpCode::NOP;
+  };
+  // true if instruction i pushes an int constant
+  auto push_int = [&](int i) {
+    return op(i) == OpCode::PUSH and
+      holds_alternative<int>(constants[code[i].arg]);
+  };
+  for (int i = 0; i < code.size(); ++i) {
+    if (code[i].opcode != OpCode::LOAD)
+      continue;
+    int local = code[i].arg;
+    OpCode next = op(i + 2);
+    if (push_int(i + 1) and next == OpCode::ADD_INT and
+        op(i + 3) == OpCode::STORE and code[i + 3].arg == local)
+      code[i].opcode = OpCode::INC_LOCAL;
+    else if (push_int(i + 1) and op(i + 3) == OpCode::JMPF and
+             next == OpCode::CMPLT_INT)
+      code[i].opcode = OpCode::JMP_IF_LOCAL_GE_CONST;
+    else if (push_int(i + 1) and op(i + 3) == OpCode::JMPF and
+             next == OpCode::CMPLE_INT)
+      code[i].opcode = OpCode::JMP_IF_LOCAL_GT_CONST;
+    else if (push_int(i + 1) and op(i + 3) == OpCode::JMPF and
+             next == OpCode::CMPGT_INT)
+      code[i].opcode = OpCode::JMP_IF_LOCAL_LE_CONST;
+    else if (push_int(i + 1) and op(i + 3) == OpCode::JMPF and
+             next == OpCode::CMPGE_INT)
+      code[i].opcode = OpCode::JMP_IF_LOCAL_LT_CONST;
+    else if (push_int(i + 1) and next == OpCode::ADD_INT)
+      code[i].opcode = OpCode::LOAD_ADD_CONST;
+    else if (push_int(i + 1) and next == OpCode::SUB_INT)
+      code[i].opcode = OpCode::LOAD_SUB_CONST;
+    else if (op(i + 1) == OpCode::GETF)
+      code[i].opcode = OpCode::LOAD_GETF;
+  }
+}
+
+
+bool VM::SameConstant::operator()(const VMValue& x, const VMValue& y) const
+{
+  const double* a = get_if<double>(&x);
+  const double* b = get_if<double>(&y);
+  if (a and b)
+    return bit_cast<uint64_t>(*a) == bit_cast<uint64_t>(*b);
+  return x == y;
+}
+
+
+int VM::add_constant(const VMValue& value)
+{
+  auto entry = constant_index.find(value);
+  if (entry != constant_index.end())
+    return entry->second;
+  int index = constants.size();
+  constants.push_back(value);
+  // every push of a literal shares its buffer
+  if (VMString* literal = get_if<VMString>(&constants.back()))
+    literal->freeze();
+  constant_index[value] = index;
+  return index;
+}
+
+
+string VM::instr_string(const VMFrameInfo& frame, int pc) const
+{
+  const VMCode& code = frame.code[pc];
+  string vstr = "";
+  OperandKind kind = operand_kind(code.opcode);
+  if (kind == OperandKind::IMMEDIATE)
+    vstr = to_string(code.arg);
+  else if (kind == OperandKind::CONSTANT)
+    vstr = to_string(constants[code.arg]);
+  string s = to_string(code.opcode) + "(" + vstr + ")";
+  auto comment = frame.comments.find(pc);
+  if (comment != frame.comments.end())
+    s += "  // " + comment->second;
+  return s;
+}
+
+
+//----------------------------------------------------------------------
+// Dispatch
+//----------------------------------------------------------------------
+
+// The run loop is written once as a sequence of opcode handlers. When
+// MYPL_COMPUTED_GOTO is defined (see CMakeLists.txt) and the compiler
+// supports labels-as-values, the handlers form a label table and each
+// handler jumps straight to the next one (direct threading). Otherwise
+// the same handlers become the cases of a dense switch.
+
+#if defined(MYPL_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#define VM_THREADED_DISPATCH
+#endif
+
+// fetch the next instruction (leaving the loop when there is none)
+#define VM_FETCH()                                                      \
+  if (frames.empty() or frame->pc >= frame->info->code.size())          \
+    goto done;                                                          \
+  instr = &frame->info->code[frame->pc];                                \
+  ++frame->pc;                                                          \
+  hooks.instruction(*frame, *instr, stack, frames.size());
+
+// In single-step mode (STEP) a handler returns instead of continuing
+// with the next instruction.
+#ifdef VM_THREADED_DISPATCH
+#define VM_DISPATCH_BEGIN()                                             \
+  VM_FETCH();                                                           \
+  goto *dispatch_table[static_cast<int>(instr->opcode)];
+#define VM_CASE(op) L_##op:
+#define VM_NEXT()                                                       \
+  do {                                                                  \
+    if constexpr (STEP)                                                 \
+      return;                                                           \
+    VM_FETCH();                                                         \
+    goto *dispatch_table[static_cast<int>(instr->opcode)];             \
+  } while (false)
+#define VM_DISPATCH_END()
+#else
+#define VM_DISPATCH_BEGIN()                                             \
+  while (true) {                                                        \
+    VM_FETCH();                                                         \
+    switch (instr->opcode) {
+#define VM_CASE(op) case OpCode::op:
+#define VM_NEXT()                                                       \
+  if constexpr (STEP)                                                   \
+    return;                                                             \
+  else                                                                  \
+    continue
+#define VM_DISPATCH_END()                                               \
+    }                                                                   \
+    error("unsupported operation " + to_string(instr->opcode));         \
+  }
+#endif
+
+// run the current frame's function natively (from its pc) if it has
+// been compiled, resuming interpretation at the call or return that
+// ended the native run (never done in single-step mode, which only
+// serves the native code itself)
+#define VM_JIT_ENTER(function)                                          \
+  if constexpr (!STEP) {                                                \
+    frame->pc = jit->enter(function, frame->pc);                        \
+  }
+
+
+// typed binary operations on the top two stack values (y op x). The
+// operands are checked and combined in place (without copying them
+// off the stack). A null operand is an error for arithmetic and
+// ordering, and falls back to the generic comparison for equality.
+#define VM_TYPED_BINARY(T, expr)                                        \
+  {                                                                     \
+    const T* x = get_if<T>(&stack.back());                              \
+    const T* y = get_if<T>(&stack[stack.size() - 2]);                   \
+    if (!x or !y)                                                       \
+      error("null reference", *frame);                                  \
+    VMValue result = (expr);                                            \
+    stack.pop_back();                                                   \
+    stack.back() = std::move(result);                                   \
+  }
+#define VM_TYPED_EQUALITY(T, negate)                                    \
+  {                                                                     \
+    const T* x = get_if<T>(&stack.back());                              \
+    const T* y = get_if<T>(&stack[stack.size() - 2]);                   \
+    bool xy = (x and y) ? (*y == *x) :                                  \
+      get<bool>(eq(stack[stack.size() - 2], stack.back()));             \
+    stack.pop_back();                                                   \
+    stack.back() = (negate) ? !xy : xy;                                 \
+  }
+
+// unboxed array operations on a heap of VMTypedArray<T> objects, whose
+// elements are pushed and popped as vm values of type V (an element's
+// null bit stands for a null vm value)
+#define VM_TYPED_ALLOCA(heap, T, V)                                     \
+  {                                                                     \
+    if (heap_bytes >= gc_threshold)                                     \
+      collect();                                                        \
+    const V* init = get_if<V>(&stack.back());                           \
+    T value = init ? static_cast<T>(*init) : T {};                      \
+    stack.pop_back();                                                   \
+    int size = get<int>(stack.back());                                  \
+    auto& arr = heap[next_obj_id];                                      \
+    arr.values.assign(size, value);                                     \
+    arr.nulls.assign(size, !init);                                      \
+    heap_bytes += object_bytes(size, sizeof(T));                        \
+    stack.back() = next_obj_id;                                         \
+    ++next_obj_id;                                                      \
+  }
+#define VM_TYPED_SETI(heap, T, V)                                       \
+  {                                                                     \
+    const VMValue& vmx = stack.back();                                  \
+    const VMValue& vmy = stack[stack.size() - 2];                       \
+    const VMValue& vmz = stack[stack.size() - 3];                       \
+    ensure_not_null(*frame, vmx);                                       \
+    ensure_not_null(*frame, vmy);                                       \
+    ensure_not_null(*frame, vmz);                                       \
+    int y = get<int>(vmy);                                              \
+    auto& arr = heap.at(get<int>(vmz));                                 \
+    if (y < 0 or y >= arr.values.size())                                \
+      error("out-of-bounds array index", *frame);                       \
+    arr.values[y] = static_cast<T>(get<V>(vmx));                        \
+    arr.nulls[y] = false;                                               \
+    stack.resize(stack.size() - 3);                                     \
+  }
+#define VM_TYPED_GETI(heap, V)                                          \
+  {                                                                     \
+    const VMValue& vmx = stack.back();                                  \
+    const VMValue& vmy = stack[stack.size() - 2];                       \
+    ensure_not_null(*frame, vmx);                                       \
+    ensure_not_null(*frame, vmy);                                       \
+    int x = get<int>(vmx);                                              \
+    auto& arr = heap.at(get<int>(vmy));                                 \
+    if (x < 0 or x >= arr.values.size())                                \
+      error("out-of-bounds array index", *frame);                       \
+    stack.pop_back();                                                   \
+    if (arr.nulls[x])                                                   \
+      stack.back() = nullptr;                                           \
+    else                                                                \
+      stack.back() = static_cast<V>(arr.values[x]);                     \
+  }
+
+
+// superinstructions on an int local and the int constant pushed by
+// the next instruction: push local op constant (skipping the PUSH and
+// the operation), or branch on the comparison (skipping to the JMPF's
+// target or past it). A local that is not an int is just loaded.
+#define VM_FUSED_ARITHMETIC(op)                                         \
+  {                                                                     \
+    const VMValue& x = stack[frame->base + instr->arg];                 \
+    if (const int* value = get_if<int>(&x)) {                           \
+      stack.push_back(*value op get<int>(constants[instr[1].arg]));     \
+      frame->pc += 2;                                                   \
+    }                                                                   \
+    else                                                                \
+      stack.push_back(x);                                               \
+  }
+#define VM_FUSED_BRANCH(op)                                             \
+  {                                                                     \
+    const VMValue& x = stack[frame->base + instr->arg];                 \
+    if (const int* value = get_if<int>(&x)) {                           \
+      if (*value op get<int>(constants[instr[1].arg]))                  \
+        frame->pc += 3;                                                 \
+      else                                                              \
+        frame->pc = instr[3].arg;                                       \
+    }                                                                   \
+    else                                                                \
+      stack.push_back(x);                                               \
+  }
+
+
+class VM::DebugHooks : public VMNoHooks
+{
+public:
+  DebugHooks(const VM& vm) : vm(vm) {}
+  void instruction(const VMFrame& frame, const VMCode& instr,
+                   const vector<VMValue>& stack, int depth)
+  {
+    vm.debug_trace(frame);
+  }
+private:
+  const VM& vm;
+};
+
+
+void VM::debug_trace(const VMFrame& frame) const
+{
+  output.flush();
+  cerr << endl << endl;
+  cerr << "\t FRAME.........: " << frame.info->function_name << endl;
+  cerr << "\t PC............: " << (frame.pc - 1) << endl;
+  cerr << "\t INSTR.........: " << instr_string(*frame.info, frame.pc - 1)
+       << endl;
+  cerr << "\t NEXT OPERAND..: ";
+  if (stack.size() > frame.base + frame.info->local_count)
+    cerr << to_string(stack.back()) << endl;
+  else
+    cerr << "empty" << endl;
+  cerr << "\t NEXT FUNCTION.: ";
+  if (!frames.empty())
+    cerr << frames.back().info->function_name << endl;
+  else
+    cerr << "empty" << endl;
 }
 
 
 void VM::run(bool DEBUG)
 {
+  // resolve function calls (if not already done)
+  if (!linked)
+    link();
+
   // grab the "main" frame if it exists
-  if (!frame_info.contains("main"))
+  if (!frame_index.contains("main"))
     error("No 'main' function");
-  shared_ptr<VMFrame> frame = make_shared<VMFrame>();
-  frame->info = frame_info["main"];
-  call_stack.push(frame);
+  if (fusion and !fused) {
+    for (VMFrameInfo& frame : frame_info)
+      fuse(frame);
+    fused = true;
+  }
+  const VMFrameInfo* main_info = &frame_info[frame_index["main"]];
+  frames.push_back(VMFrame {main_info, 0, 0});
+  stack.resize(main_info->local_count, nullptr);
+
+  // native code is not used when debugging, profiling, tracing, or
+  // counting
+  if (DEBUG or profiler or tracer or counter)
+    jit.reset();
+
+  // the run loop is compiled separately for each kind of hooks
+  int main_index = frame_index["main"];
+  if (DEBUG) {
+    DebugHooks hooks {*this};
+    start(main_index, hooks);
+  }
+  else if (profiler)
+    start(main_index, *profiler);
+  else if (tracer)
+    start(main_index, *tracer);
+  else if (counter)
+    start(main_index, *counter);
+  else {
+    VMNoHooks hooks;
+    start(main_index, hooks);
+  }
+  output.flush();
+}
+
+
+template<typename Hooks>
+void VM::start(int function, Hooks& hooks)
+{
+  hooks.call(function);
+  try {
+    execute<false>(hooks);
+  }
+  catch (...) {
+    hooks.finish();
+    throw;
+  }
+  hooks.finish();
+}
+
+
+void VM::step()
+{
+  VMNoHooks hooks;
+  execute<true>(hooks);
+}
+
+
+template<bool STEP, typename Hooks>
+void VM::execute(Hooks& hooks)
+{
+#ifdef VM_THREADED_DISPATCH
+  // handler table, one entry per opcode in the order of op_code.h
+  static void* dispatch_table[] = {
+    &&L_PUSH, &&L_POP, &&L_LOAD, &&L_STORE,
+    &&L_ADD, &&L_SUB, &&L_MUL, &&L_DIV,
+    &&L_AND, &&L_OR, &&L_NOT,
+    &&L_CMPLT, &&L_CMPLE, &&L_CMPGT, &&L_CMPGE, &&L_CMPEQ, &&L_CMPNE,
+    &&L_ADD_INT, &&L_ADD_DBL, &&L_SUB_INT, &&L_SUB_DBL,
+    &&L_MUL_INT, &&L_MUL_DBL, &&L_DIV_INT, &&L_DIV_DBL,
+    &&L_CMPLT_INT, &&L_CMPLT_DBL, &&L_CMPLT_STR,
+    &&L_CMPLE_INT, &&L_CMPLE_DBL, &&L_CMPLE_STR,
+    &&L_CMPGT_INT, &&L_CMPGT_DBL, &&L_CMPGT_STR,
+    &&L_CMPGE_INT, &&L_CMPGE_DBL, &&L_CMPGE_STR,
+    &&L_CMPEQ_INT, &&L_CMPEQ_DBL, &&L_CMPEQ_STR,
+    &&L_CMPNE_INT, &&L_CMPNE_DBL, &&L_CMPNE_STR,
+    &&L_CMPLT_CHR, &&L_CMPLE_CHR, &&L_CMPGT_CHR, &&L_CMPGE_CHR,
+    &&L_CMPEQ_CHR, &&L_CMPNE_CHR,
+    &&L_JMP, &&L_JMPF,
+    &&L_CALL, &&L_RET,
+    &&L_WRITE, &&L_READ, &&L_SLEN, &&L_ALEN, &&L_GETC,
+    &&L_TOINT, &&L_TODBL, &&L_TOSTR, &&L_CONCAT,
+    &&L_ALLOCS, &&L_ALLOCA, &&L_ADDF, &&L_SETF, &&L_GETF, &&L_SETI, &&L_GETI,
+    &&L_ALLOCA_INT, &&L_ALLOCA_DBL, &&L_ALLOCA_BOOL,
+    &&L_SETI_INT, &&L_SETI_DBL, &&L_SETI_BOOL,
+    &&L_GETI_INT, &&L_GETI_DBL, &&L_GETI_BOOL,
+    &&L_INC_LOCAL, &&L_LOAD_ADD_CONST, &&L_LOAD_SUB_CONST, &&L_LOAD_GETF,
+    &&L_JMP_IF_LOCAL_GE_CONST, &&L_JMP_IF_LOCAL_GT_CONST,
+    &&L_JMP_IF_LOCAL_LE_CONST, &&L_JMP_IF_LOCAL_LT_CONST,
+    &&L_DUP, &&L_NOP
+  };
+  static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) ==
+                static_cast<int>(OpCode::NOP) + 1,
+                "dispatch table out of sync with OpCode");
+#endif
+
+  VMFrame* frame = &frames.back();
+
+  // the instruction currently being executed
+  const VMCode* instr = nullptr;
 
   // run loop (keep going until we run out of instructions)
-  while (!call_stack.empty() and frame->pc < frame->info.instructions.size()) {
-
-    // get the next instruction
-    VMInstr& instr = frame->info.instructions[frame->pc];
-
-    // increment the program counter
-    ++frame->pc;
-
-    // for debugging
-    if (DEBUG) {
-      cerr << endl << endl;
-      cerr << "\t FRAME.........: " << frame->info.function_name << endl;
-      cerr << "\t PC............: " << (frame->pc - 1) << endl;
-      cerr << "\t INSTR.........: " << to_string(instr) << endl;
-      cerr << "\t NEXT OPERAND..: ";
-      if (!frame->operand_stack.empty())
-        cerr << to_string(frame->operand_stack.top()) << endl;
-      else
-        cerr << "empty" << endl;
-      cerr << "\t NEXT FUNCTION.: ";
-      if (!call_stack.empty())
-        cerr << call_stack.top()->info.function_name << endl;
-      else
-        cerr << "empty" << endl;
-    }
+  VM_DISPATCH_BEGIN()
 
     //----------------------------------------------------------------------
     // Literals and Variables
     //----------------------------------------------------------------------
 
-    if (instr.opcode() == OpCode::PUSH) {
-      frame->operand_stack.push(instr.operand().value());
+    VM_CASE(PUSH) {
+      stack.push_back(constants[instr->arg]);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::POP) {
-      frame->operand_stack.pop();
+    VM_CASE(POP) {
+      stack.pop_back();
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::LOAD) {
-       int x = get<int>(instr.operand().value());
-       VMValue y = frame->variables.at(x);
-        frame->operand_stack.push(y);
+    VM_CASE(LOAD) {
+      int x = instr->arg;
+      stack.push_back(stack[frame->base + x]);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::STORE) {
-        VMValue x = frame->operand_stack.top();
-        frame->operand_stack.pop();
-        int index = get<int>(instr.operand().value());
-        if(index >= frame->variables.size())
-            frame->variables.push_back(x);
-        else
-            frame->variables[index] = x;
+    VM_CASE(STORE) {
+      int index = instr->arg;
+      stack[frame->base + index] = std::move(stack.back());
+      stack.pop_back();
+      VM_NEXT();
     }
     
     //----------------------------------------------------------------------
     // Operations
     //----------------------------------------------------------------------
 
-    else if (instr.opcode() == OpCode::ADD) {
-      VMValue x = frame->operand_stack.top();
+    VM_CASE(ADD) {
+      VMValue x = stack.back();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
+      stack.pop_back();
+      VMValue y = stack.back();
       ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(add(y, x));
+      stack.pop_back();
+      stack.push_back(add(y, x));
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::SUB) {
-        VMValue x = frame->operand_stack.top();
+    VM_CASE(SUB) {
+        VMValue x = stack.back();
         ensure_not_null(*frame, x);
-        frame->operand_stack.pop();
-        VMValue y = frame->operand_stack.top();
+        stack.pop_back();
+        VMValue y = stack.back();
         ensure_not_null(*frame, y);
-        frame->operand_stack.pop();
-        frame->operand_stack.push(sub(y, x));
+        stack.pop_back();
+        stack.push_back(sub(y, x));
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::MUL) {
-        VMValue x = frame->operand_stack.top();
+    VM_CASE(MUL) {
+        VMValue x = stack.back();
         ensure_not_null(*frame, x);
-        frame->operand_stack.pop();
-        VMValue y = frame->operand_stack.top();
+        stack.pop_back();
+        VMValue y = stack.back();
         ensure_not_null(*frame, y);
-        frame->operand_stack.pop();
-        frame->operand_stack.push(mul(y, x));
+        stack.pop_back();
+        stack.push_back(mul(y, x));
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::DIV) {
-        VMValue x = frame->operand_stack.top();
+    VM_CASE(DIV) {
+        VMValue x = stack.back();
         ensure_not_null(*frame, x);
-        frame->operand_stack.pop();
-        VMValue y = frame->operand_stack.top();
+        stack.pop_back();
+        VMValue y = stack.back();
         ensure_not_null(*frame, y);
-        frame->operand_stack.pop();
-        frame->operand_stack.push(div(y, x));
+        stack.pop_back();
+        stack.push_back(div(y, x));
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::AND) {
-        VMValue x = frame->operand_stack.top();
+    VM_CASE(AND) {
+        VMValue x = stack.back();
         ensure_not_null(*frame, x);
-        frame->operand_stack.pop();
+        stack.pop_back();
         bool bx = get<bool>(x);
-        VMValue y = frame->operand_stack.top();
+        VMValue y = stack.back();
         ensure_not_null(*frame, y);
-        frame->operand_stack.pop();
+        stack.pop_back();
         bool by = get<bool>(y);
         VMValue result = bx && by;
-        frame->operand_stack.push(result);
+        stack.push_back(result);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::OR) {
-        VMValue x = frame->operand_stack.top();
+    VM_CASE(OR) {
+        VMValue x = stack.back();
         ensure_not_null(*frame, x);
-        frame->operand_stack.pop();
+        stack.pop_back();
         bool bx = get<bool>(x);
-        VMValue y = frame->operand_stack.top();
+        VMValue y = stack.back();
         ensure_not_null(*frame, y);
-        frame->operand_stack.pop();
+        stack.pop_back();
         bool by = get<bool>(y);
         VMValue result = bx || by;
-        frame->operand_stack.push(result);
+        stack.push_back(result);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::NOT) {
-        VMValue x = frame->operand_stack.top();
+    VM_CASE(NOT) {
+        VMValue x = stack.back();
         ensure_not_null(*frame, x);
-        frame->operand_stack.pop();
+        stack.pop_back();
         bool bx = get<bool>(x);
         VMValue result = !bx;
-        frame->operand_stack.push(result);
+        stack.push_back(result);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::CMPLT) {
-        VMValue x = frame->operand_stack.top();
+    VM_CASE(CMPLT) {
+        VMValue x = stack.back();
         ensure_not_null(*frame, x);
-        frame->operand_stack.pop();
-        VMValue y = frame->operand_stack.top();
+        stack.pop_back();
+        VMValue y = stack.back();
         ensure_not_null(*frame, y);
-        frame->operand_stack.pop();
-        frame->operand_stack.push(lt(y, x));
+        stack.pop_back();
+        stack.push_back(lt(y, x));
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::CMPLE) {
-        VMValue x = frame->operand_stack.top();
+    VM_CASE(CMPLE) {
+        VMValue x = stack.back();
         ensure_not_null(*frame, x);
-        frame->operand_stack.pop();
-        VMValue y = frame->operand_stack.top();
+        stack.pop_back();
+        VMValue y = stack.back();
         ensure_not_null(*frame, y);
-        frame->operand_stack.pop();
-        frame->operand_stack.push(le(y, x));
+        stack.pop_back();
+        stack.push_back(le(y, x));
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::CMPGT) {
-        VMValue x = frame->operand_stack.top();
+    VM_CASE(CMPGT) {
+        VMValue x = stack.back();
         ensure_not_null(*frame, x);
-        frame->operand_stack.pop();
-        VMValue y = frame->operand_stack.top();
+        stack.pop_back();
+        VMValue y = stack.back();
         ensure_not_null(*frame, y);
-        frame->operand_stack.pop();
-        frame->operand_stack.push(gt(y, x));
+        stack.pop_back();
+        stack.push_back(gt(y, x));
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::CMPGE) {
-        VMValue x = frame->operand_stack.top();
+    VM_CASE(CMPGE) {
+        VMValue x = stack.back();
         ensure_not_null(*frame, x);
-        frame->operand_stack.pop();
-        VMValue y = frame->operand_stack.top();
+        stack.pop_back();
+        VMValue y = stack.back();
         ensure_not_null(*frame, y);
-        frame->operand_stack.pop();
-        frame->operand_stack.push(ge(y, x));
+        stack.pop_back();
+        stack.push_back(ge(y, x));
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::CMPEQ) {
-        VMValue x = frame->operand_stack.top();
-        frame->operand_stack.pop();
-        VMValue y = frame->operand_stack.top();
-        frame->operand_stack.pop();
+    VM_CASE(CMPEQ) {
+        VMValue x = stack.back();
+        stack.pop_back();
+        VMValue y = stack.back();
+        stack.pop_back();
         bool xy = get<bool>(eq(y, x));
         VMValue result = xy;
-        frame->operand_stack.push(result);
+        stack.push_back(result);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::CMPNE) {
-        VMValue x = frame->operand_stack.top();
-        frame->operand_stack.pop();
-        VMValue y = frame->operand_stack.top();
-        frame->operand_stack.pop();
+    VM_CASE(CMPNE) {
+        VMValue x = stack.back();
+        stack.pop_back();
+        VMValue y = stack.back();
+        stack.pop_back();
         bool xy = get<bool>(eq(y, x));
         VMValue result = !xy;
-        frame->operand_stack.push(result);
+        stack.push_back(result);
+      VM_NEXT();
+    }
+
+    //----------------------------------------------------------------------
+    // Typed arithmetic and comparators
+    //----------------------------------------------------------------------
+
+    VM_CASE(ADD_INT) {
+      VM_TYPED_BINARY(int, *y + *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(ADD_DBL) {
+      VM_TYPED_BINARY(double, *y + *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(SUB_INT) {
+      VM_TYPED_BINARY(int, *y - *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(SUB_DBL) {
+      VM_TYPED_BINARY(double, *y - *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(MUL_INT) {
+      VM_TYPED_BINARY(int, *y * *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(MUL_DBL) {
+      VM_TYPED_BINARY(double, *y * *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(DIV_INT) {
+      VM_TYPED_BINARY(int, *y / *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(DIV_DBL) {
+      VM_TYPED_BINARY(double, *y / *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPLT_INT) {
+      VM_TYPED_BINARY(int, *y < *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPLT_DBL) {
+      VM_TYPED_BINARY(double, *y < *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPLT_STR) {
+      VM_TYPED_BINARY(VMString, *y < *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPLE_INT) {
+      VM_TYPED_BINARY(int, *y <= *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPLE_DBL) {
+      VM_TYPED_BINARY(double, *y <= *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPLE_STR) {
+      VM_TYPED_BINARY(VMString, *y <= *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPGT_INT) {
+      VM_TYPED_BINARY(int, *y > *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPGT_DBL) {
+      VM_TYPED_BINARY(double, *y > *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPGT_STR) {
+      VM_TYPED_BINARY(VMString, *y > *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPGE_INT) {
+      VM_TYPED_BINARY(int, *y >= *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPGE_DBL) {
+      VM_TYPED_BINARY(double, *y >= *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPGE_STR) {
+      VM_TYPED_BINARY(VMString, *y >= *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPEQ_INT) {
+      VM_TYPED_EQUALITY(int, false);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPEQ_DBL) {
+      VM_TYPED_EQUALITY(double, false);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPEQ_STR) {
+      VM_TYPED_EQUALITY(VMString, false);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPNE_INT) {
+      VM_TYPED_EQUALITY(int, true);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPNE_DBL) {
+      VM_TYPED_EQUALITY(double, true);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPNE_STR) {
+      VM_TYPED_EQUALITY(VMString, true);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPLT_CHR) {
+      // chars order as unsigned bytes (as in string comparisons)
+      VM_TYPED_BINARY(char, (unsigned char) *y < (unsigned char) *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPLE_CHR) {
+      VM_TYPED_BINARY(char, (unsigned char) *y <= (unsigned char) *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPGT_CHR) {
+      VM_TYPED_BINARY(char, (unsigned char) *y > (unsigned char) *x);
+      VM_NEXT();
     }
 
-        //----------------------------------------------------------------------
+    VM_CASE(CMPGE_CHR) {
+      VM_TYPED_BINARY(char, (unsigned char) *y >= (unsigned char) *x);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPEQ_CHR) {
+      VM_TYPED_EQUALITY(char, false);
+      VM_NEXT();
+    }
+
+    VM_CASE(CMPNE_CHR) {
+      VM_TYPED_EQUALITY(char, true);
+      VM_NEXT();
+    }
+
+    //----------------------------------------------------------------------
     // Branching
     //----------------------------------------------------------------------
 
-    else if (instr.opcode() == OpCode::JMP) {
-        int x = get<int>(instr.operand().value());
-        //instr = frame->info.instructions[x];
+    VM_CASE(JMP) {
+        int x = instr->arg;
+        // a backward jump is a loop back-edge
+        bool back_edge = x < frame->pc;
         frame->pc = x;
+        if (back_edge and jit) {
+          int function = frame->info - frame_info.data();
+          if (jit->hot(function))
+            VM_JIT_ENTER(function);
+        }
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::JMPF) {
-        int line = get<int>(instr.operand().value());
-        VMValue x = frame->operand_stack.top();
-        frame->operand_stack.pop();
+    VM_CASE(JMPF) {
+        int line = instr->arg;
+        VMValue x = stack.back();
+        ensure_not_null(*frame, x);
+        stack.pop_back();
         bool bx = get<bool>(x);
-        if(!bx) {
-            //instr = frame->info.instructions[line];
+        if(!bx)
             frame->pc = line;
-        }
+      VM_NEXT();
     }
     
     //----------------------------------------------------------------------
     // Functions
     //----------------------------------------------------------------------
 
-    else if (instr.opcode() == OpCode::CALL) {
-        string name = get<string>(instr.operand().value());
-        shared_ptr<VMFrame> new_frame = make_shared<VMFrame>();
-        new_frame->info = frame_info[name];
-        int count = new_frame->info.arg_count;
-        call_stack.push(new_frame);
-        for(int i = 0; i < count; i++) {
-            VMValue x = frame->operand_stack.top();
-            new_frame->operand_stack.push(x);
-            frame->operand_stack.pop();
-        }
-        frame = new_frame;
-
+    VM_CASE(CALL) {
+      // the arguments on top of the caller's operands become the
+      // callee's first locals, the remaining locals start out null
+      int index = instr->arg;
+      const VMFrameInfo* info = &frame_info[index];
+      int base = stack.size() - info->arg_count;
+      frames.push_back(VMFrame {info, 0, base});
+      frame = &frames.back();
+      stack.resize(base + info->local_count, nullptr);
+      hooks.call(index);
+      if (jit and jit->hot(index))
+        VM_JIT_ENTER(index);
+      VM_NEXT();
     }
-//
-    else if (instr.opcode() == OpCode::RET) {
-        VMValue x = frame->operand_stack.top();
-        call_stack.pop();
-        if(!call_stack.empty()) {
-            frame = call_stack.top();
-            frame->operand_stack.push(x);
-        }
+
+    VM_CASE(RET) {
+      // drop the frame's window, leaving the return value on top of
+      // the caller's operands
+      VMValue x = std::move(stack.back());
+      stack.resize(frame->base);
+      frames.pop_back();
+      hooks.ret();
+      if (!frames.empty()) {
+        frame = &frames.back();
+        stack.push_back(std::move(x));
+        int function = frame->info - frame_info.data();
+        if (jit and jit->compiled(function))
+          VM_JIT_ENTER(function);
+      }
+      VM_NEXT();
     }
     
     //----------------------------------------------------------------------
     // Built in functions
     //----------------------------------------------------------------------
 
-    else if (instr.opcode() == OpCode::WRITE) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      cout << to_string(x);
+    VM_CASE(WRITE) {
+      VMValue x = stack.back();
+      stack.pop_back();
+      output.write(x);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::READ) {
+    VM_CASE(READ) {
+      // prompts are shown before waiting for input
+      output.flush();
       string val = "";
       getline(cin, val);
-      frame->operand_stack.push(val);
+      stack.push_back(VMString(move(val)));
+      VM_NEXT();
+    }
+
+    VM_CASE(SLEN) {
+        VMValue& x = stack.back();
+        ensure_not_null(*frame, x);
+        x = (int) get<VMString>(x).size();
+      VM_NEXT();
+    }
+
+    VM_CASE(ALEN) {
+        // pop array (vector) x, push x.size()
+        VMValue vmx = stack.back();
+        stack.pop_back();
+        ensure_not_null(*frame, vmx);
+
+        int x = get<int>(vmx);
+        int length = 0;
+        if (int_array_heap.contains(x))
+          length = int_array_heap.at(x).values.size();
+        else if (double_array_heap.contains(x))
+          length = double_array_heap.at(x).values.size();
+        else if (bool_array_heap.contains(x))
+          length = bool_array_heap.at(x).values.size();
+        else
+          length = array_heap.at(x).size();
+        stack.push_back(length);
+      VM_NEXT();
+    }
+
+    VM_CASE(GETC) {
+        // pop string x, pop int y, push x[y] (as a char, no allocation)
+        const VMValue& vmx = stack.back();
+        const VMValue& vmy = stack[stack.size() - 2];
+
+        ensure_not_null(*frame, vmx);
+        ensure_not_null(*frame, vmy);
+
+        string_view x = get<VMString>(vmx).view();
+        int y = get<int>(vmy);
+        if(y >= x.size())
+            error("out-of-bounds string index", *frame);
+        char value = x.at(y);
+        stack.pop_back();
+        stack.back() = value;
+      VM_NEXT();
+    }
+
+    VM_CASE(TOINT) {
+        // converted in place (strings are parsed without copying)
+        VMValue& x = stack.back();
+        ensure_not_null(*frame, x);
+        if (holds_alternative<double>(x))
+            x = (int) get<double>(x);
+        else if (holds_alternative<bool>(x))
+            x = (int) get<bool>(x);
+        else if (holds_alternative<VMString>(x)) {
+            int value = 0;
+            if (!parse_int(get<VMString>(x).view(), value))
+                error("cannot convert string to int", *frame);
+            x = value;
+        }
+        else if (holds_alternative<char>(x)) {
+            int value = 0;
+            if (!parse_int(string_view(&get<char>(x), 1), value))
+                error("cannot convert string to int", *frame);
+            x = value;
+        }
+      VM_NEXT();
+    }
+
+    VM_CASE(TODBL) {
+        VMValue& x = stack.back();
+        ensure_not_null(*frame, x);
+        if (holds_alternative<int>(x))
+            x = (double) get<int>(x);
+        else if (holds_alternative<bool>(x))
+            x = (double) get<bool>(x);
+        else if (holds_alternative<VMString>(x)) {
+            double value = 0.0;
+            if (!parse_double(get<VMString>(x).view(), value))
+                error("cannot convert string to double", *frame);
+            x = value;
+        }
+        else if (holds_alternative<char>(x)) {
+            double value = 0.0;
+            if (!parse_double(string_view(&get<char>(x), 1), value))
+                error("cannot convert string to double", *frame);
+            x = value;
+        }
+      VM_NEXT();
+    }
+
+    VM_CASE(TOSTR) {
+        VMValue& x = stack.back();
+        ensure_not_null(*frame, x);
+        if (!holds_alternative<VMString>(x))
+            x = VMString(to_string(x));
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::SLEN) {
-        VMValue x = frame->operand_stack.top();
-        frame->operand_stack.pop();
+    VM_CASE(CONCAT) {
+        // appends to y's buffer in place when possible (char operands
+        // are one-character strings)
+        VMValue& x = stack.back();
+        VMValue& y = stack[stack.size() - 2];
         ensure_not_null(*frame, x);
-        string xy = get<string>(x);
-        int z = xy.length();
-        VMValue result = z;
-        frame->operand_stack.push(result);
+        ensure_not_null(*frame, y);
+        if (holds_alternative<char>(x))
+            x = VMString(to_string(x));
+        if (holds_alternative<char>(y))
+            y = VMString(to_string(y));
+        y = VMString::concat(get<VMString>(y), get<VMString>(x));
+        stack.pop_back();
+      VM_NEXT();
     }
+
     //----------------------------------------------------------------------
     // heap
     //----------------------------------------------------------------------
 
-    else if (instr.opcode() == OpCode::ALLOCS) {
-        struct_heap[next_obj_id] = {};
-        frame->operand_stack.push(next_obj_id);
+    VM_CASE(ALLOCS) {
+        // [operand] allocate obj of struct type v, fields set to null
+        if (heap_bytes >= gc_threshold)
+          collect();
+        int field_count = struct_info[instr->arg].field_names.size();
+        VMStructObject& obj = struct_heap[next_obj_id];
+        obj.type = instr->arg;
+        obj.fields.resize(field_count, nullptr);
+        heap_bytes += object_bytes(field_count);
+        stack.push_back(next_obj_id);
         ++next_obj_id;
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::ALLOCA) {
-        VMValue val = frame->operand_stack.top();
-        frame->operand_stack.pop();
-        int size = get<int>(frame->operand_stack.top());
-        frame->operand_stack.pop();
+    VM_CASE(ALLOCA) {
+        // collect first, while the operands are still roots
+        if (heap_bytes >= gc_threshold)
+          collect();
+        VMValue val = stack.back();
+        stack.pop_back();
+        int size = get<int>(stack.back());
+        stack.pop_back();
         array_heap[next_obj_id] = vector<VMValue>(size, val);
-        frame->operand_stack.push(next_obj_id);
+        heap_bytes += object_bytes(size);
+        stack.push_back(next_obj_id);
         ++next_obj_id;
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::ADDF) {
-        // [operand] pop x, add field named v to obj(x)
-        string name = get<string>(instr.operand().value());
-        VMValue vm = frame->operand_stack.top();
+    VM_CASE(ADDF) {
+        // [operand] pop x, add field slot v to obj(x)
+        int slot = instr->arg;
+        VMValue vm = stack.back();
         ensure_not_null(*frame, vm);
         int x = get<int>(vm);
-        frame->operand_stack.pop();
-        struct_heap[x][name] = nullptr;
+        stack.pop_back();
+        auto obj = struct_heap.find(x);
+        if (obj == struct_heap.end())
+          error("invalid struct reference", *frame);
+        vector<VMValue>& fields = obj->second.fields;
+        if (fields.size() <= slot) {
+          heap_bytes += object_bytes(slot + 1) - object_bytes(fields.size());
+          fields.resize(slot + 1, nullptr);
+        }
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::SETF) {
-        // [operand] pop x and y, set obj(y).v = x
-        string name = get<string>(instr.operand().value());
-        VMValue x = frame->operand_stack.top();
-        frame->operand_stack.pop();
-        VMValue vm = frame->operand_stack.top();
+    VM_CASE(SETF) {
+        // [operand] pop x and y, set obj(y)[v] = x
+        int slot = instr->arg;
+        VMValue x = stack.back();
+        stack.pop_back();
+        VMValue vm = stack.back();
         ensure_not_null(*frame, vm);
         int y = get<int>(vm);
-        frame->operand_stack.pop();
-        struct_heap[y][name] = x;
+        stack.pop_back();
+        field(*frame, y, slot) = std::move(x);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::GETF) {
-        // [operand] pop x, push value of obj(x).v
-        string name = get<string>(instr.operand().value());
-        VMValue vm = frame->operand_stack.top();
-        ensure_not_null(*frame, vm);
-        int x = get<int>(vm);
-        frame->operand_stack.pop();
-        VMValue v = struct_heap[x][name];
-        frame->operand_stack.push(v);
+    VM_CASE(GETF) {
+        // [operand] pop x, push obj(x)[v]
+        int slot = instr->arg;
+        ensure_not_null(*frame, stack.back());
+        int x = get<int>(stack.back());
+        stack.back() = field(*frame, x, slot);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::SETI) {
+    VM_CASE(SETI) {
         // pop x, y, and z, set array obj(z)[y] = x
-        VMValue vmx = frame->operand_stack.top();
-        frame->operand_stack.pop();
-        VMValue vmy = frame->operand_stack.top();
-        frame->operand_stack.pop();
-        VMValue vmz = frame->operand_stack.top();
-        frame->operand_stack.pop();
+        VMValue vmx = stack.back();
+        stack.pop_back();
+        VMValue vmy = stack.back();
+        stack.pop_back();
+        VMValue vmz = stack.back();
+        stack.pop_back();
 
         ensure_not_null(*frame, vmx);
         ensure_not_null(*frame, vmy);
@@ -400,14 +1227,15 @@ void VM::run(bool DEBUG)
         if(y >= array_heap[z].size())
             error("out-of-bounds array index", *frame);
         array_heap[z][y] = vmx;
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::GETI) {
+    VM_CASE(GETI) {
         // pop x and y, push array obj(y)[x] value
-        VMValue vmx = frame->operand_stack.top();
-        frame->operand_stack.pop();
-        VMValue vmy = frame->operand_stack.top();
-        frame->operand_stack.pop();
+        VMValue vmx = stack.back();
+        stack.pop_back();
+        VMValue vmy = stack.back();
+        stack.pop_back();
 
         ensure_not_null(*frame, vmx);
         ensure_not_null(*frame, vmy);
@@ -418,126 +1246,280 @@ void VM::run(bool DEBUG)
         if(x >= array_heap[y].size())
             error("out-of-bounds array index", *frame);
         VMValue value = array_heap[y][x];
-        frame->operand_stack.push(value);
+        stack.push_back(value);
+      VM_NEXT();
     }
 
+    VM_CASE(ALLOCA_INT) {
+      VM_TYPED_ALLOCA(int_array_heap, int32_t, int);
+      VM_NEXT();
+    }
 
-    else if (instr.opcode() == OpCode::ALEN) {
-        // pop array (vector) x, push x.size()
-        VMValue vmx = frame->operand_stack.top();
-        frame->operand_stack.pop();
-        ensure_not_null(*frame, vmx);
+    VM_CASE(ALLOCA_DBL) {
+      VM_TYPED_ALLOCA(double_array_heap, double, double);
+      VM_NEXT();
+    }
 
-        int x = get<int>(vmx);
-        std::vector<VMValue> vector = array_heap.at(x);
-        int length = vector.size();
-        frame->operand_stack.push(length);
+    VM_CASE(ALLOCA_BOOL) {
+      VM_TYPED_ALLOCA(bool_array_heap, uint8_t, bool);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::GETC) {
-        // pop string x, pop int y, push x[y]
-        VMValue vmx = frame->operand_stack.top();
-        frame->operand_stack.pop();
-        VMValue vmy = frame->operand_stack.top();
-        frame->operand_stack.pop();
+    VM_CASE(SETI_INT) {
+      VM_TYPED_SETI(int_array_heap, int32_t, int);
+      VM_NEXT();
+    }
 
-        ensure_not_null(*frame, vmx);
-        ensure_not_null(*frame, vmy);
+    VM_CASE(SETI_DBL) {
+      VM_TYPED_SETI(double_array_heap, double, double);
+      VM_NEXT();
+    }
 
-        string x = get<string>(vmx);
-        int y = get<int>(vmy);
-        if(y >= x.size())
-            error("out-of-bounds string index", *frame);
-        string ch = "";
-        ch += x.at(y);
-        VMValue value = ch;
-        frame->operand_stack.push(value);
+    VM_CASE(SETI_BOOL) {
+      VM_TYPED_SETI(bool_array_heap, uint8_t, bool);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::TOSTR) {
-        VMValue x = frame->operand_stack.top();
-        frame->operand_stack.pop();
-        ensure_not_null(*frame, x);
-        string xy = to_string(x);
-        VMValue result = xy;
-        frame->operand_stack.push(result);
+    VM_CASE(GETI_INT) {
+      VM_TYPED_GETI(int_array_heap, int);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::TOINT) {
-        VMValue x = frame->operand_stack.top();
-        frame->operand_stack.pop();
-        ensure_not_null(*frame, x);
-        if (holds_alternative<double>(x)) {
-            int xy = (int) get<double>(x);
-            frame->operand_stack.push(xy);
-        } else if (holds_alternative<bool>(x)) {
-            int xy = (int) get<bool>(x);
-            frame->operand_stack.push(xy);
-        }
-        else {
-            try {
-                int str = stoi(get<string>(x));
-                frame->operand_stack.push(str);
-            }
-            catch (...) {
-                error("cannot convert string to int", (VMFrame &) *frame);
-            }
-        }
+    VM_CASE(GETI_DBL) {
+      VM_TYPED_GETI(double_array_heap, double);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::TODBL) {
-        VMValue x = frame->operand_stack.top();
-        frame->operand_stack.pop();
-        ensure_not_null(*frame, x);
-        if (holds_alternative<int>(x)) {
-            double xy = (double) get<int>(x);
-            frame->operand_stack.push(xy);
-        } else if (holds_alternative<bool>(x)) {
-            double xy = (double) get<bool>(x);
-            frame->operand_stack.push(xy);
-        } else
-            try {
-                double xy = stod(get<string>(x));
-                frame->operand_stack.push(xy);
-            }
-            catch (...){
-                error("cannot convert string to double", (VMFrame &) *frame);
-            }
-    }
-
-    else if (instr.opcode() == OpCode::CONCAT) {
-        VMValue x = frame->operand_stack.top();
-        ensure_not_null(*frame, x);
-        frame->operand_stack.pop();
-        VMValue y = frame->operand_stack.top();
-        ensure_not_null(*frame, y);
-        frame->operand_stack.pop();
-        string sx = get<string>(x);
-        string sy = get<string>(y);
-        string concat = sy + sx;
-        frame->operand_stack.push(concat);
+    VM_CASE(GETI_BOOL) {
+      VM_TYPED_GETI(bool_array_heap, bool);
+      VM_NEXT();
     }
-    
+
+    //----------------------------------------------------------------------
+    // superinstructions (the operands of the rest of the sequence are
+    // read from the instructions following the superinstruction)
+    //----------------------------------------------------------------------
+
+    VM_CASE(INC_LOCAL) {
+      VMValue& x = stack[frame->base + instr->arg];
+      if (int* value = get_if<int>(&x)) {
+        *value += get<int>(constants[instr[1].arg]);
+        frame->pc += 3;
+      }
+      else
+        stack.push_back(x);
+      VM_NEXT();
+    }
+
+    VM_CASE(LOAD_ADD_CONST) {
+      VM_FUSED_ARITHMETIC(+);
+      VM_NEXT();
+    }
+
+    VM_CASE(LOAD_SUB_CONST) {
+      VM_FUSED_ARITHMETIC(-);
+      VM_NEXT();
+    }
+
+    VM_CASE(LOAD_GETF) {
+      const VMValue& x = stack[frame->base + instr->arg];
+      if (const int* oid = get_if<int>(&x)) {
+        stack.push_back(field(*frame, *oid, instr[1].arg));
+        frame->pc += 1;
+      }
+      else
+        stack.push_back(x);
+      VM_NEXT();
+    }
+
+    VM_CASE(JMP_IF_LOCAL_GE_CONST) {
+      VM_FUSED_BRANCH(<);
+      VM_NEXT();
+    }
+
+    VM_CASE(JMP_IF_LOCAL_GT_CONST) {
+      VM_FUSED_BRANCH(<=);
+      VM_NEXT();
+    }
+
+    VM_CASE(JMP_IF_LOCAL_LE_CONST) {
+      VM_FUSED_BRANCH(>);
+      VM_NEXT();
+    }
+
+    VM_CASE(JMP_IF_LOCAL_LT_CONST) {
+      VM_FUSED_BRANCH(>=);
+      VM_NEXT();
+    }
+
     //----------------------------------------------------------------------
     // special
     //----------------------------------------------------------------------
 
-    
-    else if (instr.opcode() == OpCode::DUP) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      frame->operand_stack.push(x);
-      frame->operand_stack.push(x);      
+    VM_CASE(DUP) {
+      VMValue x = stack.back();
+      stack.pop_back();
+      stack.push_back(x);
+      stack.push_back(x);
+      VM_NEXT();
     }
 
-    else if (instr.opcode() == OpCode::NOP) {
+    VM_CASE(NOP) {
       // do nothing
+      VM_NEXT();
+    }
+
+  VM_DISPATCH_END()
+
+ done:
+  return;
+}
+
+
+//----------------------------------------------------------------------
+// Garbage collection
+//----------------------------------------------------------------------
+
+string to_string(const VMGCStats& stats)
+{
+  auto ms = [](long ns) {return to_string(ns / 1000000.0) + " ms";};
+  string s = "";
+  s += "GC collections....: " + to_string(stats.collections) + "\n";
+  s += "GC objects freed..: " + to_string(stats.objects_freed) + "\n";
+  s += "GC bytes freed....: " + to_string(stats.bytes_freed) + "\n";
+  s += "GC heap bytes.....: " + to_string(stats.heap_bytes) + "\n";
+  s += "GC peak bytes.....: " + to_string(stats.peak_bytes) + "\n";
+  s += "GC total pause....: " + ms(stats.total_pause) + "\n";
+  s += "GC max pause......: " + ms(stats.max_pause) + "\n";
+  return s;
+}
+
+
+void VM::set_output_mode(VMBufferMode mode)
+{
+  output.set_mode(mode);
+}
+
+
+void VM::set_gc_threshold(size_t bytes)
+{
+  gc_min_threshold = bytes;
+  gc_threshold = bytes;
+}
+
+
+VMGCStats VM::gc_stats() const
+{
+  VMGCStats stats = gc;
+  stats.heap_bytes = heap_bytes;
+  stats.peak_bytes = max(stats.peak_bytes, (long)heap_bytes);
+  return stats;
+}
+
+
+size_t VM::object_bytes(size_t count, size_t element_bytes)
+{
+  // the element storage plus the heap map node and object header
+  return count * element_bytes + sizeof(VMStructObject) +
+    4 * sizeof(void*);
+}
+
+
+void VM::mark(const VMValue& value, unordered_set<int>& marked,
+              vector<int>& pending) const
+{
+  // object references are ints, any int naming a live object is
+  // treated as a reference (ints that merely look like one only keep
+  // the object alive a little longer)
+  const int* oid = get_if<int>(&value);
+  if (!oid or marked.contains(*oid))
+    return;
+  if (int_array_heap.contains(*oid) or double_array_heap.contains(*oid) or
+      bool_array_heap.contains(*oid)) {
+    // unboxed arrays hold no references (nothing to scan)
+    marked.insert(*oid);
+    return;
+  }
+  if (!struct_heap.contains(*oid) and !array_heap.contains(*oid))
+    return;
+  marked.insert(*oid);
+  pending.push_back(*oid);
+}
+
+
+// helper function to remove the unmarked objects of a heap, adding to
+// the freed object count and bytes (using the given object size
+// function)
+template<typename Heap, typename Size>
+void sweep(Heap& heap, const unordered_set<int>& marked, Size object_size,
+           long& freed_objects, size_t& freed_bytes)
+{
+  for (auto obj = heap.begin(); obj != heap.end(); ) {
+    if (marked.contains(obj->first))
+      ++obj;
+    else {
+      freed_bytes += object_size(obj->second);
+      ++freed_objects;
+      obj = heap.erase(obj);
+    }
+  }
+}
+
+
+void VM::collect()
+{
+  auto start = chrono::steady_clock::now();
+  gc.peak_bytes = max(gc.peak_bytes, (long)heap_bytes);
+
+  // mark from the roots: every frame's locals and operands
+  unordered_set<int> marked;
+  vector<int> pending;
+  for (const VMValue& value : stack)
+    mark(value, marked, pending);
+  while (!pending.empty()) {
+    int oid = pending.back();
+    pending.pop_back();
+    auto obj = struct_heap.find(oid);
+    if (obj != struct_heap.end()) {
+      // only fields that can hold references are scanned
+      const VMStructInfo& type = struct_info[obj->second.type];
+      for (int slot : type.reference_slots)
+        mark(obj->second.fields[slot], marked, pending);
     }
-    
     else {
-      error("unsupported operation " + to_string(instr));
+      for (const VMValue& value : array_heap.at(oid))
+        mark(value, marked, pending);
     }
   }
+
+  // sweep the unmarked objects
+  size_t freed_bytes = 0;
+  long freed_objects = 0;
+  sweep(struct_heap, marked, [](const VMStructObject& obj) {
+      return object_bytes(obj.fields.size());}, freed_objects, freed_bytes);
+  sweep(array_heap, marked, [](const vector<VMValue>& obj) {
+      return object_bytes(obj.size());}, freed_objects, freed_bytes);
+  sweep(int_array_heap, marked, [](const VMTypedArray<int32_t>& obj) {
+      return object_bytes(obj.values.size(), sizeof(int32_t));},
+    freed_objects, freed_bytes);
+  sweep(double_array_heap, marked, [](const VMTypedArray<double>& obj) {
+      return object_bytes(obj.values.size(), sizeof(double));},
+    freed_objects, freed_bytes);
+  sweep(bool_array_heap, marked, [](const VMTypedArray<uint8_t>& obj) {
+      return object_bytes(obj.values.size(), sizeof(uint8_t));},
+    freed_objects, freed_bytes);
+  heap_bytes -= freed_bytes;
+
+  // collect again once the heap doubles (but not below the minimum)
+  gc_threshold = max(gc_min_threshold, 2 * heap_bytes);
+
+  auto pause = chrono::duration_cast<chrono::nanoseconds>(
+    chrono::steady_clock::now() - start).count();
+  ++gc.collections;
+  gc.objects_freed += freed_objects;
+  gc.bytes_freed += freed_bytes;
+  gc.total_pause += pause;
+  gc.max_pause = max(gc.max_pause, (long)pause);
 }
 
 
@@ -548,6 +1530,15 @@ void VM::ensure_not_null(const VMFrame& f, const VMValue& x) const
 }
 
 
+VMValue& VM::field(const VMFrame& f, int oid, int slot)
+{
+  auto obj = struct_heap.find(oid);
+  if (obj == struct_heap.end() or slot >= obj->second.fields.size())
+    error("invalid struct reference", f);
+  return obj->second.fields[slot];
+}
+
+
 VMValue VM::add(const VMValue& x, const VMValue& y) const
 {
   if (holds_alternative<int>(x)) 
@@ -595,8 +1586,10 @@ VMValue VM::eq(const VMValue& x, const VMValue& y) const
         return get<int>(x) == get<int>(y);
     else if (holds_alternative<double>(x))
         return get<double>(x) == get<double>(y);
-    else if (holds_alternative<string>(x))
-        return get<string>(x) == get<string>(y);
+    else if (holds_alternative<VMString>(x))
+        return get<VMString>(x) == get<VMString>(y);
+    else if (holds_alternative<char>(x))
+        return get<char>(x) == get<char>(y);
     else
         return get<bool>(x) == get<bool>(y);
 }
@@ -615,8 +1608,10 @@ VMValue VM::lt(const VMValue& x, const VMValue& y) const
         return get<int>(x) < get<int>(y);
     else if (holds_alternative<double>(x))
         return get<double>(x) < get<double>(y);
-    else if (holds_alternative<string>(x))
-        return get<string>(x) < get<string>(y);
+    else if (holds_alternative<VMString>(x))
+        return get<VMString>(x) < get<VMString>(y);
+    else if (holds_alternative<char>(x))
+        return (unsigned char) get<char>(x) < (unsigned char) get<char>(y);
     else
         return get<bool>(x) < get<bool>(y);
 }
@@ -633,8 +1628,10 @@ VMValue VM::le(const VMValue& x, const VMValue& y) const
         return get<int>(x) <= get<int>(y);
     else if (holds_alternative<double>(x))
         return get<double>(x) <= get<double>(y);
-    else if (holds_alternative<string>(x))
-        return get<string>(x) <= get<string>(y);
+    else if (holds_alternative<VMString>(x))
+        return get<VMString>(x) <= get<VMString>(y);
+    else if (holds_alternative<char>(x))
+        return (unsigned char) get<char>(x) <= (unsigned char) get<char>(y);
     else
         return get<bool>(x) <= get<bool>(y);
 }
@@ -651,8 +1648,10 @@ VMValue VM::gt(const VMValue& x, const VMValue& y) const
         return get<int>(x) > get<int>(y);
     else if (holds_alternative<double>(x))
         return get<double>(x) > get<double>(y);
-    else if (holds_alternative<string>(x))
-        return get<string>(x) > get<string>(y);
+    else if (holds_alternative<VMString>(x))
+        return get<VMString>(x) > get<VMString>(y);
+    else if (holds_alternative<char>(x))
+        return (unsigned char) get<char>(x) > (unsigned char) get<char>(y);
     else
         return get<bool>(x) > get<bool>(y);
 }
@@ -669,9 +1668,128 @@ VMValue VM::ge(const VMValue& x, const VMValue& y) const
         return get<int>(x) >= get<int>(y);
     else if (holds_alternative<double>(x))
         return get<double>(x) >= get<double>(y);
-    else if (holds_alternative<string>(x))
-        return get<string>(x) >= get<string>(y);
+    else if (holds_alternative<VMString>(x))
+        return get<VMString>(x) >= get<VMString>(y);
+    else if (holds_alternative<char>(x))
+        return (unsigned char) get<char>(x) >= (unsigned char) get<char>(y);
     else
         return get<bool>(x) >= get<bool>(y);
 }
 
+
+//----------------------------------------------------------------------
+// NaN-boxed (VMWord) versions of the operation helpers, with the same
+// semantics as the VMValue versions above
+//----------------------------------------------------------------------
+
+VMWord VM::add(VMWord x, VMWord y) const
+{
+  if (x.is_int())
+    return VMWord::from_int(x.as_int() + y.as_int());
+  else
+    return VMWord::from_double(x.as_double() + y.as_double());
+}
+
+VMWord VM::sub(VMWord x, VMWord y) const
+{
+  if (x.is_int())
+    return VMWord::from_int(x.as_int() - y.as_int());
+  else
+    return VMWord::from_double(x.as_double() - y.as_double());
+}
+
+VMWord VM::mul(VMWord x, VMWord y) const
+{
+  if (x.is_int())
+    return VMWord::from_int(x.as_int() * y.as_int());
+  else
+    return VMWord::from_double(x.as_double() * y.as_double());
+}
+
+VMWord VM::div(VMWord x, VMWord y) const
+{
+  if (x.is_int())
+    return VMWord::from_int(x.as_int() / y.as_int());
+  else
+    return VMWord::from_double(x.as_double() / y.as_double());
+}
+
+VMWord VM::eq(VMWord x, VMWord y) const
+{
+  if (x.is_null() or y.is_null())
+    return VMWord::from_bool(x.is_null() and y.is_null());
+  else if (x.is_double())
+    return VMWord::from_bool(x.as_double() == y.as_double());
+  else if (x.is_string())
+    return VMWord::from_bool(x.as_string() == y.as_string());
+  else
+    return VMWord::from_bool(x.bits == y.bits);
+}
+
+VMWord VM::lt(VMWord x, VMWord y) const
+{
+  if (x.is_null() or y.is_null())
+    return VMWord::from_bool(x.is_null() and y.is_null());
+  else if (x.is_int())
+    return VMWord::from_bool(x.as_int() < y.as_int());
+  else if (x.is_double())
+    return VMWord::from_bool(x.as_double() < y.as_double());
+  else if (x.is_string())
+    return VMWord::from_bool(x.as_string() < y.as_string());
+  else if (x.is_char())
+    return VMWord::from_bool((unsigned char) x.as_char() <
+                             (unsigned char) y.as_char());
+  else
+    return VMWord::from_bool(x.as_bool() < y.as_bool());
+}
+
+VMWord VM::le(VMWord x, VMWord y) const
+{
+  if (x.is_null() or y.is_null())
+    return VMWord::from_bool(x.is_null() and y.is_null());
+  else if (x.is_int())
+    return VMWord::from_bool(x.as_int() <= y.as_int());
+  else if (x.is_double())
+    return VMWord::from_bool(x.as_double() <= y.as_double());
+  else if (x.is_string())
+    return VMWord::from_bool(x.as_string() <= y.as_string());
+  else if (x.is_char())
+    return VMWord::from_bool((unsigned char) x.as_char() <=
+                             (unsigned char) y.as_char());
+  else
+    return VMWord::from_bool(x.as_bool() <= y.as_bool());
+}
+
+VMWord VM::gt(VMWord x, VMWord y) const
+{
+  if (x.is_null() or y.is_null())
+    return VMWord::from_bool(x.is_null() and y.is_null());
+  else if (x.is_int())
+    return VMWord::from_bool(x.as_int() > y.as_int());
+  else if (x.is_double())
+    return VMWord::from_bool(x.as_double() > y.as_double());
+  else if (x.is_string())
+    return VMWord::from_bool(x.as_string() > y.as_string());
+  else if (x.is_char())
+    return VMWord::from_bool((unsigned char) x.as_char() >
+                             (unsigned char) y.as_char());
+  else
+    return VMWord::from_bool(x.as_bool() > y.as_bool());
+}
+
+VMWord VM::ge(VMWord x, VMWord y) const
+{
+  if (x.is_null() or y.is_null())
+    return VMWord::from_bool(x.is_null() and y.is_null());
+  else if (x.is_int())
+    return VMWord::from_bool(x.as_int() >= y.as_int());
+  else if (x.is_double())
+    return VMWord::from_bool(x.as_double() >= y.as_double());
+  else if (x.is_string())
+    return VMWord::from_bool(x.as_string() >= y.as_string());
+  else if (x.is_char())
+    return VMWord::from_bool((unsigned char) x.as_char() >=
+                             (unsigned char) y.as_char());
+  else
+    return VMWord::from_bool(x.as_bool() >= y.as_bool());
+}
@@ -8,45 +8,248 @@
 #ifndef VM_H
 #define VM_H
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
-#include <stack>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "vm_instr.h"
 #include "vm_frame.h"
+#include "vm_hooks.h"
+#include "vm_array.h"
+#include "vm_output.h"
+#include "vm_profile.h"
+#include "vm_struct.h"
+#include "vm_trace.h"
+#include "vm_word.h"
+
+class VMJit;
+
+
+// Garbage collection statistics (times in nanoseconds)
+class VMGCStats
+{
+public:
+
+  // number of collections run
+  long collections = 0;
+
+  // number of objects and (estimated) bytes reclaimed overall
+  long objects_freed = 0;
+  long bytes_freed = 0;
+
+  // (estimated) bytes currently held by heap objects and the most
+  // ever held at once
+  long heap_bytes = 0;
+  long peak_bytes = 0;
+
+  // total and longest collection pause
+  long total_pause = 0;
+  long max_pause = 0;
+
+};
+
+// function to get a (multi-line) report of the collection statistics
+std::string to_string(const VMGCStats& stats);
 
 
 class VM
 {
 public:
 
+  // preallocates the value and frame stacks
+  VM();
+  ~VM();
+
   // add a new frame type to the vm
   void add(const VMFrameInfo& frame);
 
+  // add a new struct type to the vm
+  void add(const VMStructInfo& type);
+
+  // resolve CALL and ALLOCS operands from function and struct names
+  // to their indexes and pack each frame's instructions, moving operand values into
+  // the constant pool (done once, after code generation and before
+  // running)
+  void link();
+
   // run the virtual machine
   void run(bool DEBUG = false);
 
+  // compile hot functions to native code while running (returns false,
+  // leaving the vm interpreting, if the platform is not supported)
+  bool enable_jit();
+
+  // record a profile of the next run, without native code (call once
+  // the program is loaded)
+  void enable_profile();
+
+  // the profile of the last run (empty if profiling was not enabled)
+  VMProfile profile() const;
+
+  // write a binary trace of the next run to the file, without native
+  // code (call once the program is loaded, see VMTracer)
+  void enable_trace(const std::string& filename);
+
+  // count the instructions of the next run, without native code (see
+  // instruction_count)
+  void enable_count();
+
+  // number of instructions run (if counting was enabled)
+  long instruction_count() const;
+
+  // set whether runs replace common instruction sequences with
+  // superinstructions (on by default, see fuse)
+  void set_fusion(bool enabled);
+
+  // set the (estimated) heap size in bytes that triggers a collection
+  void set_gc_threshold(std::size_t bytes);
+
+  // the garbage collection statistics so far
+  VMGCStats gc_stats() const;
+
+  // set when program output (buffered by the vm) is written out
+  void set_output_mode(VMBufferMode mode);
+
   // to print the instructions for each VM frame
   friend std::string to_string(const VM& vm);
 
+  // operation support helper functions
+  VMValue add(const VMValue& x, const VMValue& y) const;
+  VMValue sub(const VMValue& x, const VMValue& y) const;  
+  VMValue mul(const VMValue& x, const VMValue& y) const;  
+  VMValue div(const VMValue& x, const VMValue& y) const;    
+  VMValue lt(const VMValue& x, const VMValue& y) const;  
+  VMValue le(const VMValue& x, const VMValue& y) const;  
+  VMValue gt(const VMValue& x, const VMValue& y) const;  
+  VMValue ge(const VMValue& x, const VMValue& y) const;  
+  VMValue eq(const VMValue& x, const VMValue& y) const;  
+
+  // operation support helper functions for NaN-boxed values
+  VMWord add(VMWord x, VMWord y) const;
+  VMWord sub(VMWord x, VMWord y) const;
+  VMWord mul(VMWord x, VMWord y) const;
+  VMWord div(VMWord x, VMWord y) const;
+  VMWord lt(VMWord x, VMWord y) const;
+  VMWord le(VMWord x, VMWord y) const;
+  VMWord gt(VMWord x, VMWord y) const;
+  VMWord ge(VMWord x, VMWord y) const;
+  VMWord eq(VMWord x, VMWord y) const;
+
   
 private:
 
-  // heap for struct objects mapping oid's to field values
-  std::unordered_map<int, std::unordered_map<std::string, VMValue>> struct_heap;
+  // heap for struct objects mapping oid's to objects
+  std::unordered_map<int, VMStructObject> struct_heap;
 
   // heap for array objects
   std::unordered_map<int, std::vector<VMValue>> array_heap;
 
-  // next available object id 
+  // heaps for unboxed arrays of int, double, and bool elements
+  std::unordered_map<int, VMTypedArray<std::int32_t>> int_array_heap;
+  std::unordered_map<int, VMTypedArray<double>> double_array_heap;
+  std::unordered_map<int, VMTypedArray<std::uint8_t>> bool_array_heap;
+
+  // next available object id (ids are never reused, so a stale id
+  // can never alias a newer object)
   int next_obj_id = 2023;
 
-  // collection of frame "templates" identified by function name
-  std::unordered_map<std::string, VMFrameInfo> frame_info;
+  // default heap size that triggers the first collection
+  static const std::size_t GC_THRESHOLD = 1 << 26;
+
+  // (estimated) bytes held by heap objects
+  std::size_t heap_bytes = 0;
+
+  // configured and current collection trigger (the trigger grows with
+  // the live heap so collections stay amortized)
+  std::size_t gc_min_threshold = GC_THRESHOLD;
+  std::size_t gc_threshold = GC_THRESHOLD;
 
-  // VM function call stack
-  std::stack<std::shared_ptr<VMFrame>> call_stack;
+  // collection statistics
+  VMGCStats gc;
+
+  // collection of frame "templates" identified by function index
+  std::vector<VMFrameInfo> frame_info;
+
+  // mapping from function names to their index in frame_info
+  std::unordered_map<std::string, int> frame_index;
+
+  // struct type descriptors identified by struct index
+  std::vector<VMStructInfo> struct_info;
+
+  // mapping from struct names to their index in struct_info
+  std::unordered_map<std::string, int> struct_index;
+
+  // true once the frames have been linked into packed code
+  bool linked = false;
+
+  // whether runs use superinstructions, and true once the packed code
+  // has them
+  bool fusion = true;
+  bool fused = false;
+
+  // the program's constant pool (PUSH values)
+  std::vector<VMValue> constants;
+
+  // equality of constant pool values, with doubles compared by their
+  // bits (so 0.0 and -0.0 get separate slots, and a NaN finds its own)
+  class SameConstant
+  {
+  public:
+    bool operator()(const VMValue& x, const VMValue& y) const;
+  };
+
+  // mapping from constant values to their index in the pool
+  std::unordered_map<VMValue, int, std::hash<VMValue>, SameConstant>
+    constant_index;
+
+  // initial capacity of the value and frame stacks (calls and returns
+  // only allocate if a program goes beyond these)
+  static const int STACK_RESERVE = 1 << 16;
+  static const int FRAME_RESERVE = 1 << 12;
+
+  // value stack shared by all frames, holding each frame's locals
+  // followed by its operands
+  std::vector<VMValue> stack;
+
+  // VM function call stack (current frame last)
+  std::vector<VMFrame> frames;
+
+  // program output (flushed on errors, so mutable)
+  mutable VMOutput output;
+
+  // the native code compiler (if enabled), which uses the vm's state
+  // directly
+  friend class VMJit;
+  std::unique_ptr<VMJit> jit;
+
+  // the profiler, tracer, and instruction counter (if enabled)
+  std::unique_ptr<VMProfiler> profiler;
+  std::unique_ptr<VMTracer> tracer;
+  std::unique_ptr<VMCounter> counter;
+
+  // hooks printing the state of the run loop before each instruction
+  // (for debugging)
+  class DebugHooks;
+
+  // programs are saved to and loaded from binary images directly
+  friend class VMImage;
+
+  // the register engine runs over the vm's stack, heaps, and constants
+  friend class RegVM;
+
+  // the run loop, either running until the program ends or (STEP)
+  // running the current frame's next instruction only, calling the
+  // hooks (see vm_hooks.h) as it goes
+  template<bool STEP, typename Hooks> void execute(Hooks& hooks);
+
+  // run the program from the given (main) function with the hooks
+  template<typename Hooks> void start(int function, Hooks& hooks);
+
+  // run the current frame's next instruction (used by native code)
+  void step();
 
   // helper functions to report VM errors
   void error(std::string msg) const;
@@ -55,16 +258,39 @@ private:
   // helper function to check for null values (throws mypl exception)
   void ensure_not_null(const VMFrame& f, const VMValue& x) const;
 
-  // operation support helper functions
-  VMValue add(const VMValue& x, const VMValue& y) const;
-  VMValue sub(const VMValue& x, const VMValue& y) const;  
-  VMValue mul(const VMValue& x, const VMValue& y) const;  
-  VMValue div(const VMValue& x, const VMValue& y) const;    
-  VMValue lt(const VMValue& x, const VMValue& y) const;  
-  VMValue le(const VMValue& x, const VMValue& y) const;  
-  VMValue gt(const VMValue& x, const VMValue& y) const;  
-  VMValue ge(const VMValue& x, const VMValue& y) const;  
-  VMValue eq(const VMValue& x, const VMValue& y) const;  
+  // helper function to get a field of a struct object (throws mypl
+  // exception if there is no such object or field)
+  VMValue& field(const VMFrame& f, int oid, int slot);
+
+  // helper function to print the state of the run loop (for debugging)
+  void debug_trace(const VMFrame& f) const;
+
+  // estimated bytes of a heap object holding the given number of
+  // elements (vm values by default)
+  static std::size_t object_bytes(std::size_t count,
+                                  std::size_t element_bytes = sizeof(VMValue));
+
+  // collect (mark and sweep) the objects not reachable from the stack
+  void collect();
+
+  // mark the object (if any) the value refers to, queueing it for
+  // scanning
+  void mark(const VMValue& value, std::unordered_set<int>& marked,
+            std::vector<int>& pending) const;
+
+  // replace the LOAD starting each common sequence of the frame's
+  // packed code with the superinstruction running the whole sequence
+  // (see op_code.h). The rest of the sequence stays in place, so jumps
+  // into it still work, and a superinstruction whose operands are not
+  // the expected types runs as the LOAD, continuing with the sequence.
+  void fuse(VMFrameInfo& frame);
+
+  // helper function to add a value to the constant pool
+  int add_constant(const VMValue& value);
+
+  // helper function to pretty print a packed instruction of a frame
+  std::string instr_string(const VMFrameInfo& frame, int pc) const;
+
 
 };
 
@@ -0,0 +1,34 @@
+//----------------------------------------------------------------------
+// FILE: vm_array.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Representation of unboxed (typed) array objects in the VM
+//----------------------------------------------------------------------
+
+#ifndef VM_ARRAY_H
+#define VM_ARRAY_H
+
+#include <vector>
+
+
+// The following is a plain-old-data class
+
+
+// An array of primitive elements stored contiguously as T values (e.g.,
+// std::int32_t for int arrays) instead of as vm values. Since MyPL
+// array elements can be null, a separate bitmap marks the null ones
+// (the element value is then unused).
+template<typename T>
+class VMTypedArray
+{
+public:
+
+  // the element values
+  std::vector<T> values;
+
+  // the null bit of each element
+  std::vector<bool> nulls;
+
+};
+
+#endif
@@ -9,8 +9,8 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
-#include <stack>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include "vm_instr.h"
 
@@ -28,9 +28,18 @@ public:
   // the number of parameters of the assocated function
   int arg_count; 
 
-  // the program instructions
+  // the number of local variables (including parameters), set by VM::link
+  int local_count = 0;
+
+  // the program instructions as generated (consumed by VM::link)
   std::vector<VMInstr> instructions;  
 
+  // the packed program instructions run by the VM (set by VM::link)
+  std::vector<VMCode> code;
+
+  // instruction comments by instruction index (set by VM::link)
+  std::unordered_map<int, std::string> comments;
+
 };
 
 
@@ -38,17 +47,15 @@ class VMFrame
 {
 public:
 
-  // the type of the current frame
-  VMFrameInfo info;
+  // the type of the current frame (shared, immutable function code)
+  const VMFrameInfo* info = nullptr;
   
   // the program counter
   int pc = 0;
 
-  // the internal memory of the function
-  std::vector<VMValue> variables;
-
-  // the operand stack
-  std::stack<VMValue> operand_stack;
+  // index in the VM value stack of the frame's first local variable
+  // (the frame's operands start after its local variables)
+  int base = 0;
 
 };
 
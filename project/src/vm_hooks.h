@@ -0,0 +1,57 @@
+//----------------------------------------------------------------------
+// FILE: vm_hooks.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Instrumentation points of the vm run loop
+//----------------------------------------------------------------------
+
+#ifndef VM_HOOKS_H
+#define VM_HOOKS_H
+
+#include <vector>
+#include "vm_frame.h"
+#include "vm_instr.h"
+
+
+// The run loop is a template over a hooks type, called for each
+// instruction executed and each function entered and left. These
+// default hooks do nothing, so a normal run compiles to a loop with
+// no instrumentation at all. Other hooks (VMProfiler, VMTracer)
+// provide the same (inline) member functions.
+class VMNoHooks
+{
+public:
+
+  // the frame's instruction (at pc - 1) is about to be executed, with
+  // the value stack as given and depth frames on the call stack
+  void instruction(const VMFrame& frame, const VMCode& instr,
+                   const std::vector<VMValue>& stack, int depth) {}
+
+  // the function (by index) is entered
+  void call(int function) {}
+
+  // the current function returns
+  void ret() {}
+
+  // the run ends (normally or with an error)
+  void finish() {}
+
+};
+
+
+// Hooks counting the instructions executed
+class VMCounter : public VMNoHooks
+{
+public:
+
+  long instructions = 0;
+
+  void instruction(const VMFrame& frame, const VMCode& instr,
+                   const std::vector<VMValue>& stack, int depth)
+  {
+    ++instructions;
+  }
+
+};
+
+#endif
@@ -0,0 +1,318 @@
+//----------------------------------------------------------------------
+// FILE: vm_image.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Binary images (.myplc files) of linked vm programs
+//----------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mypl_exception.h"
+#include "vm.h"
+#include "vm_image.h"
+
+using namespace std;
+
+// tags of the constant pool value kinds
+enum class ConstantKind : uint8_t {INT, DOUBLE, BOOL, CHAR, STRING,
+                                   NULLPTR};
+
+const char MAGIC[4] = {'M', 'Y', 'P', 'L'};
+const uint32_t OPCODE_COUNT = static_cast<uint32_t>(OpCode::NOP) + 1;
+
+
+// helper functions to append values to an image being written
+
+template<typename T>
+static void put(string& out, const T& value)
+{
+  out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void put_string(string& out, string_view s)
+{
+  put<uint32_t>(out, s.size());
+  out += s;
+}
+
+
+// Bounds-checked cursor over the bytes of an image being read
+class ImageReader
+{
+public:
+
+  ImageReader(const char* data, size_t size, const string& filename)
+    : pos(data), end(data + size), filename(filename) {}
+
+  template<typename T>
+  T get()
+  {
+    T value;
+    memcpy(&value, bytes(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  string get_string()
+  {
+    uint32_t size = get<uint32_t>();
+    return string(bytes(size), size);
+  }
+
+  // the next count bytes (moving past them)
+  const char* bytes(size_t count)
+  {
+    if (count > end - pos)
+      error("truncated");
+    const char* start = pos;
+    pos += count;
+    return start;
+  }
+
+  [[noreturn]] void error(const string& msg) const
+  {
+    throw MyPLException::VMError("invalid image '" + filename + "' (" +
+                                 msg + ")");
+  }
+
+private:
+
+  const char* pos;
+  const char* end;
+  const string& filename;
+
+};
+
+
+bool VMImage::is_image(const string& filename)
+{
+  return filename.ends_with(".myplc");
+}
+
+
+void VMImage::write(const VM& vm, const string& filename,
+                    const VMImageStats& stats)
+{
+  if (!vm.linked)
+    throw MyPLException::VMError("cannot write an unlinked program");
+  string out;
+  out.append(MAGIC, sizeof(MAGIC));
+  put<uint32_t>(out, VERSION);
+  put<uint32_t>(out, OPCODE_COUNT);
+  put<uint32_t>(out, vm.constants.size());
+  put<uint32_t>(out, vm.struct_info.size());
+  put<uint32_t>(out, vm.frame_info.size());
+  put<uint32_t>(out, stats.folded);
+  put<uint32_t>(out, stats.eliminated);
+
+  for (const VMValue& value : vm.constants) {
+    if (holds_alternative<int>(value)) {
+      put(out, ConstantKind::INT);
+      put<int32_t>(out, get<int>(value));
+    }
+    else if (holds_alternative<double>(value)) {
+      put(out, ConstantKind::DOUBLE);
+      put<double>(out, get<double>(value));
+    }
+    else if (holds_alternative<bool>(value)) {
+      put(out, ConstantKind::BOOL);
+      put<uint8_t>(out, get<bool>(value));
+    }
+    else if (holds_alternative<char>(value)) {
+      put(out, ConstantKind::CHAR);
+      put<char>(out, get<char>(value));
+    }
+    else if (holds_alternative<VMString>(value)) {
+      put(out, ConstantKind::STRING);
+      put_string(out, get<VMString>(value).view());
+    }
+    else
+      put(out, ConstantKind::NULLPTR);
+  }
+
+  for (const VMStructInfo& type : vm.struct_info) {
+    put_string(out, type.struct_name);
+    put<uint32_t>(out, type.field_names.size());
+    for (const string& field_name : type.field_names)
+      put_string(out, field_name);
+    put<uint32_t>(out, type.reference_slots.size());
+    for (int slot : type.reference_slots)
+      put<int32_t>(out, slot);
+  }
+
+  for (const VMFrameInfo& frame : vm.frame_info) {
+    put_string(out, frame.function_name);
+    put<int32_t>(out, frame.arg_count);
+    put<int32_t>(out, frame.local_count);
+    put<uint32_t>(out, frame.code.size());
+    out.append(reinterpret_cast<const char*>(frame.code.data()),
+               frame.code.size() * sizeof(VMCode));
+    put<uint32_t>(out, frame.comments.size());
+    for (const auto& [pc, comment] : frame.comments) {
+      put<int32_t>(out, pc);
+      put_string(out, comment);
+    }
+  }
+
+  ofstream file(filename, ios::binary | ios::trunc);
+  file.write(out.data(), out.size());
+  if (!file)
+    throw MyPLException::VMError("cannot write image '" + filename + "'");
+}
+
+
+VMImageStats VMImage::read(VM& vm, const string& filename)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  struct stat info;
+  if (fd < 0 or fstat(fd, &info) != 0) {
+    if (fd >= 0)
+      close(fd);
+    throw MyPLException::VMError("cannot open image '" + filename + "'");
+  }
+  size_t size = info.st_size;
+  void* data = size > 0 ?
+    mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (data == MAP_FAILED)
+    throw MyPLException::VMError("cannot read image '" + filename + "'");
+
+  // the mapping is only needed while loading
+  struct Unmap {
+    void* data;
+    size_t size;
+    ~Unmap() { munmap(data, size); }
+  } unmap {data, size};
+
+  ImageReader in(static_cast<const char*>(data), size, filename);
+  if (memcmp(in.bytes(sizeof(MAGIC)), MAGIC, sizeof(MAGIC)) != 0)
+    in.error("not a mypl image");
+  if (in.get<uint32_t>() != VERSION or in.get<uint32_t>() != OPCODE_COUNT)
+    in.error("built by a different version");
+  uint32_t constant_count = in.get<uint32_t>();
+  uint32_t struct_count = in.get<uint32_t>();
+  uint32_t function_count = in.get<uint32_t>();
+  VMImageStats stats;
+  stats.folded = in.get<uint32_t>();
+  stats.eliminated = in.get<uint32_t>();
+
+  // the vm is only changed once the whole image has been read
+  vector<VMValue> constants;
+  vector<VMStructInfo> structs;
+  vector<VMFrameInfo> frames;
+  for (uint32_t i = 0; i < constant_count; ++i) {
+    ConstantKind kind = in.get<ConstantKind>();
+    if (kind == ConstantKind::INT)
+      constants.push_back(in.get<int32_t>());
+    else if (kind == ConstantKind::DOUBLE)
+      constants.push_back(in.get<double>());
+    else if (kind == ConstantKind::BOOL)
+      constants.push_back(in.get<uint8_t>() != 0);
+    else if (kind == ConstantKind::CHAR)
+      constants.push_back(in.get<char>());
+    else if (kind == ConstantKind::STRING) {
+      VMString literal = in.get_string();
+      literal.freeze();
+      constants.push_back(literal);
+    }
+    else if (kind == ConstantKind::NULLPTR)
+      constants.push_back(nullptr);
+    else
+      in.error("bad constant");
+  }
+
+  // the most fields of any struct (the struct a field instruction
+  // applies to is only known at run time)
+  uint32_t max_field_count = 0;
+  for (uint32_t i = 0; i < struct_count; ++i) {
+    VMStructInfo type;
+    type.struct_name = in.get_string();
+    uint32_t field_count = in.get<uint32_t>();
+    for (uint32_t j = 0; j < field_count; ++j)
+      type.field_names.push_back(in.get_string());
+    uint32_t slot_count = in.get<uint32_t>();
+    for (uint32_t j = 0; j < slot_count; ++j) {
+      int32_t slot = in.get<int32_t>();
+      if (slot < 0 or slot >= field_count)
+        in.error("bad reference slot");
+      type.reference_slots.push_back(slot);
+    }
+    max_field_count = max(max_field_count, field_count);
+    structs.push_back(type);
+  }
+
+  // true if the instruction pushes an int constant
+  auto push_int = [&](const VMCode& code) {
+    return code.opcode == OpCode::PUSH and
+      static_cast<uint32_t>(code.arg) < constant_count and
+      holds_alternative<int>(constants[code.arg]);
+  };
+
+  for (uint32_t i = 0; i < function_count; ++i) {
+    VMFrameInfo frame;
+    frame.function_name = in.get_string();
+    frame.arg_count = in.get<int32_t>();
+    frame.local_count = in.get<int32_t>();
+    if (frame.arg_count < 0 or frame.arg_count > frame.local_count)
+      in.error("bad local count");
+    uint32_t code_count = in.get<uint32_t>();
+    const char* code = in.bytes(code_count * sizeof(VMCode));
+    frame.code.resize(code_count);
+    memcpy(frame.code.data(), code, code_count * sizeof(VMCode));
+    // operands index the tables just read, and a superinstruction is
+    // followed by the rest of the sequence it reads its operands from
+    // (checked once, here, so the run loop can index without bounds
+    // checks; a negative operand is out of range as a uint32)
+    auto next = [&](uint32_t pc) {
+      return pc < code_count ? frame.code[pc] : VMCode {};
+    };
+    for (uint32_t pc = 0; pc < code_count; ++pc) {
+      const VMCode& code = frame.code[pc];
+      if (static_cast<uint32_t>(code.opcode) >= OPCODE_COUNT)
+        in.error("bad opcode");
+      OpCode op = code.opcode;
+      uint32_t arg = code.arg;
+      if ((operand_kind(op) == OperandKind::CONSTANT and
+           arg >= constant_count) or
+          (op == OpCode::CALL and arg >= function_count) or
+          (op == OpCode::ALLOCS and arg >= struct_count) or
+          ((op == OpCode::JMP or op == OpCode::JMPF) and arg > code_count) or
+          ((op == OpCode::ADDF or op == OpCode::SETF or
+            op == OpCode::GETF) and arg >= max_field_count) or
+          ((unfused(op) == OpCode::LOAD or op == OpCode::STORE) and
+           arg >= frame.local_count))
+        in.error("bad operand");
+      bool complete = true;
+      if (op == OpCode::LOAD_GETF)
+        complete = next(pc + 1).opcode == OpCode::GETF;
+      else if (op == OpCode::INC_LOCAL or op == OpCode::LOAD_ADD_CONST or
+               op == OpCode::LOAD_SUB_CONST)
+        complete = push_int(next(pc + 1));
+      else if (unfused(op) == OpCode::LOAD and op != OpCode::LOAD)
+        complete = push_int(next(pc + 1)) and
+          next(pc + 3).opcode == OpCode::JMPF;
+      if (!complete)
+        in.error("bad superinstruction");
+    }
+    uint32_t comment_count = in.get<uint32_t>();
+    for (uint32_t j = 0; j < comment_count; ++j) {
+      int pc = in.get<int32_t>();
+      if (pc < 0 or pc >= code_count)
+        in.error("bad comment");
+      frame.comments[pc] = in.get_string();
+    }
+    frames.push_back(frame);
+  }
+
+  vm.constants = constants;
+  for (const VMStructInfo& type : structs)
+    vm.add(type);
+  for (const VMFrameInfo& frame : frames)
+    vm.add(frame);
+  vm.linked = true;
+  return stats;
+}
@@ -0,0 +1,68 @@
+//----------------------------------------------------------------------
+// FILE: vm_image.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Binary images (.myplc files) of linked vm programs
+//----------------------------------------------------------------------
+
+#ifndef VM_IMAGE_H
+#define VM_IMAGE_H
+
+#include <cstdint>
+#include <string>
+
+class VM;
+
+
+// Optimizer counts of the compilation an image holds (so a compile
+// cache hit reports them as the compilation did)
+class VMImageStats
+{
+public:
+  std::uint32_t folded = 0;
+  std::uint32_t eliminated = 0;
+};
+
+
+// Saves a linked program (its functions with their packed code, the
+// constant pool, and the struct descriptors) so it can later be run
+// without the front end. An image is laid out as
+//
+//   header     "MYPL", format version, opcode count, the number of
+//              constants, structs, and functions, and the optimizer
+//              counts (all uint32)
+//   constants  kind byte (int, double, bool, string, null) + value
+//   structs    name, field names, reference slots
+//   functions  name, arg count, local count, packed code (VMCode
+//              array), and comments (pc + text)
+//
+// with strings stored as a uint32 length followed by their bytes and
+// all numbers in host byte order. Reading maps the file into memory.
+class VMImage
+{
+public:
+
+  // write the (linked) program of the vm to the file, with the
+  // optimizer counts of its compilation
+  static void write(const VM& vm, const std::string& filename,
+                    const VMImageStats& stats = {});
+
+  // load the program in the file into the (empty) vm, leaving it
+  // linked and ready to run (throws a MyPLException if the file is not
+  // a valid image of this version or its operands are out of range;
+  // how the code uses the stack and the types of the values on it are
+  // not checked, so the code is only as safe as the compiler that
+  // wrote it), returning the optimizer counts it was written with
+  static VMImageStats read(VM& vm, const std::string& filename);
+
+  // true if the file name has the image extension (.myplc)
+  static bool is_image(const std::string& filename);
+
+private:
+
+  // bump whenever the layout or the meaning of the opcodes changes
+  static constexpr std::uint32_t VERSION = 4;
+
+};
+
+#endif
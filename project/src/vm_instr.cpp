@@ -6,6 +6,9 @@
 //----------------------------------------------------------------------
 
 
+#include <cctype>
+#include <charconv>
+#include <cmath>
 #include <unordered_map>
 #include "vm_instr.h"
 
@@ -28,7 +31,7 @@ void VMInstr::set_comment(const std::string& comment)
 }
 
 
-std::string VMInstr::comment() const
+const std::string& VMInstr::comment() const
 {
   return instr_comment;
 }
@@ -40,7 +43,7 @@ OpCode VMInstr::opcode() const
 }
 
 
-std::optional<VMValue> VMInstr::operand() const
+const std::optional<VMValue>& VMInstr::operand() const
 {
   return instr_operand;
 }
@@ -154,6 +157,198 @@ VMInstr VMInstr::CMPNE()
 }
 
 
+VMInstr VMInstr::ADD_INT()
+{
+  return VMInstr(OpCode::ADD_INT);
+}
+
+
+VMInstr VMInstr::ADD_DBL()
+{
+  return VMInstr(OpCode::ADD_DBL);
+}
+
+
+VMInstr VMInstr::SUB_INT()
+{
+  return VMInstr(OpCode::SUB_INT);
+}
+
+
+VMInstr VMInstr::SUB_DBL()
+{
+  return VMInstr(OpCode::SUB_DBL);
+}
+
+
+VMInstr VMInstr::MUL_INT()
+{
+  return VMInstr(OpCode::MUL_INT);
+}
+
+
+VMInstr VMInstr::MUL_DBL()
+{
+  return VMInstr(OpCode::MUL_DBL);
+}
+
+
+VMInstr VMInstr::DIV_INT()
+{
+  return VMInstr(OpCode::DIV_INT);
+}
+
+
+VMInstr VMInstr::DIV_DBL()
+{
+  return VMInstr(OpCode::DIV_DBL);
+}
+
+
+VMInstr VMInstr::CMPLT_INT()
+{
+  return VMInstr(OpCode::CMPLT_INT);
+}
+
+
+VMInstr VMInstr::CMPLT_DBL()
+{
+  return VMInstr(OpCode::CMPLT_DBL);
+}
+
+
+VMInstr VMInstr::CMPLT_STR()
+{
+  return VMInstr(OpCode::CMPLT_STR);
+}
+
+
+VMInstr VMInstr::CMPLT_CHR()
+{
+  return VMInstr(OpCode::CMPLT_CHR);
+}
+
+
+VMInstr VMInstr::CMPLE_INT()
+{
+  return VMInstr(OpCode::CMPLE_INT);
+}
+
+
+VMInstr VMInstr::CMPLE_DBL()
+{
+  return VMInstr(OpCode::CMPLE_DBL);
+}
+
+
+VMInstr VMInstr::CMPLE_STR()
+{
+  return VMInstr(OpCode::CMPLE_STR);
+}
+
+
+VMInstr VMInstr::CMPLE_CHR()
+{
+  return VMInstr(OpCode::CMPLE_CHR);
+}
+
+
+VMInstr VMInstr::CMPGT_INT()
+{
+  return VMInstr(OpCode::CMPGT_INT);
+}
+
+
+VMInstr VMInstr::CMPGT_DBL()
+{
+  return VMInstr(OpCode::CMPGT_DBL);
+}
+
+
+VMInstr VMInstr::CMPGT_STR()
+{
+  return VMInstr(OpCode::CMPGT_STR);
+}
+
+
+VMInstr VMInstr::CMPGT_CHR()
+{
+  return VMInstr(OpCode::CMPGT_CHR);
+}
+
+
+VMInstr VMInstr::CMPGE_INT()
+{
+  return VMInstr(OpCode::CMPGE_INT);
+}
+
+
+VMInstr VMInstr::CMPGE_DBL()
+{
+  return VMInstr(OpCode::CMPGE_DBL);
+}
+
+
+VMInstr VMInstr::CMPGE_STR()
+{
+  return VMInstr(OpCode::CMPGE_STR);
+}
+
+
+VMInstr VMInstr::CMPGE_CHR()
+{
+  return VMInstr(OpCode::CMPGE_CHR);
+}
+
+
+VMInstr VMInstr::CMPEQ_INT()
+{
+  return VMInstr(OpCode::CMPEQ_INT);
+}
+
+
+VMInstr VMInstr::CMPEQ_DBL()
+{
+  return VMInstr(OpCode::CMPEQ_DBL);
+}
+
+
+VMInstr VMInstr::CMPEQ_STR()
+{
+  return VMInstr(OpCode::CMPEQ_STR);
+}
+
+
+VMInstr VMInstr::CMPEQ_CHR()
+{
+  return VMInstr(OpCode::CMPEQ_CHR);
+}
+
+
+VMInstr VMInstr::CMPNE_INT()
+{
+  return VMInstr(OpCode::CMPNE_INT);
+}
+
+
+VMInstr VMInstr::CMPNE_DBL()
+{
+  return VMInstr(OpCode::CMPNE_DBL);
+}
+
+
+VMInstr VMInstr::CMPNE_STR()
+{
+  return VMInstr(OpCode::CMPNE_STR);
+}
+
+
+VMInstr VMInstr::CMPNE_CHR()
+{
+  return VMInstr(OpCode::CMPNE_CHR);
+}
+
+
 VMInstr VMInstr::JMP(int instruction_index)
 {
   return VMInstr(OpCode::JMP, instruction_index);
@@ -232,9 +427,9 @@ VMInstr VMInstr::CONCAT()
 }
 
 
-VMInstr VMInstr::ALLOCS()
+VMInstr VMInstr::ALLOCS(const string& struct_name)
 {
-  return VMInstr(OpCode::ALLOCS);  
+  return VMInstr(OpCode::ALLOCS, struct_name);  
 }
 
 
@@ -244,21 +439,21 @@ VMInstr VMInstr::ALLOCA()
 }
 
 
-VMInstr VMInstr::ADDF(const string& field)
+VMInstr VMInstr::ADDF(int slot)
 {
-  return VMInstr(OpCode::ADDF, field);
+  return VMInstr(OpCode::ADDF, slot);
 }
 
 
-VMInstr VMInstr::SETF(const string& field)
+VMInstr VMInstr::SETF(int slot)
 {
-  return VMInstr(OpCode::SETF, field);      
+  return VMInstr(OpCode::SETF, slot);      
 }
 
 
-VMInstr VMInstr::GETF(const string& field)
+VMInstr VMInstr::GETF(int slot)
 {
-  return VMInstr(OpCode::GETF, field);
+  return VMInstr(OpCode::GETF, slot);
 }
 
 
@@ -274,6 +469,60 @@ VMInstr VMInstr::GETI()
 }  
 
 
+VMInstr VMInstr::ALLOCA_INT()
+{
+  return VMInstr(OpCode::ALLOCA_INT);
+}
+
+
+VMInstr VMInstr::ALLOCA_DBL()
+{
+  return VMInstr(OpCode::ALLOCA_DBL);
+}
+
+
+VMInstr VMInstr::ALLOCA_BOOL()
+{
+  return VMInstr(OpCode::ALLOCA_BOOL);
+}
+
+
+VMInstr VMInstr::SETI_INT()
+{
+  return VMInstr(OpCode::SETI_INT);
+}
+
+
+VMInstr VMInstr::SETI_DBL()
+{
+  return VMInstr(OpCode::SETI_DBL);
+}
+
+
+VMInstr VMInstr::SETI_BOOL()
+{
+  return VMInstr(OpCode::SETI_BOOL);
+}
+
+
+VMInstr VMInstr::GETI_INT()
+{
+  return VMInstr(OpCode::GETI_INT);
+}
+
+
+VMInstr VMInstr::GETI_DBL()
+{
+  return VMInstr(OpCode::GETI_DBL);
+}
+
+
+VMInstr VMInstr::GETI_BOOL()
+{
+  return VMInstr(OpCode::GETI_BOOL);
+}
+
+
 VMInstr VMInstr::DUP()
 {
   return VMInstr(OpCode::DUP);      
@@ -287,24 +536,92 @@ VMInstr VMInstr::NOP()
 
 
 string to_string(const VMValue& val) {
-  if (holds_alternative<int>(val))
-    return to_string(get<int>(val));
-  else if (holds_alternative<double>(val))
-    return to_string(get<double>(val));
+  // numbers are formatted in place (doubles as with %f)
+  char buffer[512];
+  if (holds_alternative<int>(val)) {
+    to_chars_result r = to_chars(begin(buffer), end(buffer), get<int>(val));
+    return string(buffer, r.ptr);
+  }
+  else if (holds_alternative<double>(val)) {
+    to_chars_result r = to_chars(begin(buffer), end(buffer),
+                                 get<double>(val), chars_format::fixed, 6);
+    return string(buffer, r.ptr);
+  }
   else if (holds_alternative<bool>(val) and get<bool>(val))
     return "true";
   else if (holds_alternative<bool>(val) and !get<bool>(val))
     return "false";
-  else if (holds_alternative<string>(val))
-    return get<string>(val);
+  else if (holds_alternative<char>(val))
+    return string(1, get<char>(val));
+  else if (holds_alternative<VMString>(val))
+    return get<VMString>(val).str();
   else
     return "null";
 }
 
 
-std::string to_string(const VMInstr& instr)
+// helper function to skip the leading whitespace (as strtol does)
+static const char* skip_space(const char* first, const char* last)
+{
+  while (first != last and isspace(static_cast<unsigned char>(*first)))
+    ++first;
+  return first;
+}
+
+
+bool parse_int(string_view s, int& value)
 {
-  std::unordered_map<OpCode, string> os = {
+  const char* last = s.data() + s.size();
+  const char* first = skip_space(s.data(), last);
+  // from_chars takes a minus sign but not a plus sign
+  if (first != last and *first == '+') {
+    ++first;
+    if (first != last and *first == '-')
+      return false;
+  }
+  return from_chars(first, last, value).ec == errc();
+}
+
+
+bool parse_double(string_view s, double& value)
+{
+  const char* last = s.data() + s.size();
+  const char* first = skip_space(s.data(), last);
+  bool negative = first != last and *first == '-';
+  if (first != last and (*first == '+' or *first == '-')) {
+    ++first;
+    if (first != last and (*first == '+' or *first == '-'))
+      return false;
+  }
+  // hex floats have a 0x prefix (not taken by from_chars)
+  chars_format format = chars_format::general;
+  if (last - first > 1 and first[0] == '0' and
+      (first[1] == 'x' or first[1] == 'X')) {
+    first += 2;
+    format = chars_format::hex;
+  }
+  double result = 0.0;
+  errc ec = errc::invalid_argument;
+  if (first != last and *first != '+' and *first != '-')
+    ec = from_chars(first, last, result, format).ec;
+  // a 0x prefix without hex digits is read as just the 0
+  if (ec == errc::invalid_argument and format == chars_format::hex) {
+    ec = errc();
+    result = 0.0;
+  }
+  if (ec != errc())
+    return false;
+  // stod also rejects results too small for a normal double
+  if (fpclassify(result) == FP_SUBNORMAL)
+    return false;
+  value = negative ? -result : result;
+  return true;
+}
+
+
+std::string to_string(OpCode op)
+{
+  static const std::unordered_map<OpCode, string> os = {
     {OpCode::PUSH, "PUSH"}, {OpCode::POP, "POP"},
     {OpCode::LOAD, "LOAD"}, {OpCode::STORE, "STORE"},
     {OpCode::ADD, "ADD"}, {OpCode::SUB, "SUB"},
@@ -313,7 +630,24 @@ std::string to_string(const VMInstr& instr)
     {OpCode::NOT, "NOT"}, {OpCode::CMPLT, "CMPLT"},
     {OpCode::CMPLE, "CMPLE"}, {OpCode::CMPGT, "CMPGT"},
     {OpCode::CMPGE, "CMPGE"}, {OpCode::CMPEQ, "CMPEQ"}, 
-    {OpCode::CMPNE, "CMPNE"}, {OpCode::JMP, "JMP"},
+    {OpCode::CMPNE, "CMPNE"},
+    {OpCode::ADD_INT, "ADD_INT"}, {OpCode::ADD_DBL, "ADD_DBL"},
+    {OpCode::SUB_INT, "SUB_INT"}, {OpCode::SUB_DBL, "SUB_DBL"},
+    {OpCode::MUL_INT, "MUL_INT"}, {OpCode::MUL_DBL, "MUL_DBL"},
+    {OpCode::DIV_INT, "DIV_INT"}, {OpCode::DIV_DBL, "DIV_DBL"},
+    {OpCode::CMPLT_INT, "CMPLT_INT"}, {OpCode::CMPLT_DBL, "CMPLT_DBL"},
+    {OpCode::CMPLT_STR, "CMPLT_STR"}, {OpCode::CMPLE_INT, "CMPLE_INT"},
+    {OpCode::CMPLE_DBL, "CMPLE_DBL"}, {OpCode::CMPLE_STR, "CMPLE_STR"},
+    {OpCode::CMPGT_INT, "CMPGT_INT"}, {OpCode::CMPGT_DBL, "CMPGT_DBL"},
+    {OpCode::CMPGT_STR, "CMPGT_STR"}, {OpCode::CMPGE_INT, "CMPGE_INT"},
+    {OpCode::CMPGE_DBL, "CMPGE_DBL"}, {OpCode::CMPGE_STR, "CMPGE_STR"},
+    {OpCode::CMPEQ_INT, "CMPEQ_INT"}, {OpCode::CMPEQ_DBL, "CMPEQ_DBL"},
+    {OpCode::CMPEQ_STR, "CMPEQ_STR"}, {OpCode::CMPNE_INT, "CMPNE_INT"},
+    {OpCode::CMPNE_DBL, "CMPNE_DBL"}, {OpCode::CMPNE_STR, "CMPNE_STR"},
+    {OpCode::CMPLT_CHR, "CMPLT_CHR"}, {OpCode::CMPLE_CHR, "CMPLE_CHR"},
+    {OpCode::CMPGT_CHR, "CMPGT_CHR"}, {OpCode::CMPGE_CHR, "CMPGE_CHR"},
+    {OpCode::CMPEQ_CHR, "CMPEQ_CHR"}, {OpCode::CMPNE_CHR, "CMPNE_CHR"},
+    {OpCode::JMP, "JMP"},
     {OpCode::JMPF, "JMPF"}, {OpCode::CALL, "CALL"},
     {OpCode::RET, "RET"}, {OpCode::WRITE, "WRITE"},
     {OpCode::READ, "READ"}, {OpCode::SLEN, "SLEN"},
@@ -323,18 +657,77 @@ std::string to_string(const VMInstr& instr)
     {OpCode::ALLOCS, "ALLOCS"}, {OpCode::ALLOCA, "ALLOCA"},
     {OpCode::ADDF, "ADDF"}, {OpCode::GETF, "GETF"},
     {OpCode::SETF, "SETF"}, {OpCode::GETI, "GETI"},
-    {OpCode::SETI, "SETI"}, {OpCode::DUP, "DUP"},
+    {OpCode::ALLOCA_INT, "ALLOCA_INT"}, {OpCode::ALLOCA_DBL, "ALLOCA_DBL"},
+    {OpCode::ALLOCA_BOOL, "ALLOCA_BOOL"}, {OpCode::SETI_INT, "SETI_INT"},
+    {OpCode::SETI_DBL, "SETI_DBL"}, {OpCode::SETI_BOOL, "SETI_BOOL"},
+    {OpCode::GETI_INT, "GETI_INT"}, {OpCode::GETI_DBL, "GETI_DBL"},
+    {OpCode::GETI_BOOL, "GETI_BOOL"},
+    {OpCode::SETI, "SETI"},
+    {OpCode::INC_LOCAL, "INC_LOCAL"},
+    {OpCode::LOAD_ADD_CONST, "LOAD_ADD_CONST"},
+    {OpCode::LOAD_SUB_CONST, "LOAD_SUB_CONST"},
+    {OpCode::LOAD_GETF, "LOAD_GETF"},
+    {OpCode::JMP_IF_LOCAL_GE_CONST, "JMP_IF_LOCAL_GE_CONST"},
+    {OpCode::JMP_IF_LOCAL_GT_CONST, "JMP_IF_LOCAL_GT_CONST"},
+    {OpCode::JMP_IF_LOCAL_LE_CONST, "JMP_IF_LOCAL_LE_CONST"},
+    {OpCode::JMP_IF_LOCAL_LT_CONST, "JMP_IF_LOCAL_LT_CONST"},
+    {OpCode::DUP, "DUP"},
     {OpCode::NOP, "NOP"}
   };
+  return os.at(op);
+}
+
+
+OperandKind operand_kind(OpCode op)
+{
+  switch (op) {
+  case OpCode::LOAD:
+  case OpCode::STORE:
+  case OpCode::JMP:
+  case OpCode::JMPF:
+  case OpCode::CALL:
+  case OpCode::ALLOCS:
+  case OpCode::ADDF:
+  case OpCode::SETF:
+  case OpCode::GETF:
+    return OperandKind::IMMEDIATE;
+  case OpCode::PUSH:
+    return OperandKind::CONSTANT;
+  default:
+    // superinstructions take the operand of their LOAD
+    return unfused(op) == OpCode::LOAD ? OperandKind::IMMEDIATE :
+      OperandKind::NONE;
+  }
+}
+
+
+OpCode unfused(OpCode op)
+{
+  switch (op) {
+  case OpCode::INC_LOCAL:
+  case OpCode::LOAD_ADD_CONST:
+  case OpCode::LOAD_SUB_CONST:
+  case OpCode::LOAD_GETF:
+  case OpCode::JMP_IF_LOCAL_GE_CONST:
+  case OpCode::JMP_IF_LOCAL_GT_CONST:
+  case OpCode::JMP_IF_LOCAL_LE_CONST:
+  case OpCode::JMP_IF_LOCAL_LT_CONST:
+    return OpCode::LOAD;
+  default:
+    return op;
+  }
+}
+
+
+std::string to_string(const VMInstr& instr)
+{
   string vstr = "";
   if (instr.operand().has_value()) {
     vstr = to_string(instr.operand().value());
   }
-  string s = os[instr.opcode()] + "(" + vstr + ")";
+  string s = to_string(instr.opcode()) + "(" + vstr + ")";
   if (instr.instr_comment != "")
     s += "  // " + instr.instr_comment;
   return s;
 }
 
-  
-
@@ -9,18 +9,59 @@
 #ifndef VM_INSTR_H
 #define VM_INSTR_H
 
+#include <cstdint>
 #include <variant>
 #include <optional>
 #include <string>
 #include "op_code.h"
+#include "vm_string.h"
 
 
-// vm values are one of int, double, bool, string, or nullptr_t
-typedef std::variant<int, double, bool, std::string, std::nullptr_t> VMValue;
+// vm values are one of int, double, bool, char, string, or nullptr_t
+typedef std::variant<int, double, bool, char, VMString, std::nullptr_t>
+  VMValue;
 
 // function to get a string representation of a vm_value
 std::string to_string(const VMValue& val);
 
+// functions to parse the text accepted by stoi and stod (leading
+// whitespace, an optional sign, and any trailing characters), returning
+// false instead of throwing when there is no number or it is out of
+// range
+bool parse_int(std::string_view s, int& value);
+bool parse_double(std::string_view s, double& value);
+
+// function to get the name of an opcode
+std::string to_string(OpCode op);
+
+
+// how the operand of an instruction is stored once packed
+enum class OperandKind {
+  NONE,         // the instruction has no operand
+  IMMEDIATE,    // an int stored directly (address, index, or count)
+  CONSTANT      // a value stored in the program's constant pool
+};
+
+// returns the kind of operand an instruction with the opcode takes
+OperandKind operand_kind(OpCode op);
+
+// returns the opcode of the instruction a superinstruction replaced
+// (the first of its sequence), or the opcode itself for others
+OpCode unfused(OpCode op);
+
+
+// Packed (plain-old-data) form of an instruction executed by the VM:
+// an opcode byte plus either a 32-bit immediate or a constant pool
+// index, depending on the operand kind of the opcode. Comments are
+// kept in a side table of the frame info.
+struct VMCode
+{
+  OpCode opcode = OpCode::NOP;
+  std::int32_t arg = 0;
+};
+
+static_assert(sizeof(VMCode) == 8, "packed instructions should be 8 bytes");
+
 
 class VMInstr
 {
@@ -44,6 +85,38 @@ public:
   static VMInstr CMPGE();
   static VMInstr CMPEQ();
   static VMInstr CMPNE();
+  static VMInstr ADD_INT();
+  static VMInstr ADD_DBL();
+  static VMInstr SUB_INT();
+  static VMInstr SUB_DBL();
+  static VMInstr MUL_INT();
+  static VMInstr MUL_DBL();
+  static VMInstr DIV_INT();
+  static VMInstr DIV_DBL();
+  static VMInstr CMPLT_INT();
+  static VMInstr CMPLT_DBL();
+  static VMInstr CMPLT_STR();
+  static VMInstr CMPLT_CHR();
+  static VMInstr CMPLE_INT();
+  static VMInstr CMPLE_DBL();
+  static VMInstr CMPLE_STR();
+  static VMInstr CMPLE_CHR();
+  static VMInstr CMPGT_INT();
+  static VMInstr CMPGT_DBL();
+  static VMInstr CMPGT_STR();
+  static VMInstr CMPGT_CHR();
+  static VMInstr CMPGE_INT();
+  static VMInstr CMPGE_DBL();
+  static VMInstr CMPGE_STR();
+  static VMInstr CMPGE_CHR();
+  static VMInstr CMPEQ_INT();
+  static VMInstr CMPEQ_DBL();
+  static VMInstr CMPEQ_STR();
+  static VMInstr CMPEQ_CHR();
+  static VMInstr CMPNE_INT();
+  static VMInstr CMPNE_DBL();
+  static VMInstr CMPNE_STR();
+  static VMInstr CMPNE_CHR();
   static VMInstr JMP(int instruction_index);
   static VMInstr JMPF(int instruction_index);
   static VMInstr CALL(const std::string& function);
@@ -57,13 +130,22 @@ public:
   static VMInstr TODBL();  
   static VMInstr TOSTR();
   static VMInstr CONCAT();
-  static VMInstr ALLOCS();
+  static VMInstr ALLOCS(const std::string& struct_name);
   static VMInstr ALLOCA();
-  static VMInstr ADDF(const std::string& field);
-  static VMInstr SETF(const std::string& field);
-  static VMInstr GETF(const std::string& field);
+  static VMInstr ADDF(int slot);
+  static VMInstr SETF(int slot);
+  static VMInstr GETF(int slot);
   static VMInstr SETI();
   static VMInstr GETI();  
+  static VMInstr ALLOCA_INT();
+  static VMInstr ALLOCA_DBL();
+  static VMInstr ALLOCA_BOOL();
+  static VMInstr SETI_INT();
+  static VMInstr SETI_DBL();
+  static VMInstr SETI_BOOL();
+  static VMInstr GETI_INT();
+  static VMInstr GETI_DBL();
+  static VMInstr GETI_BOOL();
   static VMInstr DUP();
   static VMInstr NOP();
 
@@ -71,13 +153,13 @@ public:
   void set_comment(const std::string& comment);
 
   // returns the comment or empty string if no comment has been set
-  std::string comment() const;
+  const std::string& comment() const;
 
   // returns the instruction's opcode
   OpCode opcode() const;
 
   // returns the operand for those instructions with operands
-  std::optional<VMValue> operand() const;
+  const std::optional<VMValue>& operand() const;
 
   // set the operand value
   void set_operand(VMValue value);
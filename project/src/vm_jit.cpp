@@ -0,0 +1,756 @@
+//----------------------------------------------------------------------
+// FILE: vm_jit.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Implementation of the baseline x86-64 compiler for vm functions
+//----------------------------------------------------------------------
+
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <utility>
+#include "vm_jit.h"
+#include "vm.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define VM_JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+
+VMJit::VMJit(VM& vm)
+  : vm(vm)
+{
+}
+
+
+VMJit::~VMJit()
+{
+#ifdef VM_JIT_X86_64
+  for (NativeCode& native : functions)
+    if (native.memory)
+      munmap(native.memory, native.size);
+#endif
+}
+
+
+bool VMJit::supported()
+{
+#ifdef VM_JIT_X86_64
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+bool VMJit::hot(int function)
+{
+  if (functions.size() <= function)
+    functions.resize(vm.frame_info.size());
+  NativeCode& native = functions[function];
+  if (native.heat < HOT_THRESHOLD and ++native.heat == HOT_THRESHOLD)
+    compile(function);
+  return native.memory != nullptr;
+}
+
+
+bool VMJit::compiled(int function) const
+{
+  return function < functions.size() and functions[function].memory;
+}
+
+
+int VMJit::enter(int function, int pc)
+{
+  const NativeCode& native = functions[function];
+  auto run = reinterpret_cast<int (*)(VM*, const void*)>(native.memory);
+  const char* start = static_cast<const char*>(native.memory);
+  int result = run(&vm, start + native.entries[pc]);
+  if (result < 0) {
+    exception_ptr raised = error;
+    error = nullptr;
+    rethrow_exception(raised);
+  }
+  return result;
+}
+
+
+//----------------------------------------------------------------------
+// Code generation
+//----------------------------------------------------------------------
+
+#ifdef VM_JIT_X86_64
+
+// growable buffer of x86-64 machine code
+class CodeBuffer
+{
+public:
+
+  void bytes(initializer_list<uint8_t> values)
+  {
+    code.insert(code.end(), values);
+  }
+
+  void imm32(int32_t value)
+  {
+    uint8_t raw[4];
+    memcpy(raw, &value, 4);
+    code.insert(code.end(), raw, raw + 4);
+  }
+
+  void imm64(uint64_t value)
+  {
+    uint8_t raw[8];
+    memcpy(raw, &value, 8);
+    code.insert(code.end(), raw, raw + 8);
+  }
+
+  // write the 32-bit displacement at the given offset to reach target
+  void patch(size_t at, size_t target)
+  {
+    int32_t rel = static_cast<int32_t>(target - (at + 4));
+    memcpy(code.data() + at, &rel, 4);
+  }
+
+  size_t size() const
+  {
+    return code.size();
+  }
+
+  vector<uint8_t> code;
+
+};
+
+
+void VMJit::compile(int function)
+{
+  const vector<VMCode>& code = vm.frame_info[function].code;
+  const Helper* table = helpers();
+  NativeCode& native = functions[function];
+  CodeBuffer buf;
+
+  // entry: native(vm, address) saves rbx, keeps the vm in it, and
+  // jumps to the address of the first instruction to run
+  buf.bytes({0x53, 0x48, 0x89, 0xfb, 0xff, 0xe6});
+  // exit: restore rbx and return eax
+  size_t exit = buf.size();
+  buf.bytes({0x5b, 0xc3});
+  // error exit: return -1
+  size_t error_exit = buf.size();
+  buf.bytes({0xb8});
+  buf.imm32(-1);
+  buf.bytes({0xe9});
+  buf.imm32(0);
+  buf.patch(buf.size() - 4, exit);
+
+  // leave the native code returning the pc to resume at
+  auto leave = [&](int pc) {
+    buf.bytes({0xb8});
+    buf.imm32(pc);
+    buf.bytes({0xe9});
+    buf.imm32(0);
+    buf.patch(buf.size() - 4, exit);
+  };
+
+  // jumps to patch once every instruction's offset is known
+  vector<pair<size_t, int>> jumps;
+
+  native.entries.resize(code.size() + 1);
+  for (int pc = 0; pc < code.size(); ++pc) {
+    // superinstructions are compiled as the instruction they replaced
+    // (the rest of their sequence follows)
+    VMCode instr = code[pc];
+    instr.opcode = unfused(instr.opcode);
+    native.entries[pc] = buf.size();
+    if (instr.opcode == OpCode::NOP)
+      continue;
+    if (instr.opcode == OpCode::JMP) {
+      // jmp rel32
+      buf.bytes({0xe9});
+      jumps.push_back({buf.size(), instr.arg});
+      buf.imm32(0);
+      continue;
+    }
+    if (instr.opcode == OpCode::CALL or instr.opcode == OpCode::RET) {
+      // the vm switches frames
+      leave(pc);
+      continue;
+    }
+    // mov rdi, rbx; mov esi, arg; mov edx, pc; mov rax, helper; call rax
+    buf.bytes({0x48, 0x89, 0xdf, 0xbe});
+    buf.imm32(instr.arg);
+    buf.bytes({0xba});
+    buf.imm32(pc);
+    buf.bytes({0x48, 0xb8});
+    buf.imm64(reinterpret_cast<uint64_t>(table[static_cast<int>(instr.opcode)]));
+    buf.bytes({0xff, 0xd0});
+    // test eax, eax
+    buf.bytes({0x85, 0xc0});
+    if (instr.opcode == OpCode::JMPF) {
+      // js error_exit; jz target (the helper returns the condition)
+      buf.bytes({0x0f, 0x88});
+      buf.imm32(0);
+      buf.patch(buf.size() - 4, error_exit);
+      buf.bytes({0x0f, 0x84});
+      jumps.push_back({buf.size(), instr.arg});
+      buf.imm32(0);
+    }
+    else {
+      // jnz error_exit
+      buf.bytes({0x0f, 0x85});
+      buf.imm32(0);
+      buf.patch(buf.size() - 4, error_exit);
+    }
+  }
+  // running off the end of the code returns to the vm as well
+  native.entries[code.size()] = buf.size();
+  leave(code.size());
+
+  for (auto [at, target] : jumps)
+    buf.patch(at, native.entries[target]);
+
+  // copy into executable memory (never writable and executable at once)
+  void* memory = mmap(nullptr, buf.size(), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+    return;
+  memcpy(memory, buf.code.data(), buf.size());
+  if (mprotect(memory, buf.size(), PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, buf.size());
+    return;
+  }
+  native.memory = memory;
+  native.size = buf.size();
+}
+
+#else
+
+void VMJit::compile(int function)
+{
+  // no native code on this platform (the function stays interpreted)
+}
+
+#endif
+
+
+//----------------------------------------------------------------------
+// Helpers
+//----------------------------------------------------------------------
+
+int VMJit::fail(VM* vm)
+{
+  vm->jit->error = current_exception();
+  return -1;
+}
+
+
+template<OpCode op>
+int VMJit::helper(VM* vm, int arg, int pc)
+{
+  // run the instruction in the interpreter
+  try {
+    vm->frames.back().pc = pc;
+    vm->step();
+    return 0;
+  }
+  catch (...) {
+    return fail(vm);
+  }
+}
+
+
+// orders chars as unsigned bytes (as in string comparisons)
+template<typename Op>
+struct byte_order
+{
+  bool operator()(char y, char x) const
+  {
+    return Op()(static_cast<unsigned char>(y), static_cast<unsigned char>(x));
+  }
+};
+
+
+template<typename T, typename Op>
+int VMJit::typed_binary(VM* vm, int pc)
+{
+  VMValue& top = vm->stack.back();
+  VMValue& below = vm->stack[vm->stack.size() - 2];
+  const T* x = get_if<T>(&top);
+  const T* y = get_if<T>(&below);
+  if (!x or !y) {
+    try {
+      vm->frames.back().pc = pc + 1;
+      vm->error("null reference", vm->frames.back());
+    }
+    catch (...) {
+      return fail(vm);
+    }
+  }
+  VMValue result = Op()(*y, *x);
+  vm->stack.pop_back();
+  vm->stack.back() = std::move(result);
+  return 0;
+}
+
+
+template<typename T, bool NEGATE>
+int VMJit::typed_equality(VM* vm, int pc)
+{
+  try {
+    VMValue& top = vm->stack.back();
+    VMValue& below = vm->stack[vm->stack.size() - 2];
+    const T* x = get_if<T>(&top);
+    const T* y = get_if<T>(&below);
+    bool xy = (x and y) ? (*y == *x) : get<bool>(vm->eq(below, top));
+    vm->stack.pop_back();
+    vm->stack.back() = NEGATE ? !xy : xy;
+    return 0;
+  }
+  catch (...) {
+    return fail(vm);
+  }
+}
+
+
+int VMJit::generic_binary(VM* vm, int pc,
+                          VMValue (VM::*op)(const VMValue&,
+                                            const VMValue&) const)
+{
+  try {
+    VMFrame& frame = vm->frames.back();
+    frame.pc = pc + 1;
+    VMValue x = std::move(vm->stack.back());
+    vm->ensure_not_null(frame, x);
+    vm->stack.pop_back();
+    VMValue& y = vm->stack.back();
+    vm->ensure_not_null(frame, y);
+    y = (vm->*op)(y, x);
+    return 0;
+  }
+  catch (...) {
+    return fail(vm);
+  }
+}
+
+
+template<>
+int VMJit::helper<OpCode::PUSH>(VM* vm, int arg, int pc)
+{
+  vm->stack.push_back(vm->constants[arg]);
+  return 0;
+}
+
+
+template<>
+int VMJit::helper<OpCode::POP>(VM* vm, int arg, int pc)
+{
+  vm->stack.pop_back();
+  return 0;
+}
+
+
+template<>
+int VMJit::helper<OpCode::LOAD>(VM* vm, int arg, int pc)
+{
+  vm->stack.push_back(vm->stack[vm->frames.back().base + arg]);
+  return 0;
+}
+
+
+template<>
+int VMJit::helper<OpCode::STORE>(VM* vm, int arg, int pc)
+{
+  vm->stack[vm->frames.back().base + arg] = std::move(vm->stack.back());
+  vm->stack.pop_back();
+  return 0;
+}
+
+
+template<>
+int VMJit::helper<OpCode::DUP>(VM* vm, int arg, int pc)
+{
+  vm->stack.push_back(vm->stack.back());
+  return 0;
+}
+
+
+template<>
+int VMJit::helper<OpCode::JMPF>(VM* vm, int arg, int pc)
+{
+  // returns the popped condition
+  try {
+    if (holds_alternative<nullptr_t>(vm->stack.back())) {
+      vm->frames.back().pc = pc + 1;
+      vm->error("null reference", vm->frames.back());
+    }
+    bool x = get<bool>(vm->stack.back());
+    vm->stack.pop_back();
+    return x;
+  }
+  catch (...) {
+    return fail(vm);
+  }
+}
+
+
+template<>
+int VMJit::helper<OpCode::ADD>(VM* vm, int arg, int pc)
+{
+  return generic_binary(vm, pc, &VM::add);
+}
+
+
+template<>
+int VMJit::helper<OpCode::SUB>(VM* vm, int arg, int pc)
+{
+  return generic_binary(vm, pc, &VM::sub);
+}
+
+
+template<>
+int VMJit::helper<OpCode::MUL>(VM* vm, int arg, int pc)
+{
+  return generic_binary(vm, pc, &VM::mul);
+}
+
+
+template<>
+int VMJit::helper<OpCode::DIV>(VM* vm, int arg, int pc)
+{
+  return generic_binary(vm, pc, &VM::div);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPLT>(VM* vm, int arg, int pc)
+{
+  return generic_binary(vm, pc, &VM::lt);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPLE>(VM* vm, int arg, int pc)
+{
+  return generic_binary(vm, pc, &VM::le);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPGT>(VM* vm, int arg, int pc)
+{
+  return generic_binary(vm, pc, &VM::gt);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPGE>(VM* vm, int arg, int pc)
+{
+  return generic_binary(vm, pc, &VM::ge);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPEQ>(VM* vm, int arg, int pc)
+{
+  try {
+    VMValue x = std::move(vm->stack.back());
+    vm->stack.pop_back();
+    vm->stack.back() = get<bool>(vm->eq(vm->stack.back(), x));
+    return 0;
+  }
+  catch (...) {
+    return fail(vm);
+  }
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPNE>(VM* vm, int arg, int pc)
+{
+  try {
+    VMValue x = std::move(vm->stack.back());
+    vm->stack.pop_back();
+    vm->stack.back() = !get<bool>(vm->eq(vm->stack.back(), x));
+    return 0;
+  }
+  catch (...) {
+    return fail(vm);
+  }
+}
+
+
+template<>
+int VMJit::helper<OpCode::ADD_INT>(VM* vm, int arg, int pc)
+{
+  return typed_binary<int, plus<int>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::ADD_DBL>(VM* vm, int arg, int pc)
+{
+  return typed_binary<double, plus<double>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::SUB_INT>(VM* vm, int arg, int pc)
+{
+  return typed_binary<int, minus<int>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::SUB_DBL>(VM* vm, int arg, int pc)
+{
+  return typed_binary<double, minus<double>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::MUL_INT>(VM* vm, int arg, int pc)
+{
+  return typed_binary<int, multiplies<int>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::MUL_DBL>(VM* vm, int arg, int pc)
+{
+  return typed_binary<double, multiplies<double>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::DIV_INT>(VM* vm, int arg, int pc)
+{
+  return typed_binary<int, divides<int>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::DIV_DBL>(VM* vm, int arg, int pc)
+{
+  return typed_binary<double, divides<double>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPLT_INT>(VM* vm, int arg, int pc)
+{
+  return typed_binary<int, less<int>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPLT_DBL>(VM* vm, int arg, int pc)
+{
+  return typed_binary<double, less<double>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPLT_STR>(VM* vm, int arg, int pc)
+{
+  return typed_binary<VMString, less<VMString>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPLE_INT>(VM* vm, int arg, int pc)
+{
+  return typed_binary<int, less_equal<int>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPLE_DBL>(VM* vm, int arg, int pc)
+{
+  return typed_binary<double, less_equal<double>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPLE_STR>(VM* vm, int arg, int pc)
+{
+  return typed_binary<VMString, less_equal<VMString>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPGT_INT>(VM* vm, int arg, int pc)
+{
+  return typed_binary<int, greater<int>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPGT_DBL>(VM* vm, int arg, int pc)
+{
+  return typed_binary<double, greater<double>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPGT_STR>(VM* vm, int arg, int pc)
+{
+  return typed_binary<VMString, greater<VMString>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPGE_INT>(VM* vm, int arg, int pc)
+{
+  return typed_binary<int, greater_equal<int>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPGE_DBL>(VM* vm, int arg, int pc)
+{
+  return typed_binary<double, greater_equal<double>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPGE_STR>(VM* vm, int arg, int pc)
+{
+  return typed_binary<VMString, greater_equal<VMString>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPEQ_INT>(VM* vm, int arg, int pc)
+{
+  return typed_equality<int, false>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPEQ_DBL>(VM* vm, int arg, int pc)
+{
+  return typed_equality<double, false>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPEQ_STR>(VM* vm, int arg, int pc)
+{
+  return typed_equality<VMString, false>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPNE_INT>(VM* vm, int arg, int pc)
+{
+  return typed_equality<int, true>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPNE_DBL>(VM* vm, int arg, int pc)
+{
+  return typed_equality<double, true>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPNE_STR>(VM* vm, int arg, int pc)
+{
+  return typed_equality<VMString, true>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPLT_CHR>(VM* vm, int arg, int pc)
+{
+  return typed_binary<char, byte_order<less<>>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPLE_CHR>(VM* vm, int arg, int pc)
+{
+  return typed_binary<char, byte_order<less_equal<>>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPGT_CHR>(VM* vm, int arg, int pc)
+{
+  return typed_binary<char, byte_order<greater<>>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPGE_CHR>(VM* vm, int arg, int pc)
+{
+  return typed_binary<char, byte_order<greater_equal<>>>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPEQ_CHR>(VM* vm, int arg, int pc)
+{
+  return typed_equality<char, false>(vm, pc);
+}
+
+
+template<>
+int VMJit::helper<OpCode::CMPNE_CHR>(VM* vm, int arg, int pc)
+{
+  return typed_equality<char, true>(vm, pc);
+}
+
+
+const VMJit::Helper* VMJit::helpers()
+{
+  // one entry per opcode in the order of op_code.h
+  static const Helper table[] = {
+    helper<OpCode::PUSH>, helper<OpCode::POP>, helper<OpCode::LOAD>,
+    helper<OpCode::STORE>, helper<OpCode::ADD>, helper<OpCode::SUB>,
+    helper<OpCode::MUL>, helper<OpCode::DIV>, helper<OpCode::AND>,
+    helper<OpCode::OR>, helper<OpCode::NOT>, helper<OpCode::CMPLT>,
+    helper<OpCode::CMPLE>, helper<OpCode::CMPGT>, helper<OpCode::CMPGE>,
+    helper<OpCode::CMPEQ>, helper<OpCode::CMPNE>, helper<OpCode::ADD_INT>,
+    helper<OpCode::ADD_DBL>, helper<OpCode::SUB_INT>,
+    helper<OpCode::SUB_DBL>, helper<OpCode::MUL_INT>,
+    helper<OpCode::MUL_DBL>, helper<OpCode::DIV_INT>,
+    helper<OpCode::DIV_DBL>, helper<OpCode::CMPLT_INT>,
+    helper<OpCode::CMPLT_DBL>, helper<OpCode::CMPLT_STR>,
+    helper<OpCode::CMPLE_INT>, helper<OpCode::CMPLE_DBL>,
+    helper<OpCode::CMPLE_STR>, helper<OpCode::CMPGT_INT>,
+    helper<OpCode::CMPGT_DBL>, helper<OpCode::CMPGT_STR>,
+    helper<OpCode::CMPGE_INT>, helper<OpCode::CMPGE_DBL>,
+    helper<OpCode::CMPGE_STR>, helper<OpCode::CMPEQ_INT>,
+    helper<OpCode::CMPEQ_DBL>, helper<OpCode::CMPEQ_STR>,
+    helper<OpCode::CMPNE_INT>, helper<OpCode::CMPNE_DBL>,
+    helper<OpCode::CMPNE_STR>, helper<OpCode::CMPLT_CHR>,
+    helper<OpCode::CMPLE_CHR>, helper<OpCode::CMPGT_CHR>,
+    helper<OpCode::CMPGE_CHR>, helper<OpCode::CMPEQ_CHR>,
+    helper<OpCode::CMPNE_CHR>, helper<OpCode::JMP>, helper<OpCode::JMPF>,
+    helper<OpCode::CALL>, helper<OpCode::RET>, helper<OpCode::WRITE>,
+    helper<OpCode::READ>, helper<OpCode::SLEN>, helper<OpCode::ALEN>,
+    helper<OpCode::GETC>, helper<OpCode::TOINT>, helper<OpCode::TODBL>,
+    helper<OpCode::TOSTR>, helper<OpCode::CONCAT>, helper<OpCode::ALLOCS>,
+    helper<OpCode::ALLOCA>, helper<OpCode::ADDF>, helper<OpCode::SETF>,
+    helper<OpCode::GETF>, helper<OpCode::SETI>, helper<OpCode::GETI>,
+    helper<OpCode::ALLOCA_INT>, helper<OpCode::ALLOCA_DBL>,
+    helper<OpCode::ALLOCA_BOOL>, helper<OpCode::SETI_INT>,
+    helper<OpCode::SETI_DBL>, helper<OpCode::SETI_BOOL>,
+    helper<OpCode::GETI_INT>, helper<OpCode::GETI_DBL>,
+    helper<OpCode::GETI_BOOL>,
+    // superinstructions (never called, see compile)
+    helper<OpCode::LOAD>, helper<OpCode::LOAD>, helper<OpCode::LOAD>,
+    helper<OpCode::LOAD>, helper<OpCode::LOAD>, helper<OpCode::LOAD>,
+    helper<OpCode::LOAD>, helper<OpCode::LOAD>,
+    helper<OpCode::DUP>, helper<OpCode::NOP>
+  };
+  static_assert(sizeof(table) / sizeof(table[0]) ==
+                static_cast<int>(OpCode::NOP) + 1,
+                "helper table out of sync with OpCode");
+  return table;
+}
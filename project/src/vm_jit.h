@@ -0,0 +1,108 @@
+//----------------------------------------------------------------------
+// FILE: vm_jit.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: A baseline (call-threaded) x86-64 compiler for hot vm functions
+//----------------------------------------------------------------------
+
+#ifndef VM_JIT_H
+#define VM_JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <vector>
+#include "op_code.h"
+#include "vm_instr.h"
+
+class VM;
+
+
+// Compiles a function's packed code into native code once the function
+// gets hot (from its calls and loop back-edges). Each instruction
+// becomes a direct call to a helper for its opcode, with jumps and
+// branches as native jumps. Opcodes without a dedicated helper run
+// through the interpreter one instruction at a time. A call or return
+// leaves the native code so the vm can switch frames, and the function
+// can be (re-)entered at any instruction.
+class VMJit
+{
+public:
+
+  // the jit works on (and is owned by) the given vm
+  VMJit(VM& vm);
+  ~VMJit();
+
+  VMJit(const VMJit&) = delete;
+  VMJit& operator=(const VMJit&) = delete;
+
+  // true if native code can be generated and run on this platform
+  static bool supported();
+
+  // count a call of (or loop back-edge in) the function, compiling it
+  // once hot, returns true if the function has native code
+  bool hot(int function);
+
+  // true if the function has native code
+  bool compiled(int function) const;
+
+  // run the current frame's (compiled) function natively from pc until
+  // it reaches a call or return, returning that instruction's pc (vm
+  // errors raised in native code are rethrown here)
+  int enter(int function, int pc);
+
+private:
+
+  // number of calls and back-edges before a function is compiled
+  static const int HOT_THRESHOLD = 1000;
+
+  // the native code of a function
+  class NativeCode
+  {
+  public:
+    // calls and back-edges counted so far
+    int heat = 0;
+    // executable memory holding the code (null if not compiled)
+    void* memory = nullptr;
+    std::size_t size = 0;
+    // native offset of each instruction (by pc, one past the end too)
+    std::vector<std::uint32_t> entries;
+  };
+
+  // the vm whose functions are compiled
+  VM& vm;
+
+  // native code by function index
+  std::vector<NativeCode> functions;
+
+  // error raised by a helper (rethrown once out of native code)
+  std::exception_ptr error;
+
+  // generate the native code of a function
+  void compile(int function);
+
+  // helper called by native code for an instruction of the given
+  // opcode (with the instruction's operand and pc), returning 0 to
+  // continue or -1 on an error (helpers must not throw through native
+  // frames), the default runs the instruction in the interpreter
+  template<OpCode op> static int helper(VM* vm, int arg, int pc);
+
+  // table of helpers by opcode
+  using Helper = int (*)(VM*, int, int);
+  static const Helper* helpers();
+
+  // helpers shared by the typed and generic arithmetic and comparators
+  template<typename T, typename Op>
+  static int typed_binary(VM* vm, int pc);
+  template<typename T, bool NEGATE>
+  static int typed_equality(VM* vm, int pc);
+  static int generic_binary(VM* vm, int pc,
+                            VMValue (VM::*op)(const VMValue&,
+                                              const VMValue&) const);
+
+  // record the current exception as the pending error
+  static int fail(VM* vm);
+
+};
+
+#endif
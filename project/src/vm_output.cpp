@@ -0,0 +1,100 @@
+//----------------------------------------------------------------------
+// FILE: vm_output.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Buffered standard output for the vm's WRITE instruction
+//----------------------------------------------------------------------
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include "vm_output.h"
+
+using namespace std;
+
+
+VMOutput::VMOutput()
+  : mode(isatty(STDOUT_FILENO) ? VMBufferMode::LINE : VMBufferMode::FULL)
+{
+}
+
+
+VMOutput::~VMOutput()
+{
+  flush();
+}
+
+
+void VMOutput::set_mode(VMBufferMode new_mode)
+{
+  mode = new_mode;
+}
+
+
+void VMOutput::write(const VMValue& value)
+{
+  if (holds_alternative<int>(value) or holds_alternative<double>(value)) {
+    if (BUFFER_SIZE - used < NUMBER_SIZE)
+      flush();
+    char* end = buffer + BUFFER_SIZE;
+    to_chars_result result = holds_alternative<int>(value) ?
+      to_chars(buffer + used, end, get<int>(value)) :
+      to_chars(buffer + used, end, get<double>(value), chars_format::fixed, 6);
+    used = result.ptr - buffer;
+  }
+  else if (holds_alternative<bool>(value))
+    get<bool>(value) ? append("true", 4) : append("false", 5);
+  else if (holds_alternative<char>(value)) {
+    append(&get<char>(value), 1);
+    if (mode == VMBufferMode::LINE and get<char>(value) == '\n')
+      flush();
+  }
+  else if (holds_alternative<VMString>(value)) {
+    string_view s = get<VMString>(value).view();
+    append(s.data(), s.size());
+    if (mode == VMBufferMode::LINE and s.find('\n') != string_view::npos)
+      flush();
+  }
+  else
+    append("null", 4);
+}
+
+
+void VMOutput::append(const char* data, size_t size)
+{
+  if (size > BUFFER_SIZE - used) {
+    flush();
+    // too big to buffer, so write it out directly
+    if (size > BUFFER_SIZE) {
+      write_all(data, size);
+      return;
+    }
+  }
+  memcpy(buffer + used, data, size);
+  used += size;
+}
+
+
+void VMOutput::flush()
+{
+  cout.flush();
+  write_all(buffer, used);
+  used = 0;
+}
+
+
+void VMOutput::write_all(const char* data, size_t size)
+{
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = ::write(STDOUT_FILENO, data + done, size - done);
+    if (n < 0 and errno == EINTR)
+      continue;
+    // output errors (e.g., a closed pipe) drop the output
+    if (n <= 0)
+      break;
+    done += n;
+  }
+}
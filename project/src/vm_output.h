@@ -0,0 +1,67 @@
+//----------------------------------------------------------------------
+// FILE: vm_output.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Buffered standard output for the vm's WRITE instruction
+//----------------------------------------------------------------------
+
+#ifndef VM_OUTPUT_H
+#define VM_OUTPUT_H
+
+#include <cstddef>
+#include "vm_instr.h"
+
+
+// when buffered output is written out (besides when the buffer fills,
+// before reading input, on errors, and at exit)
+enum class VMBufferMode {
+  LINE,         // after each write containing a newline
+  FULL          // only when the buffer fills
+};
+
+
+// Program output collected in a large buffer and written to standard
+// output in batches. Values are formatted straight into the buffer
+// (ints and doubles with to_chars, doubles in the same fixed six-digit
+// format as to_string). Anything already written to cout is flushed
+// first, so output keeps its order.
+class VMOutput
+{
+public:
+
+  // line buffered when standard output is a terminal, otherwise fully
+  // buffered
+  VMOutput();
+  ~VMOutput();
+
+  VMOutput(const VMOutput&) = delete;
+  VMOutput& operator=(const VMOutput&) = delete;
+
+  void set_mode(VMBufferMode mode);
+
+  // append the value's printed form (as given by to_string)
+  void write(const VMValue& value);
+
+  // write out the buffered output
+  void flush();
+
+private:
+
+  static const std::size_t BUFFER_SIZE = 1 << 16;
+
+  // room needed to format any int or double in place (a double with
+  // %f can take 309 digits before the point)
+  static const std::size_t NUMBER_SIZE = 512;
+
+  char buffer[BUFFER_SIZE];
+  std::size_t used = 0;
+  VMBufferMode mode;
+
+  void append(const char* data, std::size_t size);
+
+  // write the bytes to standard output (unbuffered)
+  static void write_all(const char* data, std::size_t size);
+
+};
+
+#endif
@@ -0,0 +1,149 @@
+//----------------------------------------------------------------------
+// FILE: vm_profile.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Execution profiles of vm runs (per opcode and per function)
+//----------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdio>
+#include "vm_profile.h"
+
+using namespace std;
+
+
+// helper function to format a row of the report
+template<typename... Args>
+static string row(const char* format, Args... args)
+{
+  char buffer[256];
+  snprintf(buffer, sizeof(buffer), format, args...);
+  return buffer;
+}
+
+
+string to_string(const VMProfile& profile)
+{
+  auto ms = [](long ns) {return ns / 1000000.0;};
+  long total = 0;
+  for (long count : profile.instructions)
+    total += count;
+
+  string s = "";
+  s += "Instructions......: " + to_string(total) + "\n";
+  s += row("\n%-22s %14s %8s\n", "Opcode", "Count", "%");
+  vector<int> ops;
+  for (int op = 0; op < VMProfile::OPCODE_COUNT; ++op)
+    if (profile.instructions[op] > 0)
+      ops.push_back(op);
+  stable_sort(ops.begin(), ops.end(), [&](int x, int y) {
+    return profile.instructions[x] > profile.instructions[y];
+  });
+  for (int op : ops) {
+    long count = profile.instructions[op];
+    s += row("%-22s %14ld %7.2f%%\n",
+             to_string(static_cast<OpCode>(op)).c_str(), count,
+             100.0 * count / total);
+  }
+
+  long run_time = 0;
+  for (const VMProfile::Function& f : profile.functions)
+    run_time += f.self_time;
+  s += row("\n%-20s %10s %12s %12s %8s\n", "Function", "Calls",
+           "Self (ms)", "Total (ms)", "Self %");
+  vector<VMProfile::Function> functions;
+  for (const VMProfile::Function& f : profile.functions)
+    if (f.calls > 0)
+      functions.push_back(f);
+  stable_sort(functions.begin(), functions.end(), [](auto& x, auto& y) {
+    return x.self_time > y.self_time;
+  });
+  for (const VMProfile::Function& f : functions)
+    s += row("%-20s %10ld %12.3f %12.3f %7.2f%%\n", f.name.c_str(), f.calls,
+             ms(f.self_time), ms(f.total_time),
+             run_time ? 100.0 * f.self_time / run_time : 0.0);
+  return s;
+}
+
+
+void write_folded(const VMProfile& profile, ostream& out)
+{
+  // walk the tree depth first, extending and truncating a single path
+  // (so memory stays proportional to the deepest stack)
+  class Visit
+  {
+  public:
+    int stack;
+    int next_child;
+    size_t path_length;
+  };
+  string path;
+  vector<Visit> pending {{0, 0, 0}};
+  while (!pending.empty()) {
+    Visit& visit = pending.back();
+    const VMProfile::Stack& parent = profile.stacks[visit.stack];
+    if (visit.next_child == parent.children.size()) {
+      pending.pop_back();
+      continue;
+    }
+    int child = parent.children[visit.next_child++];
+    const VMProfile::Stack& stack = profile.stacks[child];
+    path.resize(visit.path_length);
+    if (visit.stack != 0)
+      path += ";";
+    path += profile.functions[stack.function].name;
+    if (stack.self_time > 0)
+      out << path << " " << stack.self_time << "\n";
+    pending.push_back({child, 0, path.size()});
+  }
+}
+
+
+VMProfiler::VMProfiler(const vector<VMFrameInfo>& frames)
+  : total_times(frames.size(), 0), depths(frames.size(), 0)
+{
+  for (const VMFrameInfo& frame : frames)
+    names.push_back(frame.function_name);
+  nodes.push_back(Node {-1, -1});
+}
+
+
+int VMProfiler::child(int function)
+{
+  if (nodes[current].function == function) {
+    ++nodes[current].recursion;
+    return current;
+  }
+  for (int node : nodes[current].children)
+    if (nodes[node].function == function)
+      return node;
+  int node = nodes.size();
+  nodes.push_back(Node {function, current});
+  nodes[current].children.push_back(node);
+  return node;
+}
+
+
+void VMProfiler::finish()
+{
+  while (!active.empty())
+    ret();
+}
+
+
+VMProfile VMProfiler::profile() const
+{
+  VMProfile profile;
+  profile.instructions = counts;
+  for (int i = 0; i < names.size(); ++i)
+    profile.functions.push_back({names[i], 0, 0, total_times[i]});
+  for (const Node& node : nodes) {
+    if (node.function >= 0) {
+      VMProfile::Function& f = profile.functions[node.function];
+      f.calls += node.calls;
+      f.self_time += node.self_time;
+    }
+    profile.stacks.push_back({node.function, node.self_time, node.children});
+  }
+  return profile;
+}
@@ -0,0 +1,183 @@
+//----------------------------------------------------------------------
+// FILE: vm_profile.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Execution profiles of vm runs (per opcode and per function)
+//----------------------------------------------------------------------
+
+#ifndef VM_PROFILE_H
+#define VM_PROFILE_H
+
+#include <array>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "op_code.h"
+#include "vm_frame.h"
+
+
+// Profile of a vm run (times in nanoseconds)
+class VMProfile
+{
+public:
+
+  // calls and times of a function (total time includes the callees,
+  // counting recursive calls once)
+  class Function
+  {
+  public:
+    std::string name;
+    long calls = 0;
+    long self_time = 0;
+    long total_time = 0;
+  };
+
+  // a call stack: the function called from its parent stack (with
+  // direct recursive calls folded in), its self time, and the stacks
+  // it called into
+  class Stack
+  {
+  public:
+    int function;
+    long self_time = 0;
+    std::vector<int> children;
+  };
+
+  // number of opcodes (NOP is the last one)
+  static constexpr int OPCODE_COUNT = static_cast<int>(OpCode::NOP) + 1;
+
+  // instructions executed by opcode
+  std::array<long, OPCODE_COUNT> instructions {};
+
+  // functions by function index
+  std::vector<Function> functions;
+
+  // every call stack that was run, as a tree (the root, stacks[0],
+  // stands for no call)
+  std::vector<Stack> stacks;
+
+};
+
+// function to get a (multi-line) report of the profile, with opcodes
+// and functions sorted from most to least executed
+std::string to_string(const VMProfile& profile);
+
+// write the profile's call stacks in the folded format read by
+// flamegraph tools (one "main;f;g <self time>" line per stack)
+void write_folded(const VMProfile& profile, std::ostream& out);
+
+
+// Run loop hooks (see vm_hooks.h) recording a profile: instruction
+// counts by opcode, and calls and times by call stack. Calls form a
+// tree with a node per distinct call stack, so a call only searches
+// the (few) callees seen from the current stack and reads the clock
+// once. A function calling itself stays in its node, so a deep
+// recursion adds no nodes.
+class VMProfiler
+{
+public:
+
+  // profile the functions of the given frames
+  VMProfiler(const std::vector<VMFrameInfo>& frames);
+
+  void instruction(const VMFrame& frame, const VMCode& instr,
+                   const std::vector<VMValue>& stack, int depth);
+  void call(int function);
+  void ret();
+
+  // return from every function still running (when a run ends early)
+  void finish();
+
+  // the profile recorded so far
+  VMProfile profile() const;
+
+private:
+
+  using Clock = std::chrono::steady_clock;
+
+  // a call stack, by the function called from its parent's stack
+  class Node
+  {
+  public:
+    int function;
+    int parent;
+    long calls = 0;
+    long self_time = 0;
+    std::vector<int> children;
+    // direct recursive calls running within the node's call
+    int recursion = 0;
+  };
+
+  // a running call (started at start, with time spent in callees)
+  class Activation
+  {
+  public:
+    Clock::time_point start;
+    long callee_time = 0;
+  };
+
+  // function names by index
+  std::vector<std::string> names;
+
+  std::array<long, VMProfile::OPCODE_COUNT> counts {};
+
+  // the call tree (the root, node 0, stands for no call) and the
+  // current stack's node
+  std::vector<Node> nodes;
+  int current = 0;
+
+  std::vector<Activation> active;
+
+  // total time of each function and how many of its calls are running
+  std::vector<long> total_times;
+  std::vector<int> depths;
+
+  // the child node of the current node for the function (the current
+  // node itself for a direct recursive call)
+  int child(int function);
+
+};
+
+
+//----------------------------------------------------------------------
+// Inline definitions (called from the run loop)
+//----------------------------------------------------------------------
+
+inline void VMProfiler::instruction(const VMFrame& frame,
+                                    const VMCode& instr,
+                                    const std::vector<VMValue>& stack,
+                                    int depth)
+{
+  ++counts[static_cast<int>(instr.opcode)];
+}
+
+inline void VMProfiler::call(int function)
+{
+  current = child(function);
+  ++nodes[current].calls;
+  ++depths[function];
+  active.push_back(Activation {Clock::now()});
+}
+
+inline void VMProfiler::ret()
+{
+  if (active.empty())
+    return;
+  Activation done = active.back();
+  active.pop_back();
+  long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    Clock::now() - done.start).count();
+  Node& node = nodes[current];
+  node.self_time += elapsed - done.callee_time;
+  if (--depths[node.function] == 0)
+    total_times[node.function] += elapsed;
+  if (!active.empty())
+    active.back().callee_time += elapsed;
+  if (node.recursion > 0)
+    --node.recursion;
+  else
+    current = node.parent;
+}
+
+#endif
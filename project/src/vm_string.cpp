@@ -0,0 +1,68 @@
+//----------------------------------------------------------------------
+// FILE: vm_string.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Representation of vm string values (shared, append-friendly)
+//----------------------------------------------------------------------
+
+#include "vm_string.h"
+
+using namespace std;
+
+
+VMString::VMString(const string& value)
+  : buffer(make_shared<string>(value)), length(value.size())
+{
+}
+
+
+VMString::VMString(string&& value)
+  : length(value.size())
+{
+  buffer = make_shared<string>(move(value));
+}
+
+
+VMString::VMString(const char* value)
+  : VMString(string(value))
+{
+}
+
+
+VMString::VMString(string_view value)
+  : VMString(string(value))
+{
+}
+
+
+void VMString::freeze()
+{
+  frozen = true;
+}
+
+
+string VMString::str() const
+{
+  return string(view());
+}
+
+
+VMString VMString::concat(const VMString& x, const VMString& y)
+{
+  if (y.length == 0)
+    return x;
+  // append to x's buffer when nothing follows x in it yet (otherwise
+  // some other value owns the bytes after x)
+  if (x.buffer and !x.frozen and x.length == x.buffer->size() and
+      x.buffer != y.buffer) {
+    VMString result = x;
+    result.buffer->append(y.view());
+    result.length += y.length;
+    return result;
+  }
+  string value;
+  value.reserve(x.length + y.length);
+  value.append(x.view());
+  value.append(y.view());
+  return VMString(move(value));
+}
@@ -0,0 +1,102 @@
+//----------------------------------------------------------------------
+// FILE: vm_string.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Representation of vm string values (shared, append-friendly)
+//----------------------------------------------------------------------
+
+#ifndef VM_STRING_H
+#define VM_STRING_H
+
+#include <compare>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+
+// An immutable string value: the first length bytes of a shared
+// buffer. Copying a value only shares the buffer. Concatenation appends
+// in place when the left value ends where its buffer does (values with
+// shorter lengths still see the same bytes), so a loop like s =
+// concat(s, piece) takes amortized constant time per piece instead of
+// copying s each time. A frozen value (and its copies) is never
+// appended to, so the buffers of constant pool literals keep their
+// size. The bytes are always contiguous.
+class VMString
+{
+public:
+
+  VMString() = default;
+  VMString(const std::string& value);
+  VMString(std::string&& value);
+  VMString(const char* value);
+  VMString(std::string_view value);
+
+  // the string's bytes (valid until the next concatenation)
+  std::string_view view() const;
+  std::size_t size() const;
+
+  // a copy of the string
+  std::string str() const;
+
+  // the concatenation x + y
+  static VMString concat(const VMString& x, const VMString& y);
+
+  // copy instead of appending when this value (or a copy of it) is
+  // the left side of a concatenation
+  void freeze();
+
+  friend bool operator==(const VMString& x, const VMString& y);
+  friend std::strong_ordering operator<=>(const VMString& x,
+                                          const VMString& y);
+
+private:
+
+  // (the flag shares the length's word to keep values small)
+  std::shared_ptr<std::string> buffer;
+  std::size_t length : 63 = 0;
+  std::size_t frozen : 1 = 0;
+
+};
+
+
+namespace std {
+  template<>
+  struct hash<VMString> {
+    size_t operator()(const VMString& value) const
+    {
+      return hash<string_view>()(value.view());
+    }
+  };
+}
+
+
+//----------------------------------------------------------------------
+// Inline definitions (reading a value should not cost a call)
+//----------------------------------------------------------------------
+
+inline std::string_view VMString::view() const
+{
+  return buffer ? std::string_view(buffer->data(), length) :
+    std::string_view();
+}
+
+inline std::size_t VMString::size() const
+{
+  return length;
+}
+
+inline bool operator==(const VMString& x, const VMString& y)
+{
+  return x.view() == y.view();
+}
+
+inline std::strong_ordering operator<=>(const VMString& x,
+                                        const VMString& y)
+{
+  return x.view().compare(y.view()) <=> 0;
+}
+
+#endif
@@ -0,0 +1,49 @@
+//----------------------------------------------------------------------
+// FILE: vm_struct.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Representation of a struct type descriptor registered with
+// the VM and of the struct objects created from it.
+//----------------------------------------------------------------------
+
+#ifndef VM_STRUCT_H
+#define VM_STRUCT_H
+
+#include <string>
+#include <vector>
+#include "vm_instr.h"
+
+
+// The following are plain-old-data classes
+
+
+class VMStructInfo
+{
+public:
+
+  // the name of the struct type
+  std::string struct_name;
+
+  // the field names, in slot order (objects have one value per field)
+  std::vector<std::string> field_names;
+
+  // slots of the fields that can refer to heap objects (struct and
+  // array typed fields), the only ones scanned by the collector
+  std::vector<int> reference_slots;
+
+};
+
+
+class VMStructObject
+{
+public:
+
+  // the struct index of the object's type
+  int type = 0;
+
+  // the field values by slot
+  std::vector<VMValue> fields;
+
+};
+
+#endif
@@ -0,0 +1,66 @@
+//----------------------------------------------------------------------
+// FILE: vm_trace.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Binary traces of the instructions run by the vm
+//----------------------------------------------------------------------
+
+#include "mypl_exception.h"
+#include "vm_trace.h"
+
+using namespace std;
+
+
+bool read_trace_header(istream& in, vector<string>& names)
+{
+  char magic[4];
+  uint32_t version = 0;
+  uint32_t count = 0;
+  auto read = [&](uint32_t& value) {
+    return (bool) in.read(reinterpret_cast<char*>(&value), sizeof(value));
+  };
+  if (!in.read(magic, 4) or memcmp(magic, VM_TRACE_MAGIC, 4) != 0 or
+      !read(version) or version != VM_TRACE_VERSION or !read(count))
+    return false;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t length = 0;
+    read(length);
+    string name(length, ' ');
+    in.read(name.data(), length);
+    names.push_back(name);
+  }
+  return (bool) in;
+}
+
+
+VMTracer::VMTracer(const vector<VMFrameInfo>& frames, const string& filename)
+  : first_info(frames.data()), out(filename, ios::binary)
+{
+  if (!out)
+    throw MyPLException::VMError("cannot write trace file '" + filename + "'");
+  out.write(VM_TRACE_MAGIC, sizeof(VM_TRACE_MAGIC));
+  uint32_t count = frames.size();
+  out.write(reinterpret_cast<const char*>(&VM_TRACE_VERSION), sizeof(uint32_t));
+  out.write(reinterpret_cast<const char*>(&count), sizeof(uint32_t));
+  for (const VMFrameInfo& frame : frames) {
+    uint32_t length = frame.function_name.size();
+    out.write(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
+    out.write(frame.function_name.data(), length);
+  }
+  buffer.reserve(BUFFER_RECORDS);
+}
+
+
+VMTracer::~VMTracer()
+{
+  finish();
+}
+
+
+void VMTracer::finish()
+{
+  out.write(reinterpret_cast<const char*>(buffer.data()),
+            buffer.size() * sizeof(VMTraceRecord));
+  out.flush();
+  buffer.clear();
+}
@@ -0,0 +1,140 @@
+//----------------------------------------------------------------------
+// FILE: vm_trace.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Binary traces of the instructions run by the vm
+//----------------------------------------------------------------------
+
+#ifndef VM_TRACE_H
+#define VM_TRACE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "op_code.h"
+#include "vm_frame.h"
+#include "vm_instr.h"
+
+
+// the kind of value on top of the stack in a trace record
+enum class VMTraceKind : std::uint8_t {
+  EMPTY,        // the frame has no operands
+  INT, DOUBLE, BOOL, CHAR, STRING, NULLPTR
+};
+
+
+// A traced instruction (24 bytes), recorded before it runs. The top
+// of the stack is its value for ints, bools, and chars, the bits of a
+// double, and the length of a string.
+struct VMTraceRecord
+{
+  std::uint32_t function = 0;   // function index of the frame
+  std::uint32_t pc = 0;         // the instruction's index in the frame
+  std::uint32_t depth = 0;      // number of frames on the call stack
+  OpCode opcode = OpCode::NOP;
+  VMTraceKind kind = VMTraceKind::EMPTY;
+  std::uint16_t unused = 0;
+  std::uint64_t top = 0;
+};
+
+static_assert(sizeof(VMTraceRecord) == 24, "trace records should be 24 bytes");
+
+
+// Trace file layout: the magic bytes, the format version, the number
+// of functions followed by their names (each a 32-bit length and the
+// bytes), and then trace records until the end of the file.
+const char VM_TRACE_MAGIC[4] = {'M', 'Y', 'P', 'T'};
+const std::uint32_t VM_TRACE_VERSION = 1;
+
+// read the header of a trace file, returning false if the stream does
+// not start with one (records follow with a VMTraceRecord-sized read
+// each)
+bool read_trace_header(std::istream& in, std::vector<std::string>& names);
+
+
+// Run loop hooks (see vm_hooks.h) writing a trace record per
+// instruction. Records are collected in a buffer that is written to
+// the trace file whenever it fills (and when the trace is finished).
+class VMTracer
+{
+public:
+
+  // trace the functions of the given frames to the file (throws a vm
+  // error if the file cannot be written)
+  VMTracer(const std::vector<VMFrameInfo>& frames,
+           const std::string& filename);
+  ~VMTracer();
+
+  VMTracer(const VMTracer&) = delete;
+  VMTracer& operator=(const VMTracer&) = delete;
+
+  void instruction(const VMFrame& frame, const VMCode& instr,
+                   const std::vector<VMValue>& stack, int depth);
+  void call(int function) {}
+  void ret() {}
+
+  // write out the buffered records
+  void finish();
+
+private:
+
+  // records buffered before a write
+  static const int BUFFER_RECORDS = 1 << 16;
+
+  // the vm's first frame info (a frame's function index is its info's
+  // offset from it)
+  const VMFrameInfo* first_info;
+
+  std::ofstream out;
+  std::vector<VMTraceRecord> buffer;
+
+};
+
+
+//----------------------------------------------------------------------
+// Inline definitions (called from the run loop)
+//----------------------------------------------------------------------
+
+inline void VMTracer::instruction(const VMFrame& frame, const VMCode& instr,
+                                  const std::vector<VMValue>& stack,
+                                  int depth)
+{
+  VMTraceRecord& r = buffer.emplace_back();
+  r.function = frame.info - first_info;
+  r.pc = frame.pc - 1;
+  r.depth = depth;
+  r.opcode = instr.opcode;
+  if (stack.size() <= frame.base + frame.info->local_count)
+    r.kind = VMTraceKind::EMPTY;
+  else {
+    const VMValue& x = stack.back();
+    if (const int* v = std::get_if<int>(&x)) {
+      r.kind = VMTraceKind::INT;
+      r.top = static_cast<std::uint32_t>(*v);
+    }
+    else if (const double* v = std::get_if<double>(&x)) {
+      r.kind = VMTraceKind::DOUBLE;
+      std::memcpy(&r.top, v, sizeof(double));
+    }
+    else if (const bool* v = std::get_if<bool>(&x)) {
+      r.kind = VMTraceKind::BOOL;
+      r.top = *v;
+    }
+    else if (const char* v = std::get_if<char>(&x)) {
+      r.kind = VMTraceKind::CHAR;
+      r.top = static_cast<unsigned char>(*v);
+    }
+    else if (const VMString* v = std::get_if<VMString>(&x)) {
+      r.kind = VMTraceKind::STRING;
+      r.top = v->size();
+    }
+    else
+      r.kind = VMTraceKind::NULLPTR;
+  }
+  if (buffer.size() == BUFFER_RECORDS)
+    finish();
+}
+
+#endif
@@ -0,0 +1,63 @@
+//----------------------------------------------------------------------
+// FILE: vm_word.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: String pool and conversions for NaN-boxed vm words
+//----------------------------------------------------------------------
+
+#include "vm_word.h"
+
+using namespace std;
+
+
+VMWord VMStringPool::add(const string& value)
+{
+  strings.push_back(value);
+  return VMWord::from_string(&strings.back());
+}
+
+
+int VMStringPool::size() const
+{
+  return strings.size();
+}
+
+
+VMWord to_word(const VMValue& value, VMStringPool& pool)
+{
+  if (holds_alternative<int>(value))
+    return VMWord::from_int(get<int>(value));
+  else if (holds_alternative<double>(value))
+    return VMWord::from_double(get<double>(value));
+  else if (holds_alternative<bool>(value))
+    return VMWord::from_bool(get<bool>(value));
+  else if (holds_alternative<char>(value))
+    return VMWord::from_char(get<char>(value));
+  else if (holds_alternative<VMString>(value))
+    return pool.add(get<VMString>(value).str());
+  else
+    return VMWord::null();
+}
+
+
+VMValue to_value(VMWord word)
+{
+  if (word.is_int())
+    return word.as_int();
+  else if (word.is_double())
+    return word.as_double();
+  else if (word.is_bool())
+    return word.as_bool();
+  else if (word.is_char())
+    return word.as_char();
+  else if (word.is_string())
+    return word.as_string();
+  else
+    return nullptr;
+}
+
+
+string to_string(VMWord word)
+{
+  return to_string(to_value(word));
+}
@@ -0,0 +1,189 @@
+//----------------------------------------------------------------------
+// FILE: vm_word.h
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: An alternate, 8-byte (NaN-boxed) representation of vm values
+//----------------------------------------------------------------------
+
+#ifndef VM_WORD_H
+#define VM_WORD_H
+
+#include <bit>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include "vm_instr.h"
+
+
+// A vm value packed into a single 64-bit word. Doubles are stored as
+// their own bits (with every NaN made the same quiet NaN). All other
+// values are negative quiet NaNs: the top 16 bits hold a tag and the
+// low 48 bits the payload (an int, a bool, a char, or a pointer to an
+// immutable string owned by a VMStringPool). Words are trivially
+// copyable, so copying one never allocates.
+class VMWord
+{
+public:
+
+  // creation functions for each kind of value
+  static VMWord from_int(int value);
+  static VMWord from_double(double value);
+  static VMWord from_bool(bool value);
+  static VMWord from_char(char value);
+  static VMWord from_string(const std::string* value);
+  static VMWord null();
+
+  // value kind checks
+  bool is_int() const;
+  bool is_double() const;
+  bool is_bool() const;
+  bool is_char() const;
+  bool is_string() const;
+  bool is_null() const;
+
+  // value accessors (the word must hold the corresponding kind)
+  int as_int() const;
+  double as_double() const;
+  bool as_bool() const;
+  char as_char() const;
+  const std::string& as_string() const;
+
+  // the raw bits of the word
+  std::uint64_t bits = 0;
+
+private:
+
+  static const std::uint64_t CANONICAL_NAN = 0x7FF8000000000000;
+  static const std::uint64_t PAYLOAD_MASK = 0x0000FFFFFFFFFFFF;
+  static const std::uint64_t INT_TAG = 0xFFF9000000000000;
+  static const std::uint64_t BOOL_TAG = 0xFFFA000000000000;
+  static const std::uint64_t STRING_TAG = 0xFFFB000000000000;
+  static const std::uint64_t NULL_TAG = 0xFFFC000000000000;
+  static const std::uint64_t CHAR_TAG = 0xFFFD000000000000;
+  static const std::uint64_t TAG_MASK = 0xFFFF000000000000;
+
+};
+
+static_assert(sizeof(VMWord) == 8, "vm words should be 8 bytes");
+
+
+// Owner of the immutable strings referred to by vm words
+class VMStringPool
+{
+public:
+
+  // copy the string into the pool, returning the word referring to it
+  VMWord add(const std::string& value);
+
+  // number of strings held by the pool
+  int size() const;
+
+private:
+
+  // strings never move once added (deque growth keeps references)
+  std::deque<std::string> strings;
+
+};
+
+
+// conversions between the two value representations
+VMWord to_word(const VMValue& value, VMStringPool& pool);
+VMValue to_value(VMWord word);
+
+// function to get a string representation of a vm word
+std::string to_string(VMWord word);
+
+
+//----------------------------------------------------------------------
+// Inline definitions (kept in the header so the checks and accessors
+// compile down to a few instructions)
+//----------------------------------------------------------------------
+
+inline VMWord VMWord::from_int(int value)
+{
+  return VMWord {INT_TAG | static_cast<std::uint32_t>(value)};
+}
+
+inline VMWord VMWord::from_double(double value)
+{
+  if (value != value)
+    return VMWord {CANONICAL_NAN};
+  return VMWord {std::bit_cast<std::uint64_t>(value)};
+}
+
+inline VMWord VMWord::from_bool(bool value)
+{
+  return VMWord {BOOL_TAG | static_cast<std::uint64_t>(value)};
+}
+
+inline VMWord VMWord::from_string(const std::string* value)
+{
+  return VMWord {STRING_TAG | reinterpret_cast<std::uint64_t>(value)};
+}
+
+inline VMWord VMWord::from_char(char value)
+{
+  return VMWord {CHAR_TAG | static_cast<unsigned char>(value)};
+}
+
+inline VMWord VMWord::null()
+{
+  return VMWord {NULL_TAG};
+}
+
+inline bool VMWord::is_int() const
+{
+  return (bits & TAG_MASK) == INT_TAG;
+}
+
+inline bool VMWord::is_double() const
+{
+  return bits < INT_TAG;
+}
+
+inline bool VMWord::is_bool() const
+{
+  return (bits & TAG_MASK) == BOOL_TAG;
+}
+
+inline bool VMWord::is_char() const
+{
+  return (bits & TAG_MASK) == CHAR_TAG;
+}
+
+inline bool VMWord::is_string() const
+{
+  return (bits & TAG_MASK) == STRING_TAG;
+}
+
+inline bool VMWord::is_null() const
+{
+  return bits == NULL_TAG;
+}
+
+inline int VMWord::as_int() const
+{
+  return static_cast<int>(static_cast<std::uint32_t>(bits));
+}
+
+inline double VMWord::as_double() const
+{
+  return std::bit_cast<double>(bits);
+}
+
+inline bool VMWord::as_bool() const
+{
+  return bits & 1;
+}
+
+inline char VMWord::as_char() const
+{
+  return static_cast<char>(bits & 0xFF);
+}
+
+inline const std::string& VMWord::as_string() const
+{
+  return *reinterpret_cast<const std::string*>(bits & PAYLOAD_MASK);
+}
+
+#endif
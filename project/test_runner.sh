@@ -34,3 +34,60 @@ cmp tests/output6.pl tests/output6.cs
 ./mypl prog7.mypl | tail -n +2 > tests/output7.pl
 ./mypl --csharp prog7.mypl | tail -n +11 > tests/output7.cs
 cmp tests/output7.pl tests/output7.cs
+
+# Programs 8-10 (compared across the vm's modes below)
+./mypl prog8.mypl | tail -n +2 > tests/output8.pl
+./mypl prog9.mypl | tail -n +2 > tests/output9.pl
+./mypl prog10.mypl | tail -n +2 > tests/output10.pl
+
+# Native backend (compared against the vm output)
+./mypl --native prog1.mypl | tail -n +2 > tests/output1.native
+cmp tests/output1.pl tests/output1.native
+./mypl --native prog2.mypl | tail -n +2 > tests/output2.native
+cmp tests/output2.pl tests/output2.native
+./mypl --native prog3.mypl | tail -n +2 > tests/output3.native
+cmp tests/output3.pl tests/output3.native
+./mypl --native prog4.mypl | tail -n +2 > tests/output4.native
+cmp tests/output4.pl tests/output4.native
+./mypl --native prog5.mypl | tail -n +2 > tests/output5.native
+cmp tests/output5.pl tests/output5.native
+./mypl --native prog6.mypl | tail -n +2 > tests/output6.native
+cmp tests/output6.pl tests/output6.native
+./mypl --native prog7.mypl | tail -n +2 > tests/output7.native
+cmp tests/output7.pl tests/output7.native
+./mypl --native prog9.mypl | tail -n +2 > tests/output9.native
+cmp tests/output9.pl tests/output9.native
+./mypl --native prog10.mypl | tail -n +2 > tests/output10.native
+cmp tests/output10.pl tests/output10.native
+
+# Optimized (-O1) code (compared against the vm output)
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    ./mypl -O1 prog$i.mypl | tail -n +2 > tests/output$i.opt
+    cmp tests/output$i.pl tests/output$i.opt
+done
+
+# Garbage collection stress (a one byte threshold collects as soon as
+# the heap is used, then each time it doubles, so collections happen
+# within calls and returns and between struct and array allocations)
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    ./mypl --gc-threshold=1 prog$i.mypl | tail -n +2 > tests/output$i.gc
+    cmp tests/output$i.pl tests/output$i.gc
+done
+
+# JIT (functions are compiled once called 1000 times, as in prog8)
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    ./mypl --jit prog$i.mypl | tail -n +2 > tests/output$i.jit
+    cmp tests/output$i.pl tests/output$i.jit
+done
+
+# Register engine (compared against the stack vm output)
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    ./mypl --engine=reg prog$i.mypl | tail -n +2 > tests/output$i.reg
+    cmp tests/output$i.pl tests/output$i.reg
+done
+
+# Optimized (-O1) register code (compared against the stack vm output)
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    ./mypl -O1 --engine=reg prog$i.mypl | tail -n +2 > tests/output$i.regopt
+    cmp tests/output$i.pl tests/output$i.regopt
+done
@@ -0,0 +1,125 @@
+//----------------------------------------------------------------------
+// FILE: mypl_ngrams.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Mines the most frequent opcode sequences (n-grams) run in a
+// corpus of traces written by mypl --trace, the candidates for
+// superinstructions. Only straight-line sequences count: consecutive
+// instructions of the same call, each at the pc after the last.
+//
+// Usage: mypl_ngrams [-n N] [-top K] trace-file...
+//   -n N    longest sequence length counted (2 to 8, default 4)
+//   -top K  sequences printed for each length (default 10)
+//----------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "vm_trace.h"
+
+using namespace std;
+
+
+// an n-gram packed as its opcodes (one byte each, first opcode in the
+// low byte) with its length in the top byte
+typedef uint64_t NGram;
+
+const int MAX_N = 8;
+
+
+// the last instructions run by a call (at most MAX_N)
+struct Window
+{
+  uint32_t function = 0;
+  uint32_t pc = 0;
+  vector<OpCode> ops;
+};
+
+
+string ngram_string(NGram gram)
+{
+  int n = gram >> 56;
+  string s = "";
+  for (int i = 0; i < n; ++i) {
+    s += i ? " " : "";
+    s += to_string(static_cast<OpCode>((gram >> (8 * i)) & 0xff));
+  }
+  return s;
+}
+
+
+int main(int argc, char* argv[])
+{
+  int max_n = 4;
+  int top = 10;
+  vector<string> files;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (arg == "-n" and i + 1 < argc)
+      max_n = stoi(argv[++i]);
+    else if (arg == "-top" and i + 1 < argc)
+      top = stoi(argv[++i]);
+    else
+      files.push_back(arg);
+  }
+  if (files.empty() or max_n < 2 or max_n > MAX_N) {
+    cerr << "Usage: mypl_ngrams [-n N] [-top K] trace-file..." << endl;
+    return 1;
+  }
+
+  unordered_map<NGram, long> counts;
+  vector<long> totals(max_n + 1, 0);
+  for (const string& file : files) {
+    ifstream in(file, ios::binary);
+    vector<string> names;
+    if (!read_trace_header(in, names)) {
+      cerr << "Error: '" << file << "' is not a mypl trace" << endl;
+      return 1;
+    }
+    // one window per call depth (a call's window is dropped once the
+    // trace is back in its caller)
+    vector<Window> windows;
+    VMTraceRecord r;
+    while (in.read(reinterpret_cast<char*>(&r), sizeof(r))) {
+      windows.resize(r.depth + 1);
+      Window& w = windows[r.depth];
+      if (w.ops.empty() or w.function != r.function or w.pc + 1 != r.pc)
+        w.ops.clear();
+      w.function = r.function;
+      w.pc = r.pc;
+      if (w.ops.size() == max_n)
+        w.ops.erase(w.ops.begin());
+      w.ops.push_back(r.opcode);
+      // the sequences ending at this instruction
+      NGram gram = 0;
+      for (int n = 1; n <= w.ops.size(); ++n) {
+        OpCode op = w.ops[w.ops.size() - n];
+        gram = (gram << 8) | static_cast<uint8_t>(op);
+        if (n >= 2) {
+          ++counts[(static_cast<NGram>(n) << 56) | gram];
+          ++totals[n];
+        }
+      }
+    }
+  }
+
+  for (int n = 2; n <= max_n; ++n) {
+    vector<pair<NGram, long>> grams;
+    for (auto [gram, count] : counts)
+      if ((gram >> 56) == n)
+        grams.push_back({gram, count});
+    sort(grams.begin(), grams.end(), [](auto& x, auto& y) {
+      return x.second > y.second;
+    });
+    printf("%s%d-grams (%ld)\n", n > 2 ? "\n" : "", n, totals[n]);
+    for (int i = 0; i < grams.size() and i < top; ++i)
+      printf("%14ld %7.2f%%  %s\n", grams[i].second,
+             100.0 * grams[i].second / totals[n],
+             ngram_string(grams[i].first).c_str());
+  }
+}
@@ -0,0 +1,77 @@
+//----------------------------------------------------------------------
+// FILE: mypl_trace.cpp
+// DATE: Spring 2023
+// AUTH: Santiago Calvillo
+// DESC: Prints the binary instruction traces written by mypl --trace
+// as text, one line per instruction:
+//
+//   depth function pc opcode top-of-stack
+//
+// Usage: mypl_trace [--summary] trace-file
+//   --summary prints only the instruction counts of each function
+//----------------------------------------------------------------------
+
+#include <bit>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "vm_trace.h"
+
+using namespace std;
+
+
+// the top-of-stack column of a record
+string top_string(const VMTraceRecord& r)
+{
+  switch (r.kind) {
+  case VMTraceKind::EMPTY: return "-";
+  case VMTraceKind::INT: return "int " + to_string((int) r.top);
+  case VMTraceKind::DOUBLE: return "double " + to_string(bit_cast<double>(r.top));
+  case VMTraceKind::BOOL: return r.top ? "bool true" : "bool false";
+  case VMTraceKind::CHAR: return "char " + to_string(r.top);
+  case VMTraceKind::STRING: return "string (" + to_string(r.top) + " chars)";
+  case VMTraceKind::NULLPTR: return "null";
+  }
+  return "?";
+}
+
+
+int main(int argc, char* argv[])
+{
+  bool summary = argc == 3 and string(argv[1]) == "--summary";
+  if (argc != 2 and !summary) {
+    cerr << "Usage: mypl_trace [--summary] trace-file" << endl;
+    return 1;
+  }
+  ifstream in(argv[argc - 1], ios::binary);
+  vector<string> names;
+  if (!read_trace_header(in, names)) {
+    cerr << "Error: '" << argv[argc - 1] << "' is not a mypl trace" << endl;
+    return 1;
+  }
+
+  vector<long> counts(names.size(), 0);
+  long total = 0;
+  VMTraceRecord r;
+  while (in.read(reinterpret_cast<char*>(&r), sizeof(r))) {
+    if (r.function >= names.size()) {
+      cerr << "Error: bad trace record " << total << endl;
+      return 1;
+    }
+    ++total;
+    if (summary) {
+      ++counts[r.function];
+      continue;
+    }
+    printf("%4u %-16s %5u %-12s %s\n", r.depth, names[r.function].c_str(),
+           r.pc, to_string(r.opcode).c_str(), top_string(r).c_str());
+  }
+  if (summary) {
+    for (int i = 0; i < names.size(); ++i)
+      if (counts[i] > 0)
+        printf("%-16s %12ld\n", names[i].c_str(), counts[i]);
+    printf("%-16s %12ld\n", "total", total);
+  }
+}